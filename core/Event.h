@@ -50,6 +50,7 @@ static std::vector<std::string> BLANK_NAMES;
 	E(EVENT_CUSTOM2) \
 	E(EVENT_CUSTOM3) \
 	E(EVENT_CUSTOM4) \
+	E(EVENT_SECTION) \
 	E(EVENT_CUSTOM) \
 	E(EVENT_MAX) \
 
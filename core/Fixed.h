@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#include "Vector.h"
+
+#define FIXED_BITS 16
+#define FIXED_ONE (1 << FIXED_BITS)
+
+//Signed 48.16 fixed point number, using only integer math so every machine gets the same results
+//Whole part covers about +-1.4e14, far past any world size, and products use 128 bit intermediates
+class Fixed {
+public:
+	int64_t raw = 0;
+
+	constexpr Fixed() {}
+
+	//Whole numbers convert exactly
+	constexpr Fixed(int value) : raw((int64_t)value * FIXED_ONE) {}
+
+	static constexpr Fixed fromRaw(int64_t raw) {
+		Fixed value;
+		value.raw = raw;
+		return value;
+	}
+
+	//Exact ratio, rounded toward zero
+	static constexpr Fixed fromRatio(int numerator, int denominator) {
+		return fromRaw(((int64_t)numerator * FIXED_ONE) / denominator);
+	}
+
+	//Only for loading settings, never for values calculated during play
+	static Fixed fromFloat(float value) {
+		return fromRaw(std::llround((double)value * FIXED_ONE));
+	}
+
+	float toFloat() const {
+		return (float)((double)raw / FIXED_ONE);
+	}
+
+	//Rounded toward negative infinity, for tile and pixel positions that fit in an int
+	int floor() const {
+		return (int)(raw >> FIXED_BITS);
+	}
+
+	Fixed abs() const {
+		return fromRaw(raw < 0 ? -raw : raw);
+	}
+
+	int sign() const {
+		return (raw > 0) - (raw < 0);
+	}
+
+	constexpr Fixed operator-() const {
+		return fromRaw(-raw);
+	}
+	constexpr Fixed operator+(Fixed other) const {
+		return fromRaw(raw + other.raw);
+	}
+	constexpr Fixed operator-(Fixed other) const {
+		return fromRaw(raw - other.raw);
+	}
+	constexpr Fixed operator*(Fixed other) const {
+		return fromRaw((int64_t)(((__int128)raw * other.raw) >> FIXED_BITS));
+	}
+	constexpr Fixed operator/(Fixed other) const {
+		return fromRaw((int64_t)(((__int128)raw * FIXED_ONE) / other.raw));
+	}
+
+	Fixed &operator+=(Fixed other) {
+		raw += other.raw;
+		return *this;
+	}
+	Fixed &operator-=(Fixed other) {
+		raw -= other.raw;
+		return *this;
+	}
+	Fixed &operator*=(Fixed other) {
+		return *this = *this * other;
+	}
+	Fixed &operator/=(Fixed other) {
+		return *this = *this / other;
+	}
+
+	constexpr bool operator==(const Fixed &other) const = default;
+	constexpr auto operator<=>(const Fixed &other) const {
+		return raw <=> other.raw;
+	}
+};
+
+typedef skVector2<Fixed> Vector2x;
+
+inline Vector2f toVector2f(Vector2x value) {
+	return Vector2f(value.x.toFloat(), value.y.toFloat());
+}
+
+inline Vector2x toVector2x(Vector2f value) {
+	return Vector2x(Fixed::fromFloat(value.x), Fixed::fromFloat(value.y));
+}
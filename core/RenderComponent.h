@@ -33,7 +33,14 @@ enum SK_RENDER_TYPE {
 	RENDER_GRADIENT_RECT,
 	RENDER_GRADIENT_ARRAY,
 	RENDER_PASSTHROUGH_BUFFER,
-	RENDER_STRING
+	RENDER_STRING,
+	RENDER_PIXEL_BUFFER
+};
+
+//Texture sampling for pixel buffers
+enum SK_FILTER_MODE {
+	SK_FILTER_NEAREST,
+	SK_FILTER_LINEAR
 };
 
 enum SK_UNIFORM_TYPE {
@@ -84,6 +91,10 @@ public:
 	virtual std::vector<skColor> *getColors() { throw new RENDERCOMPONENTERROR; }
 	virtual RenderComponent *getSubComponent() { throw new RENDERCOMPONENTERROR; }
 	virtual const char *getString() { throw new RENDERCOMPONENTERROR; }
+	virtual const unsigned char *getPixels() { throw new RENDERCOMPONENTERROR; }
+	virtual Vector2i getImageSize() { throw new RENDERCOMPONENTERROR; }
+	virtual Vector2i getDirtyRows() { throw new RENDERCOMPONENTERROR; }
+	virtual int getFilter() { throw new RENDERCOMPONENTERROR; }
 
 	//Optional setters
 	virtual void setBlendMode(int blendMode) { throw new RENDERCOMPONENTERROR; }
@@ -96,6 +107,9 @@ public:
 	virtual void setSubComponent(int type) { throw new RENDERCOMPONENTERROR; }
 	virtual void setSubComponent(RenderComponent *component) { throw new RENDERCOMPONENTERROR; }
 	virtual void setString(const char *text) { throw new RENDERCOMPONENTERROR; }
+	virtual void setImageSize(Vector2i size) { throw new RENDERCOMPONENTERROR; }
+	virtual void setFilter(int filter) { throw new RENDERCOMPONENTERROR; }
+	virtual void clearDirtyRows() { throw new RENDERCOMPONENTERROR; }
 };
 
 RenderComponent *createRenderComponent(int _type, Node *_source);
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "RenderComponent.h"
+#include "UpdateList.h"
 
 class TextureSingleRenderComponent : public RenderComponent {
 private:
@@ -465,6 +466,103 @@ public:
 	}
 };
 
+//Packed RGBA8 image, uploaded as one texture with only changed rows resent
+class PixelBufferRenderComponent : public RenderComponent {
+private:
+	int blendMode = 1;
+	sint texture = 0;
+	int filter = SK_FILTER_NEAREST;
+	int width = 0;
+	int height = 0;
+	std::vector<unsigned char> pixels;
+
+	//Rows changed since last upload
+	int dirtyStart = 0;
+	int dirtyEnd = 0;
+
+	void markRows(int start, int end) {
+		if(dirtyStart >= dirtyEnd) {
+			dirtyStart = start;
+			dirtyEnd = end;
+		} else {
+			dirtyStart = std::min(dirtyStart, start);
+			dirtyEnd = std::max(dirtyEnd, end);
+		}
+	}
+
+public:
+	PixelBufferRenderComponent(Node *source) : RenderComponent(source) {}
+
+	//Texture is only queued, the render thread frees it
+	~PixelBufferRenderComponent() {
+		UpdateList::releaseTexture(texture);
+	}
+
+	int getType() {
+		return RENDER_PIXEL_BUFFER;
+	}
+
+	int getBlendMode() {
+		return blendMode;
+	}
+	sint getTexture() {
+		return texture;
+	}
+	skColor getColor(sint i=0) {
+		if(i * 4 < pixels.size())
+			return skColor(&pixels[i * 4]);
+		return COLOR_PURPLE;
+	}
+	int getSize() {
+		return width;
+	}
+	const unsigned char *getPixels() {
+		return pixels.data();
+	}
+	Vector2i getImageSize() {
+		return Vector2i(width, height);
+	}
+	Vector2i getDirtyRows() {
+		return Vector2i(dirtyStart, dirtyEnd);
+	}
+	int getFilter() {
+		return filter;
+	}
+
+	void setBlendMode(int _blendMode) {
+		blendMode = _blendMode;
+	}
+	void setTexture(sint _texture) {
+		texture = _texture;
+	}
+	void setColor(skColor _color, sint i=0) {
+		if(width <= 0)
+			return;
+		if(i >= (sint)width * height)
+			setImageSize(Vector2i(width, i / width + 1));
+
+		unsigned char *pixel = &pixels[i * 4];
+		pixel[0] = _color.r();
+		pixel[1] = _color.g();
+		pixel[2] = _color.b();
+		pixel[3] = _color.a();
+		markRows(i / width, i / width + 1);
+	}
+	void setImageSize(Vector2i size) {
+		width = size.x;
+		height = size.y;
+		pixels.resize(width * height * 4, 0);
+		markRows(0, height);
+	}
+	void setFilter(int _filter) {
+		filter = _filter;
+		markRows(0, height);
+	}
+	void clearDirtyRows() {
+		dirtyStart = dirtyEnd = 0;
+	}
+};
+
 RenderComponent *createRenderComponent(int _type, Node *_source) {
 	switch(_type) {
 	case RENDER_NONE:
@@ -489,6 +587,8 @@ RenderComponent *createRenderComponent(int _type, Node *_source) {
 		return new StringRenderComponent(_source);
 	case RENDER_PASSTHROUGH_BUFFER:
 		return new PassthroughBufferRenderComponent(_source);
+	case RENDER_PIXEL_BUFFER:
+		return new PixelBufferRenderComponent(_source);
 	default:
 		return NULL;
 	}
@@ -2,6 +2,7 @@
 
 #include <string>
 #include <deque>
+#include <mutex>
 
 #include "Node.h"
 
@@ -139,6 +140,8 @@ private:
 	static std::vector<ResourceData> resourceData;
 	static std::vector<BufferData> bufferData;
 	static std::vector<ShaderUniform> shaderUniforms;
+	static std::vector<sint> releasedTextures;
+	static std::mutex releaseLock;
 
 	//Private internal functions
 	static int loadResource(std::string filename);
@@ -147,6 +150,7 @@ private:
 	static void draw(FloatRect cameraRect);
 	static void drawBuffer(sint buffer);
 	static void sendUniformValues(sint uniform);
+	static void freeTextures();
 	static void update(double time);
 
 public:
@@ -191,6 +195,7 @@ public:
 
 	//Resource handling
 	static sint createResource(sint texture, Vector2i size, sint index, int type);
+	static void releaseTexture(sint texture);
 	static ResourceData &getResourceData(sint index);
 	static sint getResourceCount();
 	static Vector2i getTextureSize(sint index);
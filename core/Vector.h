@@ -89,6 +89,12 @@ public:
 		return left <= rect.left+rect.width && left+width >= rect.left &&
 			top <= rect.top+rect.height && top+height >= rect.top;
 	}
+
+	//Half open, so rects that only touch don't count
+	bool overlaps(const Rect<T>& rect) const {
+		return left < rect.left+rect.width && rect.left < left+width &&
+			top < rect.top+rect.height && rect.top < top+height;
+	}
 };
 typedef Rect<int> IntRect;
 typedef Rect<float> FloatRect;
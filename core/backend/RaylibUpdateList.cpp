@@ -61,6 +61,8 @@ TimingStats DebugTimers::frameBufferTimes;
 std::vector<ResourceData> UpdateList::resourceData;
 std::vector<BufferData> UpdateList::bufferData;
 std::vector<ShaderUniform> UpdateList::shaderUniforms;
+std::vector<sint> UpdateList::releasedTextures;
+std::mutex UpdateList::releaseLock;
 
 //Raylib resources
 std::vector<Texture2D> textureSet;
@@ -152,6 +154,23 @@ sint UpdateList::createResource(sint texture, Vector2i size, sint index, int typ
 	return texture;
 }
 
+//Free textures queued by releaseTexture, leaving their slots unused
+void UpdateList::freeTextures() {
+	std::vector<sint> released;
+	{
+		std::lock_guard<std::mutex> guard(releaseLock);
+		released.swap(releasedTextures);
+	}
+	for(sint texture : released) {
+		if(texture == 0 || texture >= resourceData.size() || resourceData[texture].type != SK_TEXTURE)
+			continue;
+		UnloadTexture(textureSet[texture]);
+		textureSet[texture] = Texture2D{0};
+		resourceData[texture].type = SK_INVALID;
+		resourceData[texture].size = Vector2i(0, 0);
+	}
+}
+
 //Draw ImGui texture
 void UpdateList::drawImGuiTexture(sint texture, Vector2i size) {
 	if(texture >= resourceData.size() || !resourceData[texture].isTexture())
@@ -343,6 +362,41 @@ void UpdateList::drawNode(Node *source, sint passthrough) {
 			}
 		}
 		} break;
+	case RENDER_PIXEL_BUFFER: {
+		Vector2i size = rendering->getImageSize();
+		if(size.x <= 0 || size.y <= 0)
+			break;
+		int filter = rendering->getFilter() == SK_FILTER_LINEAR ? TEXTURE_FILTER_BILINEAR : TEXTURE_FILTER_POINT;
+		Vector2i dirty = rendering->getDirtyRows();
+
+		//Create texture on first draw or resize, otherwise send changed rows
+		if(texture == 0 || resourceData[texture].size != size) {
+			Image image = {(void*)rendering->getPixels(), size.x, size.y, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+			if(texture == 0) {
+				texture = createResource(0, size, 0, SK_TEXTURE);
+				rendering->setTexture(texture);
+			} else
+				UnloadTexture(textureSet[texture]);
+			textureSet[texture] = LoadTextureFromImage(image);
+			resourceData[texture].size = size;
+			SetTextureFilter(textureSet[texture], filter);
+		} else if(dirty.x < dirty.y) {
+			Rectangle rows = {0, (float)dirty.x, (float)size.x, (float)(dirty.y - dirty.x)};
+			UpdateTextureRec(textureSet[texture], rows, rendering->getPixels() + dirty.x * size.x * 4);
+			SetTextureFilter(textureSet[texture], filter);
+		}
+		rendering->clearDirtyRows();
+
+		//Linear filtering places each pixel on a cell corner, matching gradient arrays
+		Rectangle src = {0, 0, size.x*flip.x, size.y*flip.y};
+		Rectangle dst = {rect.left, rect.top, rect.width, rect.height};
+		if(rendering->getFilter() == SK_FILTER_LINEAR && size.x > 1 && size.y > 1) {
+			src = {0.5f, 0.5f, (size.x-1)*flip.x, (size.y-1)*flip.y};
+			dst.width = rect.width / size.x * (size.x-1);
+			dst.height = rect.height / size.y * (size.y-1);
+		}
+		DrawTexturePro(textureSet[texture], src, dst, Vector2{0, 0}, 0, WHITE);
+		} break;
 	case RENDER_STRING:
 		if(source->getString() != NULL && resourceData[texture].type == SK_FONT)
 			DrawTextEx(fontSet[resourceData[texture].index], source->getString(), Vector2{rect.left, rect.top}, rendering->getSize(), 1, color);
@@ -393,9 +447,11 @@ void UpdateList::drawBuffer(sint bIndex) {
 	sint rIndex = data.texture;
 	//std::cout << "INFO: BUFFER: " << rIndex << "\n";
 
-	//Create buffer object
+	//Create buffer object at its own index, since buffers can first draw in any order
 	if(resourceData[rIndex].type == SK_INVALID_BUFFER) {
-		bufferSet.push_back(LoadRenderTexture(data.size.x, data.size.y));
+		if(bufferSet.size() <= bIndex)
+			bufferSet.resize(bIndex + 1);
+		bufferSet[bIndex] = LoadRenderTexture(data.size.x, data.size.y);
 		textureSet[rIndex] = bufferSet[bIndex].texture;
 		resourceData[rIndex].type = SK_BUFFER;
 	}
@@ -619,6 +675,7 @@ void UpdateList::frame(void) {
 		dit = deleted2.erase(dit);
 		delete node;
 	}
+	freeTextures();
 	//DebugTimers::frameLiteralTimes.addDelta(GetTime()-lastTime);
 
 	EndDrawing();
@@ -336,6 +336,12 @@ sint UpdateList::createBuffer(BufferData data) {
 	return data.texture;
 }
 
+//Queue a texture made with createResource to be freed on the render thread after the next frame
+void UpdateList::releaseTexture(sint texture) {
+	std::lock_guard<std::mutex> guard(releaseLock);
+	releasedTextures.push_back(texture);
+}
+
 //Schedule buffer draw before next draw
 void UpdateList::scheduleBufferRefresh(sint texture) {
 	bufferData[resourceData[texture].index].redraw = true;
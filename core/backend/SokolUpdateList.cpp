@@ -81,6 +81,8 @@ TimingStats DebugTimers::frameBufferTimes;
 std::vector<ResourceData> UpdateList::resourceData;
 std::vector<BufferData> UpdateList::bufferData;
 std::vector<ShaderUniform> UpdateList::shaderUniforms;
+std::vector<sint> UpdateList::releasedTextures;
+std::mutex UpdateList::releaseLock;
 
 //Sokol textures
 std::vector<sg_image> textureSet;
@@ -158,6 +160,23 @@ sint UpdateList::createResource(sint texture, Vector2i size, sint index, int typ
 	return texture;
 }
 
+//Free textures queued by releaseTexture, leaving their slots unused
+void UpdateList::freeTextures() {
+	std::vector<sint> released;
+	{
+		std::lock_guard<std::mutex> guard(releaseLock);
+		released.swap(releasedTextures);
+	}
+	for(sint texture : released) {
+		if(texture == 0 || texture >= resourceData.size() || resourceData[texture].type != SK_TEXTURE)
+			continue;
+		sg_destroy_image(textureSet[texture]);
+		textureSet[texture] = sg_image{SG_INVALID_ID};
+		resourceData[texture].type = SK_INVALID;
+		resourceData[texture].size = Vector2i(0, 0);
+	}
+}
+
 //Draw ImGui texture
 void UpdateList::drawImGuiTexture(sint texture, Vector2i size) {
 	if(texture >= resourceData.size() || !resourceData[texture].isTexture())
@@ -251,6 +270,18 @@ void sgp_set_color(skColor color) {
 	sgp_set_color(color.red, color.green, color.blue, color.alpha);
 }
 
+//Shared samplers for pixel buffers, by SK_FILTER_MODE
+static sg_sampler pixelSampler(int filter) {
+	static sg_sampler samplers[2] = {{SG_INVALID_ID}, {SG_INVALID_ID}};
+	if(samplers[filter].id == SG_INVALID_ID) {
+		sg_sampler_desc sampler_desc = {0};
+		sampler_desc.min_filter = sampler_desc.mag_filter = (filter == SK_FILTER_LINEAR) ? SG_FILTER_LINEAR : SG_FILTER_NEAREST;
+		sampler_desc.wrap_u = sampler_desc.wrap_v = SG_WRAP_CLAMP_TO_EDGE;
+		samplers[filter] = sg_make_sampler(&sampler_desc);
+	}
+	return samplers[filter];
+}
+
 void UpdateList::drawNode(Node *source, sint passthrough) {
 	FloatRect rect = source->getRect();
 	RenderComponent *rendering = source->getRenderComponent(false);
@@ -376,6 +407,54 @@ void UpdateList::drawNode(Node *source, sint passthrough) {
 			}
 		}
 		} break;
+	case RENDER_PIXEL_BUFFER: {
+		Vector2i size = rendering->getImageSize();
+		if(size.x <= 0 || size.y <= 0)
+			break;
+
+		//Create streamed image on first draw or resize
+		if(texture == 0 || resourceData[texture].size != size) {
+			if(texture == 0) {
+				texture = createResource(0, size, 0, SK_TEXTURE);
+				rendering->setTexture(texture);
+			} else
+				sg_destroy_image(textureSet[texture]);
+
+			sg_image_desc image_desc = {0};
+			image_desc.width = size.x;
+			image_desc.height = size.y;
+			image_desc.pixel_format = SG_PIXELFORMAT_RGBA8;
+			image_desc.usage.stream_update = true;
+			textureSet[texture] = sg_make_image(&image_desc);
+			resourceData[texture].size = size;
+		}
+
+		//Sokol only replaces whole images, so any changed row resends all
+		Vector2i dirty = rendering->getDirtyRows();
+		if(dirty.x < dirty.y) {
+			sg_image_data image_data = {};
+			image_data.mip_levels[0].ptr = rendering->getPixels();
+			image_data.mip_levels[0].size = (size_t)(size.x * size.y * 4);
+			sg_update_image(textureSet[texture], &image_data);
+			rendering->clearDirtyRows();
+		}
+
+		//Linear filtering places each pixel on a cell corner, matching gradient arrays
+		sgp_rect src = {0, 0, size.x*flip.x, size.y*flip.y};
+		sgp_rect dst = {rect.left, rect.top, rect.width, rect.height};
+		int filter = rendering->getFilter();
+		if(filter == SK_FILTER_LINEAR && size.x > 1 && size.y > 1) {
+			src = {0.5f, 0.5f, (size.x-1)*flip.x, (size.y-1)*flip.y};
+			dst.w = rect.width / size.x * (size.x-1);
+			dst.h = rect.height / size.y * (size.y-1);
+		}
+		sgp_set_color(COLOR_WHITE);
+		sgp_set_image(0, textureSet[texture]);
+		sgp_set_sampler(0, pixelSampler(filter));
+		sgp_draw_textured_rect(0, dst, src);
+		sgp_reset_sampler(0);
+		sgp_reset_image(0);
+		} break;
 	case RENDER_STRING:
 		//if(source->getString() != NULL && resourceData[texture].type == SK_FONT)
 		//	DrawTextEx(fontSet[resourceData[texture].index], source->getString(), Vector2{rect.left, rect.top}, rendering->getSize(), 1, color);
@@ -447,7 +526,11 @@ void finilizeBuffer(BufferData data) {
             .image = color_img,
         },
     };
-    bufferSet.push_back(sg_make_view(&simg_view_desc));
+	//Buffers can be drawn for the first time in any order, so keep each at its own index
+	sint bIndex = UpdateList::getResourceData(texture).index;
+	if(bufferSet.size() <= bIndex)
+		bufferSet.resize(bIndex + 1);
+	bufferSet[bIndex] = sg_make_view(&simg_view_desc);
 
 	textureSet[texture] = color_img;
 }
@@ -726,6 +809,7 @@ void UpdateList::frame(void) {
 		dit = deleted2.erase(dit);
 		delete node;
 	}
+	freeTextures();
 }
 
 void UpdateList::init(void) {
@@ -58,7 +58,7 @@ public:
 		ImGui::SliderInt("Color Divisions", &testDivisions, 2, 100);
 		if(testDivisions != limitIndexer->fallback) {
 			testDivisions = 100 / round(100.0 / testDivisions);
-			limitIndexer->fallback = testDivisions;
+			limitIndexer->setConst(testDivisions);
 			noiseIndexer->multiplier = 100 / testDivisions;
 			randomIndexer->multiplier = 100 / testDivisions;
 			redraw = true;
@@ -0,0 +1,196 @@
+#include "FixedPhysics.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#define FIXED_JUMP_WINDOW Fixed::fromRatio(1, 5)
+
+static int floorDivide(int value, int divisor) {
+	return (value >= 0) ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+FixedPhysicsStats::FixedPhysicsStats(const GlobalPhysicsStats &stats) {
+	jumpPower = Fixed(stats.jumpPower);
+	fallSpeed = Fixed(stats.fallSpeed);
+	fallMax = Fixed::fromFloat(stats.fallMax);
+	slideSpeed = Fixed(stats.slideSpeed);
+	slideMax = Fixed(stats.slideMax);
+	slideReverse = Fixed(stats.slideReverse);
+}
+
+FixedPhysics::FixedPhysics(const CollisionGrid *_collision, const CollisionGrid *_frictionMap,
+	const GlobalPhysicsStats &_stats, int _tickRate)
+	: collision(_collision), frictionMap(_frictionMap), stats(_stats), tickRate(_tickRate) {
+
+	if(tickRate <= 0)
+		throw new std::invalid_argument("Physics tick rate must be positive");
+	tickTime = Fixed::fromRatio(1, tickRate);
+}
+
+int FixedPhysics::addBody(Vector2f position, Vector2i size) {
+	FixedBody body;
+	body.position = toVector2x(position);
+	body.size = size;
+	bodies.push_back(body);
+	return bodies.size() - 1;
+}
+
+int FixedPhysics::getTile(const CollisionGrid *grid, Vector2x position) const {
+	Vector2i scale = grid->getScale();
+	return grid->getTileI(floorDivide(position.x.floor(), scale.x), floorDivide(position.y.floor(), scale.y));
+}
+
+Vector2x FixedPhysics::snapPosition(Vector2x position) const {
+	Vector2i scale = collision->getScale();
+	return Vector2x(Fixed(floorDivide(position.x.floor(), scale.x) * scale.x),
+		Fixed(floorDivide(position.y.floor(), scale.y) * scale.y));
+}
+
+//Same rules as platformFrictionMovement
+Fixed FixedPhysics::frictionStep(const FixedBody &body, Fixed move) const {
+	Vector2x foot = Vector2x(body.position.x, body.position.y + Fixed(body.size.y / 2 - 2));
+	Vector2x footL = foot - Vector2x(Fixed(body.size.x / 2), 0);
+	Vector2x footR = foot + Vector2x(Fixed(body.size.x / 2), 0);
+	foot.y += Fixed(6);
+
+	Fixed netFriction = Fixed(getTile(frictionMap, foot)) / Fixed(100) * body.frictionValue;
+	netFriction = std::clamp(netFriction, Fixed::fromRatio(1, 100), Fixed(1));
+	int tile = getTile(collision, foot);
+	int tileL = getTile(collision, footL);
+	int tileR = getTile(collision, footR);
+	if(netFriction < Fixed(1) && (tile != EMPTY || tileL == SLOPE_UPLEFT || tileR == SLOPE_UPRIGHT)) {
+		move *= netFriction;
+		move += body.previous.x * (Fixed(1) - netFriction / Fixed(3)) * tickTime;
+
+		if((tileL == SLOPE_UPLEFT || tile == SLOPE_UPLEFT) && move > -stats.slideReverse) {
+			move += stats.slideSpeed * (Fixed(1) - netFriction) * tickTime;
+			move = std::min(move, stats.slideMax * tickTime);
+		}
+		if((tileR == SLOPE_UPRIGHT || tile == SLOPE_UPRIGHT) && move < stats.slideReverse) {
+			move -= stats.slideSpeed * (Fixed(1) - netFriction) * tickTime;
+			move = std::max(move, -(stats.slideMax * tickTime));
+		}
+	}
+	return move;
+}
+
+//Same rules as platformGravityMovement, without pushing other bodies
+Vector2x FixedPhysics::gravityStep(FixedBody &body, Fixed move, bool jump) const {
+	Vector2x start = body.position;
+	Vector2x velocity = Vector2x(move, 0);
+	Vector2x foot = Vector2x(start.x, start.y + Fixed(body.size.y / 2 + 4));
+
+	//Check for wall
+	Vector2x collisionOffset = velocity + Vector2x(Fixed(velocity.x.sign() * (body.size.x / 2)), Fixed(body.size.y / 4));
+	if(body.previous.y != Fixed(0) || foot.y - Fixed(8) < snapPosition(foot).y) {
+		int ahead = getTile(collision, start + collisionOffset);
+		int current = getTile(collision, start);
+		if(ahead == FULL)
+			velocity.x = 0;
+		else if(velocity.x > Fixed(0) && current != SLOPE_UPLEFT && ahead == SLOPE_UPLEFT)
+			velocity.x = 0;
+		else if(velocity.x < Fixed(0) && current != SLOPE_UPRIGHT && ahead == SLOPE_UPRIGHT)
+			velocity.x = 0;
+		body.blocked = move.abs() > Fixed::fromRatio(1, 10) && velocity.x.abs() < Fixed::fromRatio(1, 10);
+	}
+
+	//Falling and jumping
+	foot += velocity;
+	Vector2x footL = foot - Vector2x(Fixed(body.size.x / 4), 0);
+	Vector2x footR = foot + Vector2x(Fixed(body.size.x / 4), 0);
+	if(getTile(collision, footL) == EMPTY && getTile(collision, footR) == EMPTY) {
+		if(body.jumpTime > FIXED_JUMP_WINDOW || !jump)
+			body.previous.y += stats.fallSpeed;
+		body.previous.y = std::min(body.previous.y, stats.fallMax);
+		velocity.y += body.previous.y * tickTime;
+
+		//Ceiling check
+		int ceiling = getTile(collision, start + velocity);
+		if(ceiling != EMPTY && ceiling != ONEWAY_UP) {
+			body.previous.y = 0;
+			velocity.y = 0;
+			body.jumpTime += FIXED_JUMP_WINDOW;
+		}
+
+		foot.y += body.previous.y * tickTime;
+		body.jumpTime += tickTime;
+	} else if(jump && body.jumpTime == Fixed(0)) {
+		//Start jump
+		body.previous.y = -stats.jumpPower;
+		velocity.y += body.previous.y * tickTime;
+	}
+
+	//Snap to ground
+	int tile = getTile(collision, foot);
+	if(tile != EMPTY && !(jump && body.jumpTime < FIXED_JUMP_WINDOW)) {
+		Vector2x ground = snapPosition(foot);
+		Vector2x foot2 = foot - Vector2x(0, Fixed(8));
+
+		//Allow for upwards slope
+		int above = getTile(collision, foot2);
+		if(tile != SLOPE_UPLEFT && tile != SLOPE_UPRIGHT && (above == SLOPE_UPLEFT || above == SLOPE_UPRIGHT)) {
+			foot = foot2;
+			ground = snapPosition(foot);
+		}
+		velocity.y += ground.y - start.y - Fixed(body.size.y / 2);
+
+		tile = getTile(collision, foot);
+		if(tile == SLOPE_UPLEFT)
+			velocity.y -= ground.x - start.x;
+		else if(tile == SLOPE_UPRIGHT)
+			velocity.y -= start.x - ground.x - Fixed(collision->getScale().x);
+
+		velocity.y = std::min(std::max(body.snapSpeed, body.previous.y * tickTime), velocity.y);
+		if(velocity.y == Fixed(0)) {
+			body.previous.y = 0;
+			body.jumpTime = 0;
+		}
+	}
+
+	velocity.x *= Fixed(1) - std::clamp(body.weight, Fixed(0), Fixed(1));
+	body.previous.x = velocity.x / tickTime;
+	return velocity;
+}
+
+void FixedPhysics::step(const std::vector<FixedInput> &inputs) {
+	if(inputs.size() != bodies.size())
+		throw new std::invalid_argument("Physics step needs one input per body");
+
+	for(int i = 0; i < (int)bodies.size(); i++) {
+		Fixed move = inputs[i].move * tickTime;
+		if(frictionMap != NULL)
+			move = frictionStep(bodies[i], move);
+		bodies[i].position += gravityStep(bodies[i], move, inputs[i].jump);
+	}
+	tick++;
+}
+
+//Frame time only decides when ticks run, never what they calculate
+int FixedPhysics::advance(double time) {
+	accumulator += time;
+	int due = accumulator * tickRate;
+	accumulator -= (double)due / tickRate;
+	return due;
+}
+
+//FNV-1a over every value that affects later ticks
+uint64_t FixedPhysics::getStateHash() {
+	uint64_t hash = 14695981039346656037ull;
+	auto add = [&](int64_t value) {
+		for(int b = 0; b < 8; b++) {
+			hash ^= (uint8_t)(value >> (b * 8));
+			hash *= 1099511628211ull;
+		}
+	};
+
+	add(tick);
+	for(const FixedBody &body : bodies) {
+		add(body.position.x.raw);
+		add(body.position.y.raw);
+		add(body.previous.x.raw);
+		add(body.previous.y.raw);
+		add(body.jumpTime.raw);
+		add(body.blocked);
+	}
+	return hash;
+}
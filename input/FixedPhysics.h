@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "../core/Fixed.h"
+#include "MovementSystems.h"
+
+/*
+ * Platformer physics on a fixed tick with fixed point math, so every machine given the same inputs stays in sync
+ */
+
+//GlobalPhysicsStats converted once at setup
+struct FixedPhysicsStats {
+	Fixed jumpPower;
+	Fixed fallSpeed;
+	Fixed fallMax;
+	Fixed slideSpeed;
+	Fixed slideMax;
+	Fixed slideReverse;
+
+	FixedPhysicsStats(const GlobalPhysicsStats &stats);
+};
+
+struct FixedBody {
+	Vector2x position;
+	Vector2i size = Vector2i(1, 1);
+	Vector2x previous;
+	Fixed jumpTime;
+	Fixed weight;
+	Fixed snapSpeed = Fixed(2);
+	Fixed frictionValue = Fixed(1);
+	bool blocked = false;
+};
+
+//Only inputs need to be shared between machines
+struct FixedInput {
+	Fixed move;
+	bool jump = false;
+};
+
+class FixedPhysics {
+private:
+	const CollisionGrid *collision;
+	const CollisionGrid *frictionMap;
+	FixedPhysicsStats stats;
+	int tickRate;
+	Fixed tickTime;
+
+	std::vector<FixedBody> bodies;
+	uint tick = 0;
+	double accumulator = 0;
+
+	int getTile(const CollisionGrid *grid, Vector2x position) const;
+	Vector2x snapPosition(Vector2x position) const;
+	Fixed frictionStep(const FixedBody &body, Fixed move) const;
+	Vector2x gravityStep(FixedBody &body, Fixed move, bool jump) const;
+
+public:
+	//Friction map may be NULL, tick rate is in ticks per second
+	FixedPhysics(const CollisionGrid *_collision, const CollisionGrid *_frictionMap,
+		const GlobalPhysicsStats &_stats, int _tickRate=60);
+
+	int addBody(Vector2f position, Vector2i size);
+
+	FixedBody &getBody(int i) {
+		return bodies[i];
+	}
+
+	int count() {
+		return bodies.size();
+	}
+
+	//Run one tick, with one input per body, where move is horizontal speed per second
+	void step(const std::vector<FixedInput> &inputs);
+
+	//Number of ticks due after frame time passes, to be run with step
+	int advance(double time);
+
+	//Progress between the last tick and the next, for smoothing rendered positions
+	float getAlpha() {
+		return accumulator * tickRate;
+	}
+
+	uint getTick() {
+		return tick;
+	}
+
+	//Compare between machines to detect desyncs
+	uint64_t getStateHash();
+
+	//Save and rewind for rollback
+	std::vector<FixedBody> getState() {
+		return bodies;
+	}
+	void setState(const std::vector<FixedBody> &state, uint _tick) {
+		bodies = state;
+		tick = _tick;
+	}
+};
@@ -1,4 +1,5 @@
 #include "MovementSystems.h"
+#include "../util/Parallel.hpp"
 
 int CLOCKWISE_DIR[] = {0, 2, 4, 6, 1, 3, 5, 7};
 int clockwiseDirection(int dir) {
@@ -34,6 +35,11 @@ Vector2f topDownMovement(Node *node, Vector2f move, Indexer *collision, double d
 	return topDownMovement(node->getGPosition(), vectorLength(move, distance), node->getSize(), collision);
 }
 
+Vector2f topDownMovement(Node *node, const FlowField *field, Indexer *collision, double distance) {
+	Vector2f move = field->getDirection(node->getGPosition());
+	return topDownMovement(node->getGPosition(), vectorLength(move, distance), node->getSize(), collision);
+}
+
 int topDownDirection(Vector2f movement) {
 	if(movement.x == 0)
 		return (movement.y < 0) ? UP : DOWN;
@@ -46,8 +52,10 @@ int topDownDirection(Vector2f movement) {
 	return DOWN;
 }
 
-Vector2f platformFrictionMovement(Vector2f start, Vector2f move, Vector2i size, double time,
-	Vector2f previous, Indexer *collision, Indexer *frictionMap, float frictionValue,
+//Shared by single and batched movement, with Grid being either an Indexer or a CollisionGrid
+template<class Grid>
+static Vector2f frictionStep(Vector2f start, Vector2f move, Vector2i size, double time,
+	Vector2f previous, Grid *collision, Grid *frictionMap, float frictionValue,
 	GlobalPhysicsStats *globalPhysics) {
 
 	Vector2f foot = Vector2f(start.x, start.y + size.y / 2 - 2);
@@ -76,6 +84,13 @@ Vector2f platformFrictionMovement(Vector2f start, Vector2f move, Vector2i size,
 	return move;
 }
 
+Vector2f platformFrictionMovement(Vector2f start, Vector2f move, Vector2i size, double time,
+	Vector2f previous, Indexer *collision, Indexer *frictionMap, float frictionValue,
+	GlobalPhysicsStats *globalPhysics) {
+
+	return frictionStep(start, move, size, time, previous, collision, frictionMap, frictionValue, globalPhysics);
+}
+
 bool isAbove(Vector2f position, Vector2i size, Vector2f otherPosition, Vector2i otherSize) {
 	float dx = position.x - otherPosition.x;
 	float dy = (otherPosition.y - otherSize.y/2) - (position.y + size.y/4);
@@ -83,8 +98,9 @@ bool isAbove(Vector2f position, Vector2i size, Vector2f otherPosition, Vector2i
 	return std::abs(dx) < side && dy > 0;
 }
 
-Vector2f platformGravityMovement(Vector2f start, Vector2f move, Vector2i size, double time, bool jumpInput,
-	Indexer *collision, GlobalPhysicsStats *globalPhysics, PersonalPhysicsStats *physics, std::vector<PersonalPhysicsStats *> colliding) {
+template<class Grid>
+static Vector2f gravityStep(Vector2f start, Vector2f move, Vector2i size, double time, bool jumpInput,
+	Grid *collision, GlobalPhysicsStats *globalPhysics, PersonalPhysicsStats *physics, const std::vector<PersonalPhysicsStats *> &colliding) {
 
 	Vector2f velocity = Vector2f(move.x, 0);
 	Vector2f foot = Vector2f(start.x, start.y + physics->nodeSize.y / 2 + 4);
@@ -196,7 +212,6 @@ Vector2f platformGravityMovement(Vector2f start, Vector2f move, Vector2i size, d
 			physics->pushWeight += other->pushWeight;
 		}
 	}
-	colliding.clear();
 
 	physics->pushWeight += physics->weight;
 	velocity.x *= 1-std::clamp(0.0f, physics->pushWeight, 1.0f);
@@ -215,4 +230,127 @@ Vector2f platformGravityMovement(Vector2f start, Vector2f move, Vector2i size, d
 
 	physics->previous.x = velocity.x / time;
 	return velocity;
-}
\ No newline at end of file
+}
+
+Vector2f platformGravityMovement(Vector2f start, Vector2f move, Vector2i size, double time, bool jumpInput,
+	Indexer *collision, GlobalPhysicsStats *globalPhysics, PersonalPhysicsStats *physics, const std::vector<PersonalPhysicsStats *> &colliding) {
+
+	return gravityStep(start, move, size, time, jumpInput, collision, globalPhysics, physics, colliding);
+}
+
+CollisionGrid::CollisionGrid(Indexer *_source) : source(_source) {
+	size = source->getSize();
+	scale = source->getScale();
+	fallback = source->fallback;
+	tiles.resize(size.x * size.y);
+	source->getBlock(IntRect(0, 0, size.x, size.y), tiles.data(), size.x);
+	gridVersion = source->getUpdateCount();
+}
+
+//Copy only changed areas
+void CollisionGrid::refresh() {
+	uint version = source->getUpdateCount();
+	if(version == gridVersion)
+		return;
+
+	for(IntRect area : source->getChanges(gridVersion, version)) {
+		int left = std::max(area.left, 0);
+		int top = std::max(area.top, 0);
+		int right = std::min(area.left + area.width, size.x);
+		int bottom = std::min(area.top + area.height, size.y);
+		if(left < right && top < bottom)
+			source->getBlock(IntRect(left, top, right - left, bottom - top), tiles.data() + left + top * size.x, size.x);
+	}
+	gridVersion = version;
+}
+
+int MovementBatch::add(Vector2f position, Vector2i size) {
+	positions.push_back(position);
+	sizes.push_back(size);
+	moves.emplace_back(0, 0);
+	physics.emplace_back();
+	physics.back().nodePosition = position;
+	physics.back().nodeSize = size;
+	jumpInputs.push_back(false);
+	frictionValues.push_back(1);
+	return positions.size() - 1;
+}
+
+//First tile along one axis that blocks a box moving from edge to target, or target if none
+static float sweepAxis(const CollisionGrid &collision, bool horizontal, float edge, float target,
+	float sideStart, float sideEnd) {
+
+	Vector2i scale = collision.getScale();
+	float step = horizontal ? scale.x : scale.y;
+	float sideStep = horizontal ? scale.y : scale.x;
+	int first = std::floor(sideStart / sideStep);
+	int last = std::ceil(sideEnd / sideStep) - 1;
+
+	//Tiles the leading edge enters, in order
+	int from, to, direction;
+	if(target > edge) {
+		from = std::ceil(edge / step);
+		to = std::ceil(target / step) - 1;
+		direction = 1;
+	} else {
+		from = std::floor(edge / step) - 1;
+		to = std::floor(target / step);
+		direction = -1;
+	}
+
+	for(int line = from; (to - line) * direction >= 0; line += direction) {
+		for(int side = first; side <= last; side++) {
+			int tile = horizontal ? collision.getTileI(line, side) : collision.getTileI(side, line);
+			if(tile != EMPTY)
+				return (direction > 0) ? line * step : (line + 1) * step;
+		}
+	}
+	return target;
+}
+
+void topDownMovement(MovementBatch &batch, const CollisionGrid &collision, int threads) {
+	parallelRange(batch.count(), threads, [&](int start, int end) {
+		for(int i = start; i < end; i++) {
+			Vector2f position = batch.positions[i];
+			Vector2f half = Vector2f(batch.sizes[i].x / 2.0f, batch.sizes[i].y / 2.0f);
+			Vector2f move = batch.moves[i];
+
+			//Horizontal first, then vertical from the new position
+			if(move.x != 0) {
+				float edge = position.x + ((move.x > 0) ? half.x : -half.x);
+				float reached = sweepAxis(collision, true, edge, edge + move.x, position.y - half.y, position.y + half.y);
+				move.x = reached - edge;
+				position.x += move.x;
+			}
+			if(move.y != 0) {
+				float edge = position.y + ((move.y > 0) ? half.y : -half.y);
+				float reached = sweepAxis(collision, false, edge, edge + move.y, position.x - half.x, position.x + half.x);
+				move.y = reached - edge;
+				position.y += move.y;
+			}
+
+			batch.moves[i] = move;
+			batch.positions[i] = position;
+		}
+	});
+}
+
+void platformMovement(MovementBatch &batch, double time, const CollisionGrid &collision,
+	const CollisionGrid *frictionMap, GlobalPhysicsStats *globalPhysics, int threads) {
+
+	static const std::vector<PersonalPhysicsStats *> colliding;
+	parallelRange(batch.count(), threads, [&](int start, int end) {
+		for(int i = start; i < end; i++) {
+			PersonalPhysicsStats *physics = &batch.physics[i];
+			Vector2f move = batch.moves[i];
+			if(frictionMap != NULL)
+				move = frictionStep(batch.positions[i], move, batch.sizes[i], time, physics->previous,
+					&collision, frictionMap, batch.frictionValues[i], globalPhysics);
+
+			move = gravityStep(batch.positions[i], move, batch.sizes[i], time, (bool)batch.jumpInputs[i],
+				&collision, globalPhysics, physics, colliding);
+			batch.moves[i] = move;
+			batch.positions[i] += move;
+		}
+	});
+}
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <cstdint>
+#include <vector>
+
 #include "../tiling/GridMaker.h"
+#include "../tiling/FlowField.h"
 #include "InputHandler.h"
 #include "MovementEnums.h"
 
@@ -12,6 +16,9 @@ Vector2f topDownMovement(Vector2f start, Vector2f move, Vector2i size, Indexer *
 Vector2f topDownMovement(Node *node, Vector2f move, Indexer *collision);
 Vector2f topDownMovement(Node *node, Vector2f move, Indexer *collision, double distance);
 
+//Follow a shared flow field toward its goals
+Vector2f topDownMovement(Node *node, const FlowField *field, Indexer *collision, double distance);
+
 //Convert vector to MovementDirection (default to down)
 int topDownDirection(Vector2f movement);
 
@@ -51,4 +58,68 @@ Vector2f platformFrictionMovement(Vector2f start, Vector2f move, Vector2i size,
 	Vector2f previous, Indexer *collision, Indexer *frictionMap, float frictionValue,
 	GlobalPhysicsStats *globalPhysics);
 Vector2f platformGravityMovement(Vector2f start, Vector2f move, Vector2i size, double time, bool jumpInput,
-	Indexer *collision, GlobalPhysicsStats *globalPhysics, PersonalPhysicsStats *physics, std::vector<PersonalPhysicsStats *> colliding);
\ No newline at end of file
+	Indexer *collision, GlobalPhysicsStats *globalPhysics, PersonalPhysicsStats *physics, const std::vector<PersonalPhysicsStats *> &colliding);
+
+//Flat copy of a collision indexer, read without virtual calls, matching Indexer::getTile on square grids
+class CollisionGrid {
+private:
+	Indexer *source;
+	Vector2i size;
+	Vector2i scale;
+	int fallback;
+	std::vector<int> tiles;
+	uint gridVersion = 0;
+
+public:
+	CollisionGrid(Indexer *_source);
+
+	//Copy changed tiles from source, usually once per frame
+	void refresh();
+
+	int getTileI(int x, int y) const {
+		if(x < 0 || y < 0 || x >= size.x || y >= size.y)
+			return fallback;
+		return tiles[x + y * size.x];
+	}
+
+	int getTile(Vector2f position) const {
+		return getTileI(position.x / scale.x, position.y / scale.y);
+	}
+
+	Vector2f snapPosition(Vector2f position) const {
+		int x = position.x / scale.x;
+		int y = position.y / scale.y;
+		return Vector2f(x * scale.x, y * scale.y);
+	}
+
+	Vector2i getScale() const {
+		return scale;
+	}
+
+	Vector2i getSize() const {
+		return size;
+	}
+};
+
+//Agents as parallel arrays, with positions at the center of each box
+struct MovementBatch {
+	std::vector<Vector2f> positions;
+	std::vector<Vector2i> sizes;
+	std::vector<Vector2f> moves;
+	std::vector<PersonalPhysicsStats> physics;
+	std::vector<uint8_t> jumpInputs;
+	std::vector<float> frictionValues;
+
+	int add(Vector2f position, Vector2i size);
+	int count() const {
+		return positions.size();
+	}
+};
+
+//Sweep each box along its move, stopping flush against any tile that isn't EMPTY
+//Moves are replaced with the distance actually moved and added to positions
+void topDownMovement(MovementBatch &batch, const CollisionGrid &collision, int threads=1);
+
+//Friction then gravity for each agent, the same as the single agent functions without pushing between agents
+void platformMovement(MovementBatch &batch, double time, const CollisionGrid &collision,
+	const CollisionGrid *frictionMap, GlobalPhysicsStats *globalPhysics, int threads=1);
\ No newline at end of file
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+#include "GridMaker.h"
+
+#define CACHE_CHUNK_SIZE 32
+
+/*
+ * Stores the output of an indexer stack for repeated reads
+ */
+
+//Lazily fills chunks of a dense buffer from the previous indexer
+class CacheIndexer : public Indexer {
+private:
+	Vector2i size;
+	int chunkSize;
+	Vector2i chunkCount;
+
+	std::vector<int> tiles;
+	std::unique_ptr<std::atomic<bool>[]> chunkValid;
+
+	//Shared by readers, exclusive while copying in chunks or reallocating buffers
+	std::shared_mutex bufferLock;
+
+	//Counts invalidations, so a fill that raced one isn't marked valid
+	std::atomic<uint> generation = 0;
+
+	uint gridUpdates = 0;
+	std::atomic<bool> gridChanged = false;
+
+	//Rebuild buffers if the grid changed size
+	void resize() {
+		size = getPrevious()->getSize();
+		chunkCount = Vector2i((size.x + chunkSize - 1) / chunkSize, (size.y + chunkSize - 1) / chunkSize);
+		tiles.assign(size.x * size.y, fallback);
+		chunkValid.reset(new std::atomic<bool>[chunkCount.x * chunkCount.y]);
+		for(int i = 0; i < chunkCount.x * chunkCount.y; i++)
+			chunkValid[i] = false;
+		gridUpdates = getPrevious()->getUpdateCount();
+		generation++;
+	}
+
+	//Read the chunk containing a tile from previous indexer without holding the lock, then copy it in
+	int fillChunk(int x, int y) {
+		IntRect area;
+		int chunk;
+		Vector2i filledSize;
+		uint filledGeneration;
+		{
+			std::shared_lock<std::shared_mutex> guard(bufferLock);
+			if(x < 0 || y < 0 || x >= size.x || y >= size.y)
+				return fallback;
+
+			int cx = x / chunkSize;
+			int cy = y / chunkSize;
+			chunk = cx + cy * chunkCount.x;
+			if(chunkValid[chunk])
+				return tiles[y * size.x + x];
+			area = IntRect(cx * chunkSize, cy * chunkSize,
+				std::min(chunkSize, size.x - cx * chunkSize), std::min(chunkSize, size.y - cy * chunkSize));
+			filledSize = size;
+			filledGeneration = generation;
+		}
+
+		std::vector<int> values(area.width * area.height);
+		getPrevious()->getBlock(area, values.data(), area.width);
+
+		std::unique_lock<std::shared_mutex> guard(bufferLock);
+		if(size == filledSize && !chunkValid[chunk]) {
+			for(int ty = 0; ty < area.height; ty++)
+				std::copy(values.begin() + ty * area.width, values.begin() + (ty + 1) * area.width,
+					tiles.begin() + (area.top + ty) * size.x + area.left);
+			chunkValid[chunk] = generation == filledGeneration;
+		}
+		return values[(y - area.top) * area.width + (x - area.left)];
+	}
+
+	//Drop cached chunks that upstream has changed
+	void checkUpdates() {
+		std::unique_lock<std::shared_mutex> guard(bufferLock);
+		gridChanged = false;
+		uint updates = getPrevious()->getUpdateCount();
+		if(updates != gridUpdates) {
+			if(getPrevious()->getSize() != size)
+				resize();
+			else
+				for(IntRect area : getPrevious()->getChanges(gridUpdates, updates))
+					invalidateChunks(area);
+			gridUpdates = updates;
+		}
+	}
+
+	//Mark chunks covering area for refill, with bufferLock held
+	void invalidateChunks(IntRect area) {
+		int startX = std::max(area.left / chunkSize, 0);
+		int startY = std::max(area.top / chunkSize, 0);
+		int endX = std::min((area.left + area.width - 1) / chunkSize, chunkCount.x - 1);
+		int endY = std::min((area.top + area.height - 1) / chunkSize, chunkCount.y - 1);
+		for(int cy = startY; cy <= endY; cy++)
+			for(int cx = startX; cx <= endX; cx++)
+				chunkValid[cx + cy * chunkCount.x] = false;
+		generation++;
+	}
+
+public:
+	CacheIndexer(Indexer *previous, int _chunkSize=CACHE_CHUNK_SIZE)
+		: Indexer(previous, previous->fallback, Vector2i(1, 1)), chunkSize(_chunkSize) {
+
+		resize();
+	}
+
+	//Read tile from buffer, filling chunk if needed
+	int getTileI(int x, int y) override {
+		if(gridChanged)
+			checkUpdates();
+
+		{
+			std::shared_lock<std::shared_mutex> guard(bufferLock);
+			if(x < 0 || y < 0 || x >= size.x || y >= size.y)
+				return fallback;
+			if(chunkValid[x / chunkSize + y / chunkSize * chunkCount.x])
+				return tiles[y * size.x + x];
+		}
+		return fillChunk(x, y);
+	}
+
+	//Check for changes on next read
+	void notifyChanged() override {
+		gridChanged = true;
+		Indexer::notifyChanged();
+	}
+
+	//Pass through any direct mapping to the cached stack
+	int mapTile(int c) override {
+		return getPrevious()->mapTile(c);
+	}
+	int mapTileI(int c, int x, int y) override {
+		return getPrevious()->mapTileI(c, x, y);
+	}
+
+	//Mark chunks covering area for refill
+	void invalidate(IntRect area) {
+		std::shared_lock<std::shared_mutex> guard(bufferLock);
+		invalidateChunks(area);
+	}
+
+	void invalidate() {
+		std::shared_lock<std::shared_mutex> guard(bufferLock);
+		invalidateChunks(IntRect(0, 0, size.x, size.y));
+	}
+
+	//Count filled chunks for debugging
+	int countValidChunks() {
+		std::shared_lock<std::shared_mutex> guard(bufferLock);
+		int count = 0;
+		for(int i = 0; i < chunkCount.x * chunkCount.y; i++)
+			if(chunkValid[i])
+				count++;
+		return count;
+	}
+
+	int getChunkSize() {
+		return chunkSize;
+	}
+};
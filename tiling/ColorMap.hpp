@@ -14,9 +14,13 @@ class ColorMap : public Node {
 private:
     Indexer *indexes;
     uint gridUpdates = 0;
+    bool gridChanged = false;
+    int gridListener = -1;
 
     std::function<skColor(int)> func;
 
+    //Sizes are in cells, each drawn scaled up to cover its tiles
+    Vector2i scale;
     uint fullWidth = 0;
     uint fullHeight = 0;
     uint width = 0;
@@ -26,73 +30,88 @@ private:
 
 public:
     ColorMap(Indexer *_indexes, std::function<skColor(int)> _func, int layer=0, Rect<uint> border=Rect<uint>())
-     : Node(layer, RENDER_COLOR_ARRAY), indexes(_indexes), func(_func) {
+     : Node(layer, RENDER_PIXEL_BUFFER), indexes(_indexes), func(_func) {
 
         //Set sizing
-        fullWidth = width = indexes->getSize().x * indexes->getScale().x;
-        fullHeight = height = indexes->getSize().y * indexes->getScale().x;
-        startX = border.left;
-        startY = border.top;
+        scale = indexes->getScale();
+        fullWidth = width = indexes->getSize().x;
+        fullHeight = height = indexes->getSize().y;
+        startX = border.left / scale.x;
+        startY = border.top / scale.y;
         if(border.width != 0)
-            width = border.width;
+            width = (border.width + scale.x - 1) / scale.x;
         if(border.height != 0)
-            height = border.height;
+            height = (border.height + scale.y - 1) / scale.y;
         if(width + startX > fullWidth)
             width = fullWidth - startX;
         if(height + startY > fullHeight)
             height = fullHeight - startY;
 
         setSize(Vector2i(width, height));
+        setScale(scale.x, scale.y);
         setOrigin(0, 0);
-        setPosition(startX, startY);
-
-        //setTexture(_tileset);
-        setupBuffer(0, COLOR_EMPTY);
+        setPosition(startX * scale.x, startY * scale.y);
 
         //std::cout << " " << startX << "," << startY << ", " << width << "," << height << "\n";
         //std::cout << toString(getGPosition()) << ":" << toString(getGScale()) <<  "\n";
 
-        getRenderComponent()->getColors()->reserve(width * height);
-        getRenderComponent()->setSize(width);
+        //One pixel per cell, drawn as a single texture
+        getRenderComponent()->setImageSize(Vector2i(width, height));
 
         //Load textures
+        gridListener = indexes->subscribe([this]() { gridChanged = true; });
         reload();
     }
 
     ~ColorMap() {
+        indexes->unsubscribe(gridListener);
     }
 
     void reload() {
-        int usedRects = 0;
-        bool hasBuffer = true;
-
-        // populate the vertex array, with one quad per tile
-        for(unsigned int j = 0; j < height; ++j) {
-            for(unsigned int i = 0; i < width; ++i) {
-                // get the current tile number
-                int tileValue = indexes->getTile(Vector2f(i + startX, hasBuffer ? fullHeight - (j + startY + 1) : j + startY));
-                skColor tileColor = func(tileValue);
-                getRenderComponent()->setColor(tileColor, usedRects++);
-                //std::cout << tileValue << tileColor << ' ';
-            }
-            //std::cout << "\n";
-        }
+        //Read whole area at once
+        std::vector<int> tiles(width * height);
+        indexes->getBlock(IntRect(startX, startY, width, height), tiles.data(), width);
+
+        for(unsigned int j = 0; j < height; ++j)
+            for(unsigned int i = 0; i < width; ++i)
+                getRenderComponent()->setColor(func(tiles[j * width + i]), i + j * width);
         gridUpdates = indexes->getUpdateCount();
-        getRenderComponent()->getColors()->resize(usedRects);
-        //std::cout << getRenderComponent()->getColors()->size();
+    }
 
-        if(hasBuffer)
-            scheduleBufferRefresh();
+    //Recolor only the cells covering a changed grid area
+    void reload(IntRect area) {
+        int startI = std::max(area.left - (int)startX, 0);
+        int endI = std::min(area.left + area.width - (int)startX, (int)width);
+        int startJ = std::max(area.top - (int)startY, 0);
+        int endJ = std::min(area.top + area.height - (int)startY, (int)height);
+
+        for(int j = startJ; j < endJ; ++j)
+            for(int i = startI; i < endI; ++i) {
+                int tileValue = indexes->getTileI(i + startX, j + startY);
+                getRenderComponent()->setColor(func(tileValue), i + j * width);
+            }
     }
 
     void setIndexer(Indexer *indexes) {
+        this->indexes->unsubscribe(gridListener);
         this->indexes = indexes;
+        gridListener = indexes->subscribe([this]() { gridChanged = true; });
         reload();
     }
 
+    //Only check for changes after a notification
     void update(double time) {
-        if(this->indexes->getUpdateCount() != gridUpdates)
-            reload();
+        if(!gridChanged)
+            return;
+        gridChanged = false;
+
+        uint updates = this->indexes->getUpdateCount();
+        if(updates != gridUpdates) {
+            std::vector<IntRect> changes = indexes->getChanges(gridUpdates, updates);
+            gridUpdates = updates;
+            for(IntRect area : changes)
+                reload(area);
+        }
     }
 };
 
@@ -0,0 +1,213 @@
+#include "ConnectedRegions.h"
+#include "MathIndexers.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+static const int SQUARE_OFFSETS[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+
+//Even rows sit half a tile right, matching HexIndexer
+static const int HEX_EVEN_OFFSETS[6][2] = {{1, 0}, {-1, 0}, {0, -1}, {1, -1}, {0, 1}, {1, 1}};
+static const int HEX_ODD_OFFSETS[6][2] = {{1, 0}, {-1, 0}, {-1, -1}, {0, -1}, {-1, 1}, {0, 1}};
+
+ConnectedRegions::ConnectedRegions(Indexer *_source, std::function<bool(int)> _passable, int _layout, int _chunkSize)
+	: source(_source), passable(_passable), layout(_layout), chunkSize(_chunkSize) {
+
+	if(chunkSize < 1)
+		throw new std::invalid_argument("Region chunk size must be positive");
+
+	//Diagonal steps never cut corners, so they connect the same tiles as square steps
+	if(layout == PATH_AUTO || layout == PATH_DIAGONAL) {
+		layout = PATH_SQUARE;
+		for(Indexer *indexer = source; indexer != NULL; indexer = indexer->getPrevious())
+			if(_layout == PATH_AUTO && dynamic_cast<HexIndexer *>(indexer) != NULL)
+				layout = PATH_HEX;
+	}
+
+	view = std::make_unique<RegionIndexer>(source, this);
+	rebuild();
+	refresh();
+}
+
+//Reread every tile and mark every chunk for labeling
+void ConnectedRegions::rebuild() {
+	size = source->getSize();
+	chunkCount = Vector2i((size.x + chunkSize - 1) / chunkSize, (size.y + chunkSize - 1) / chunkSize);
+
+	int count = size.x * size.y;
+	std::vector<int> tiles(count);
+	source->getBlock(IntRect(0, 0, size.x, size.y), tiles.data(), size.x);
+	open.resize(count);
+	for(int i = 0; i < count; i++)
+		open[i] = passable(tiles[i]);
+	gridVersion = source->getUpdateCount();
+
+	labels.assign(count, -1);
+	componentSizes.assign(chunkCount.x * chunkCount.y, {});
+	dirty.assign(chunkCount.x * chunkCount.y, 1);
+	linksDirty = true;
+}
+
+int ConnectedRegions::neighbors(int x, int y, int *cells) const {
+	int count = 0;
+	int directions = (layout == PATH_HEX) ? 6 : 4;
+	const int (*offsets)[2] = SQUARE_OFFSETS;
+	if(layout == PATH_HEX)
+		offsets = (y % 2 == 0) ? HEX_EVEN_OFFSETS : HEX_ODD_OFFSETS;
+
+	for(int i = 0; i < directions; i++) {
+		int nx = x + offsets[i][0];
+		int ny = y + offsets[i][1];
+		if(nx >= 0 && ny >= 0 && nx < size.x && ny < size.y && open[nx + ny * size.x])
+			cells[count++] = nx + ny * size.x;
+	}
+	return count;
+}
+
+int ConnectedRegions::findRoot(int component) {
+	while(parent[component] != component) {
+		parent[component] = parent[parent[component]];
+		component = parent[component];
+	}
+	return component;
+}
+
+//Flood fill each group of open tiles inside the chunk
+void ConnectedRegions::labelChunk(int chunk) {
+	int left = (chunk % chunkCount.x) * chunkSize;
+	int top = (chunk / chunkCount.x) * chunkSize;
+	int right = std::min(left + chunkSize, size.x);
+	int bottom = std::min(top + chunkSize, size.y);
+
+	for(int y = top; y < bottom; y++)
+		for(int x = left; x < right; x++)
+			labels[x + y * size.x] = -1;
+
+	std::vector<int> &sizes = componentSizes[chunk];
+	sizes.clear();
+	std::vector<int> stack;
+	int cells[6];
+	for(int y = top; y < bottom; y++) {
+		for(int x = left; x < right; x++) {
+			int i = x + y * size.x;
+			if(!open[i] || labels[i] != -1)
+				continue;
+
+			int label = sizes.size();
+			sizes.push_back(0);
+			labels[i] = label;
+			stack.push_back(i);
+			while(!stack.empty()) {
+				int cell = stack.back();
+				stack.pop_back();
+				sizes[label]++;
+
+				int count = neighbors(cell % size.x, cell / size.x, cells);
+				for(int n = 0; n < count; n++) {
+					int nx = cells[n] % size.x, ny = cells[n] / size.x;
+					if(nx >= left && ny >= top && nx < right && ny < bottom && labels[cells[n]] == -1) {
+						labels[cells[n]] = label;
+						stack.push_back(cells[n]);
+					}
+				}
+			}
+		}
+	}
+	dirty[chunk] = 0;
+}
+
+//Join the component of an edge tile with those of its neighbors in other chunks
+void ConnectedRegions::linkEdge(int x, int y, int *cells) {
+	int i = x + y * size.x;
+	if(!open[i])
+		return;
+
+	int chunk = x / chunkSize + y / chunkSize * chunkCount.x;
+	int a = findRoot(chunkBase[chunk] + labels[i]);
+	int count = neighbors(x, y, cells);
+	for(int n = 0; n < count; n++) {
+		int nx = cells[n] % size.x, ny = cells[n] / size.x;
+		int other = nx / chunkSize + ny / chunkSize * chunkCount.x;
+		if(other == chunk)
+			continue;
+		int b = findRoot(chunkBase[other] + labels[cells[n]]);
+		if(a != b) {
+			parent[std::max(a, b)] = std::min(a, b);
+			a = std::min(a, b);
+		}
+	}
+}
+
+//Join components touching across chunk edges, then number the results
+void ConnectedRegions::linkChunks() {
+	chunkBase.resize(componentSizes.size() + 1);
+	chunkBase[0] = 0;
+	for(int c = 0; c < (int)componentSizes.size(); c++)
+		chunkBase[c + 1] = chunkBase[c] + componentSizes[c].size();
+	parent.resize(chunkBase.back());
+	std::iota(parent.begin(), parent.end(), 0);
+
+	//Every pair of touching chunks has one side on a right or bottom edge, so only those rows and columns are read
+	int cells[6];
+	for(int y = chunkSize - 1; y < size.y - 1; y += chunkSize)
+		for(int x = 0; x < size.x; x++)
+			linkEdge(x, y, cells);
+	for(int x = chunkSize - 1; x < size.x - 1; x += chunkSize)
+		for(int y = 0; y < size.y; y++)
+			linkEdge(x, y, cells);
+
+	//Number regions in order of their first tile's chunk
+	regions.assign(parent.size(), 0);
+	regionSizes.assign(1, 0);
+	for(int c = 0; c < (int)componentSizes.size(); c++) {
+		for(int l = 0; l < (int)componentSizes[c].size(); l++) {
+			int component = chunkBase[c] + l;
+			int root = findRoot(component);
+			if(root == component) {
+				regions[component] = regionSizes.size();
+				regionSizes.push_back(0);
+			} else
+				regions[component] = regions[root];
+			regionSizes[regions[component]] += componentSizes[c][l];
+		}
+	}
+	linksDirty = false;
+}
+
+void ConnectedRegions::refresh() {
+	uint version = source->getUpdateCount();
+	if(source->getSize() != size)
+		rebuild();
+	else if(version != gridVersion) {
+		std::vector<int> tiles;
+		for(IntRect area : source->getChanges(gridVersion, version)) {
+			int left = std::max(area.left, 0);
+			int top = std::max(area.top, 0);
+			int right = std::min(area.left + area.width, size.x);
+			int bottom = std::min(area.top + area.height, size.y);
+			if(left >= right || top >= bottom)
+				continue;
+
+			tiles.resize((right - left) * (bottom - top));
+			source->getBlock(IntRect(left, top, right - left, bottom - top), tiles.data(), right - left);
+			for(int y = top; y < bottom; y++) {
+				for(int x = left; x < right; x++) {
+					bool now = passable(tiles[(x - left) + (y - top) * (right - left)]);
+					if(now != (bool)open[x + y * size.x]) {
+						open[x + y * size.x] = now;
+						dirty[x / chunkSize + y / chunkSize * chunkCount.x] = 1;
+						linksDirty = true;
+					}
+				}
+			}
+		}
+		gridVersion = version;
+	}
+
+	if(!linksDirty)
+		return;
+	for(int c = 0; c < (int)dirty.size(); c++)
+		if(dirty[c])
+			labelChunk(c);
+	linkChunks();
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "Pathfinding.h"
+
+/*
+ * Labels groups of connected passable tiles, to check reachability without searching
+ */
+
+class ConnectedRegions {
+private:
+	Indexer *source;
+	std::function<bool(int)> passable;
+	int layout;
+	int chunkSize;
+
+	Vector2i size;
+	Vector2i chunkCount;
+	std::vector<uint8_t> open;
+	uint gridVersion = 0;
+
+	//Components inside each chunk, labeled by index within the chunk
+	std::vector<int> labels;
+	std::vector<std::vector<int>> componentSizes;
+	std::vector<uint8_t> dirty;
+	bool linksDirty = true;
+
+	//Components joined across chunk edges, numbered from 1
+	std::vector<int> chunkBase;
+	std::vector<int> parent;
+	std::vector<int> regions;
+	std::vector<int> regionSizes;
+
+	std::unique_ptr<Indexer> view;
+
+	int neighbors(int x, int y, int *cells) const;
+	int findRoot(int component);
+	void rebuild();
+	void labelChunk(int chunk);
+	void linkEdge(int x, int y, int *cells);
+	void linkChunks();
+
+public:
+	//Tiles passing the predicate are labeled, by default EMPTY collision tiles
+	ConnectedRegions(Indexer *_source, std::function<bool(int)> _passable=[](int c) { return c == 0; },
+		int _layout=PATH_AUTO, int _chunkSize=32);
+
+	//Relabel chunks with changed tiles, or everything if the source was resized, called automatically by each query
+	void refresh();
+
+	//Region number of tile, or 0 if blocked
+	int getRegion(Vector2i cell) {
+		refresh();
+		if(cell.x < 0 || cell.y < 0 || cell.x >= size.x || cell.y >= size.y)
+			return 0;
+		int i = cell.x + cell.y * size.x;
+		if(labels[i] == -1)
+			return 0;
+		return regions[chunkBase[cell.x / chunkSize + cell.y / chunkSize * chunkCount.x] + labels[i]];
+	}
+
+	bool isConnected(Vector2i a, Vector2i b) {
+		int region = getRegion(a);
+		return region != 0 && region == getRegion(b);
+	}
+
+	int getRegionCount() {
+		refresh();
+		return regionSizes.size() - 1;
+	}
+
+	//Number of tiles in region
+	int getRegionSize(int region) {
+		refresh();
+		if(region <= 0 || region >= (int)regionSizes.size())
+			return 0;
+		return regionSizes[region];
+	}
+
+	//Region numbers as an indexer, such as for a debug ColorMap
+	Indexer *getIndexer() {
+		return view.get();
+	}
+};
+
+//Reads region numbers, with any source change counting as the whole grid since regions can be renumbered
+class RegionIndexer : public Indexer {
+private:
+	ConnectedRegions *regions;
+
+public:
+	RegionIndexer(Indexer *source, ConnectedRegions *_regions)
+		: Indexer(source, 0, Vector2i(1, 1)), regions(_regions) {
+
+	}
+
+	int getTileI(int x, int y) override {
+		return regions->getRegion(Vector2i(x, y));
+	}
+
+	void setTileI(int x, int y, int value) override {
+
+	}
+
+	std::vector<IntRect> getChanges(uint since, uint until=(uint)-1) override {
+		if(Indexer::getChanges(since, until).empty())
+			return {};
+		return {fullRect()};
+	}
+};
@@ -0,0 +1,165 @@
+#include "DistanceField.h"
+#include "../util/Parallel.hpp"
+
+#include <algorithm>
+
+#define DISTANCE_INFINITY 1e20
+
+//One dimensional squared distance transform, based on Felzenszwalb and Huttenlocher's lower envelope of parabolas
+//https://cs.brown.edu/people/pfelzens/dt/
+static void distanceTransform(const double *f, int n, double *d, int *from, int *v, double *z) {
+	int k = 0;
+	v[0] = 0;
+	z[0] = -DISTANCE_INFINITY;
+	z[1] = DISTANCE_INFINITY;
+	for(int q = 1; q < n; q++) {
+		double s = ((f[q] + (double)q * q) - (f[v[k]] + (double)v[k] * v[k])) / (2.0 * q - 2.0 * v[k]);
+		while(s <= z[k]) {
+			k--;
+			s = ((f[q] + (double)q * q) - (f[v[k]] + (double)v[k] * v[k])) / (2.0 * q - 2.0 * v[k]);
+		}
+		k++;
+		v[k] = q;
+		z[k] = s;
+		z[k + 1] = DISTANCE_INFINITY;
+	}
+
+	k = 0;
+	for(int q = 0; q < n; q++) {
+		while(z[k + 1] < q)
+			k++;
+		d[q] = (double)(q - v[k]) * (q - v[k]) + f[v[k]];
+		from[q] = v[k];
+	}
+}
+
+DistanceField::DistanceField(Indexer *_source, std::function<bool(int)> _solid, float _maxDistance, int _threads)
+	: source(_source), solid(_solid), maxDistance(_maxDistance), threads(_threads) {
+
+	size = source->getSize();
+	tiles.resize(size.x * size.y);
+	source->getBlock(IntRect(0, 0, size.x, size.y), tiles.data(), size.x);
+	gridVersion = source->getUpdateCount();
+
+	distances.resize(size.x * size.y);
+	nearest.resize(size.x * size.y);
+	computeArea(IntRect(0, 0, size.x, size.y), IntRect(0, 0, size.x, size.y));
+}
+
+//Columns of input first, then rows of output, with tiles outside input ignored
+void DistanceField::computeArea(IntRect input, IntRect output) {
+	int width = input.width, height = input.height;
+	int longest = std::max(width, height);
+	std::vector<double> columns(width * height);
+	std::vector<int> columnFrom(width * height);
+
+	//Small edits aren't worth starting threads for
+	int workers = (width * height < 64 * 64) ? 1 : threads;
+	parallelRange(width, workers, [&](int start, int end) {
+		std::vector<double> f(longest), d(longest), z(longest + 1);
+		std::vector<int> v(longest), from(longest);
+		for(int x = start; x < end; x++) {
+			for(int y = 0; y < height; y++)
+				f[y] = solid(tiles[(input.left + x) + (input.top + y) * size.x]) ? 0 : DISTANCE_INFINITY;
+			distanceTransform(f.data(), height, d.data(), from.data(), v.data(), z.data());
+			for(int y = 0; y < height; y++) {
+				columns[x + y * width] = d[y];
+				columnFrom[x + y * width] = input.top + from[y];
+			}
+		}
+	});
+
+	parallelRange(output.height, workers, [&](int start, int end) {
+		std::vector<double> d(longest), z(longest + 1);
+		std::vector<int> v(longest), from(longest);
+		for(int row = start; row < end; row++) {
+			int y = output.top + row;
+			const double *f = columns.data() + (y - input.top) * width;
+			distanceTransform(f, width, d.data(), from.data(), v.data(), z.data());
+			for(int x = output.left; x < output.left + output.width; x++) {
+				int q = x - input.left;
+				int i = x + y * size.x;
+				if(d[q] >= DISTANCE_INFINITY) {
+					distances[i] = (maxDistance > 0) ? maxDistance : DISTANCE_INFINITY;
+					nearest[i] = -1;
+					continue;
+				}
+
+				distances[i] = std::sqrt(d[q]);
+				nearest[i] = (input.left + from[q]) + columnFrom[from[q] + (y - input.top) * width] * size.x;
+				if(maxDistance > 0 && distances[i] > maxDistance) {
+					distances[i] = maxDistance;
+					nearest[i] = -1;
+				}
+			}
+		}
+	});
+}
+
+//Capped fields only recalculate tiles within reach of each change
+void DistanceField::refresh() {
+	uint version = source->getUpdateCount();
+	if(version == gridVersion)
+		return;
+
+	std::vector<IntRect> changes = source->getChanges(gridVersion, version);
+	gridVersion = version;
+	for(IntRect area : changes) {
+		int left = std::max(area.left, 0);
+		int top = std::max(area.top, 0);
+		int right = std::min(area.left + area.width, size.x);
+		int bottom = std::min(area.top + area.height, size.y);
+		if(left < right && top < bottom)
+			source->getBlock(IntRect(left, top, right - left, bottom - top), tiles.data() + left + top * size.x, size.x);
+	}
+
+	if(maxDistance <= 0) {
+		computeArea(IntRect(0, 0, size.x, size.y), IntRect(0, 0, size.x, size.y));
+		return;
+	}
+
+	int reach = std::ceil(maxDistance);
+	auto expand = [&](IntRect area, int amount) {
+		int left = std::max(area.left - amount, 0);
+		int top = std::max(area.top - amount, 0);
+		int right = std::min(area.left + area.width + amount, size.x);
+		int bottom = std::min(area.top + area.height + amount, size.y);
+		return IntRect(left, top, std::max(right - left, 0), std::max(bottom - top, 0));
+	};
+	for(IntRect area : changes) {
+		IntRect output = expand(area, reach);
+		if(output.width > 0 && output.height > 0)
+			computeArea(expand(area, reach * 2), output);
+	}
+}
+
+Vector2i DistanceField::getNearest(Vector2i cell) {
+	refresh();
+	if(cell.x < 0 || cell.y < 0 || cell.x >= size.x || cell.y >= size.y)
+		return Vector2i(-1, -1);
+	int i = nearest[cell.x + cell.y * size.x];
+	if(i == -1)
+		return Vector2i(-1, -1);
+	return Vector2i(i % size.x, i / size.x);
+}
+
+//Central differences, falling back to one side at grid edges
+Vector2f DistanceField::getGradient(Vector2i cell) {
+	refresh();
+	if(cell.x < 0 || cell.y < 0 || cell.x >= size.x || cell.y >= size.y)
+		return Vector2f(0, 0);
+
+	int left = std::max(cell.x - 1, 0), right = std::min(cell.x + 1, size.x - 1);
+	int up = std::max(cell.y - 1, 0), down = std::min(cell.y + 1, size.y - 1);
+	float dx = 0, dy = 0;
+	if(right != left)
+		dx = (distances[right + cell.y * size.x] - distances[left + cell.y * size.x]) / (right - left);
+	if(down != up)
+		dy = (distances[cell.x + down * size.x] - distances[cell.x + up * size.x]) / (down - up);
+	return Vector2f(dx, dy);
+}
+
+Indexer *DistanceField::getIndexer(int multiplier) {
+	views.emplace_back(new DistanceIndexer(source, this, multiplier));
+	return views.back().get();
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "GridMaker.h"
+
+/*
+ * Euclidean distance from every tile to the closest solid tile, for steering and nearest wall queries
+ */
+
+class DistanceField {
+private:
+	Indexer *source;
+	std::function<bool(int)> solid;
+	float maxDistance;
+	int threads;
+
+	Vector2i size;
+	std::vector<int> tiles;
+	std::vector<float> distances;
+	std::vector<int> nearest;
+	uint gridVersion = 0;
+
+	std::vector<std::unique_ptr<Indexer>> views;
+
+	void computeArea(IntRect input, IntRect output);
+
+public:
+	//Distances above a positive maxDistance are capped, letting edits only update tiles within reach
+	DistanceField(Indexer *_source, std::function<bool(int)> _solid=[](int c) { return c != 0; },
+		float _maxDistance=0, int _threads=0);
+
+	//Apply source changes, called automatically by each query
+	void refresh();
+
+	//Distance in tiles, 0 on solid tiles
+	float getDistance(Vector2i cell) {
+		refresh();
+		if(cell.x < 0 || cell.y < 0 || cell.x >= size.x || cell.y >= size.y)
+			return 0;
+		return distances[cell.x + cell.y * size.x];
+	}
+	float getDistance(Vector2f position) {
+		Vector2i scale = source->getScale();
+		return getDistance(Vector2i(std::floor(position.x / scale.x), std::floor(position.y / scale.y)));
+	}
+
+	//Closest solid tile, or -1,-1 when none is within reach
+	Vector2i getNearest(Vector2i cell);
+
+	//Points away from the closest solid tiles, with a length near 1 in open areas
+	Vector2f getGradient(Vector2i cell);
+	Vector2f getGradient(Vector2f position) {
+		Vector2i scale = source->getScale();
+		return getGradient(Vector2i(std::floor(position.x / scale.x), std::floor(position.y / scale.y)));
+	}
+
+	float getMaxDistance() {
+		return maxDistance;
+	}
+
+	//Distances times multiplier as an indexer, owned by the field
+	Indexer *getIndexer(int multiplier=1);
+};
+
+//Reads rounded distances, with changes spreading as far as distances can reach
+class DistanceIndexer : public Indexer {
+private:
+	DistanceField *field;
+	int multiplier;
+
+public:
+	DistanceIndexer(Indexer *source, DistanceField *_field, int _multiplier)
+		: Indexer(source, 0, Vector2i(1, 1)), field(_field), multiplier(_multiplier) {
+
+	}
+
+	int getTileI(int x, int y) override {
+		return std::lround(std::min(field->getDistance(Vector2i(x, y)) * multiplier, 1e9f));
+	}
+
+	void setTileI(int x, int y, int value) override {
+
+	}
+
+	std::vector<IntRect> getChanges(uint since, uint until=(uint)-1) override {
+		std::vector<IntRect> changes = Indexer::getChanges(since, until);
+		if(field->getMaxDistance() <= 0)
+			return changes.empty() ? changes : std::vector<IntRect>{fullRect()};
+
+		int reach = std::ceil(field->getMaxDistance());
+		for(IntRect &area : changes)
+			area = IntRect(area.left - reach, area.top - reach, area.width + reach * 2, area.height + reach * 2);
+		return changes;
+	}
+};
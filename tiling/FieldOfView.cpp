@@ -0,0 +1,237 @@
+#include "FieldOfView.h"
+#include "../util/Parallel.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+float ShadowLine::visibility(Shadow projection, bool full) const {
+	int strength = 0;
+	for(int i = 0; i < count; i++) {
+		const Shadow &shadow = shadows[i];
+		bool blocks = full ? (shadow.start <= projection.start && shadow.end >= projection.end) :
+			(shadow.start <= projection.end && shadow.end >= projection.start);
+		if(strength < 100 && blocks)
+			strength += shadow.strength;
+	}
+	return (100 - std::min(strength, 100)) / 100.0;
+}
+
+bool ShadowLine::covers(Shadow projection) const {
+	for(int i = 0; i < count && shadows[i].start <= projection.start; i++)
+		if(shadows[i].strength >= 100 && shadows[i].end >= projection.end)
+			return true;
+	return false;
+}
+
+void ShadowLine::add(Shadow shadow) {
+	//Slot in after every shadow starting before it
+	int index = 0;
+	while(index < count && shadows[index].start < shadow.start)
+		index++;
+
+	Shadow *previous = NULL;
+	if(index > 0 && shadows[index - 1].end >= shadow.start && shadows[index - 1].strength == shadow.strength)
+		previous = &shadows[index - 1];
+	Shadow *next = NULL;
+	if(index < count && shadows[index].start <= shadow.end && shadows[index].strength == shadow.strength)
+		next = &shadows[index];
+
+	//Unify with overlapping neighbours, shifting the rest instead of reallocating
+	if(previous != NULL && next != NULL) {
+		previous->end = next->end;
+		std::memmove(shadows.data() + index, shadows.data() + index + 1, sizeof(Shadow) * (count - index - 1));
+		count--;
+	} else if(next != NULL)
+		next->start = shadow.start;
+	else if(previous != NULL)
+		previous->end = shadow.end;
+	else {
+		if(count == (int)shadows.size())
+			shadows.resize(shadows.size() * 2);
+		std::memmove(shadows.data() + index + 1, shadows.data() + index, sizeof(Shadow) * (count - index));
+		shadows[index] = shadow;
+		count++;
+	}
+
+	//Full once solid shadows reach across every slope, sorted by start so a gap ends the search
+	float pos = 0;
+	for(int i = 0; i < count && shadows[i].start <= pos; i++)
+		if(shadows[i].strength >= 100)
+			pos = std::max(pos, shadows[i].end);
+	full = pos >= 1;
+}
+
+Shadow FieldOfView::projectTile(float row, float col) {
+	return {col / (row + 2), (col + 1) / (row + 1)};
+}
+
+Vector2i FieldOfView::transformOctant(int row, int col, int octant) {
+	switch(octant) {
+		case 0: return Vector2i( col, -row);
+		case 1: return Vector2i( row, -col);
+		case 2: return Vector2i( row,  col);
+		case 3: return Vector2i( col,  row);
+		case 4: return Vector2i(-col,  row);
+		case 5: return Vector2i(-row,  col);
+		case 6: return Vector2i(-row, -col);
+		case 7: return Vector2i(-col, -row);
+	}
+	return Vector2i(0, 0);
+}
+
+void VisibilitySet::reset(Vector2i _origin, int _radius) {
+	origin = _origin;
+	radius = _radius;
+	area = IntRect(origin.x - radius, origin.y - radius, radius * 2 + 1, radius * 2 + 1);
+	bits.assign((area.width * area.height + 63) / 64, 0);
+}
+
+int VisibilitySet::count() const {
+	int total = 0;
+	for(uint64_t word : bits)
+		total += std::popcount(word);
+	return total;
+}
+
+FieldOfView::FieldOfView(Indexer *_occlusion, int _opaque, unsigned int _capacity)
+	: occlusion(_occlusion), opaque(_opaque), capacity(_capacity) {
+
+	cacheVersion = occlusion->getUpdateCount();
+}
+
+//Shadowcast each octant from a copy of the tiles in reach
+void FieldOfView::compute(Vector2i origin, int radius, VisibilitySet &visible) {
+	visible.reset(origin, radius);
+	if(!occlusion->inBounds(origin.x, origin.y) || radius < 0)
+		return;
+	visible.setVisible(origin.x, origin.y);
+
+	IntRect area = visible.getArea();
+	std::vector<int> tiles(area.width * area.height);
+	occlusion->getBlock(area, tiles.data(), area.width);
+
+	//Slightly past radius gives rounder edges
+	int limit = radius * radius + radius;
+	ShadowLine line(radius + 2);
+	for(int octant = 0; octant < 8; octant++) {
+		castOctant(line, octant, radius, [&](int row, int col, Vector2i offset, Shadow projection) {
+			int x = origin.x + offset.x;
+			int y = origin.y + offset.y;
+			if(!occlusion->inBounds(x, y) || line.covers(projection))
+				return true;
+
+			if(offset.x * offset.x + offset.y * offset.y <= limit)
+				visible.setVisible(x, y);
+			if(tiles[(x - area.left) + (y - area.top) * area.width] <= opaque)
+				line.add(projection);
+			return true;
+		});
+	}
+}
+
+//Drop results near changed tiles, keeping the rest for the new version
+void FieldOfView::refreshCache() {
+	uint version = occlusion->getUpdateCount();
+	if(version == cacheVersion)
+		return;
+
+	std::vector<IntRect> changes = occlusion->getChanges(cacheVersion, version);
+	cacheVersion = version;
+	if(cache.empty())
+		return;
+
+	for(auto it = cache.begin(); it != cache.end();) {
+		bool changed = false;
+		for(IntRect change : changes)
+			changed = changed || change.overlaps(it->second->getArea());
+		if(changed)
+			it = cache.erase(it);
+		else
+			++it;
+	}
+
+	std::deque<std::tuple<int, int, int>> order;
+	for(auto &key : cacheOrder)
+		if(cache.count(key))
+			order.push_back(key);
+	cacheOrder.swap(order);
+}
+
+void FieldOfView::store(std::shared_ptr<const VisibilitySet> visible) {
+	auto key = std::make_tuple(visible->getOrigin().x, visible->getOrigin().y, visible->getRadius());
+	if(!cache.emplace(key, visible).second)
+		return;
+	cacheOrder.push_back(key);
+
+	//Oldest results are removed first
+	while(cache.size() > capacity) {
+		cache.erase(cacheOrder.front());
+		cacheOrder.pop_front();
+	}
+}
+
+std::shared_ptr<const VisibilitySet> FieldOfView::getVisible(Vector2i origin, int radius) {
+	refreshCache();
+	auto found = cache.find(std::make_tuple(origin.x, origin.y, radius));
+	if(found != cache.end()) {
+		hits++;
+		return found->second;
+	}
+
+	misses++;
+	std::shared_ptr<VisibilitySet> visible = std::make_shared<VisibilitySet>();
+	compute(origin, radius, *visible);
+	store(visible);
+	return visible;
+}
+
+bool FieldOfView::canSee(Vector2i from, Vector2i to, int radius) {
+	return getVisible(from, radius)->isVisible(to);
+}
+
+std::vector<std::shared_ptr<const VisibilitySet>> FieldOfView::getVisible(const std::vector<Vector2i> &origins, int radius, int threads) {
+	refreshCache();
+
+	//Find cached results and each distinct missing origin
+	std::map<std::tuple<int, int, int>, std::shared_ptr<const VisibilitySet>> found;
+	std::vector<Vector2i> missing;
+	for(Vector2i origin : origins) {
+		auto key = std::make_tuple(origin.x, origin.y, radius);
+		if(found.count(key))
+			continue;
+		auto cached = cache.find(key);
+		if(cached != cache.end()) {
+			hits++;
+			found[key] = cached->second;
+		} else {
+			misses++;
+			found[key] = NULL;
+			missing.push_back(origin);
+		}
+	}
+
+	std::vector<std::shared_ptr<VisibilitySet>> computed(missing.size());
+	parallelRange(missing.size(), threads, [&](int start, int end) {
+		for(int i = start; i < end; i++) {
+			computed[i] = std::make_shared<VisibilitySet>();
+			compute(missing[i], radius, *computed[i]);
+		}
+	});
+
+	for(std::shared_ptr<VisibilitySet> &visible : computed) {
+		found[std::make_tuple(visible->getOrigin().x, visible->getOrigin().y, radius)] = visible;
+		store(visible);
+	}
+
+	std::vector<std::shared_ptr<const VisibilitySet>> results;
+	results.reserve(origins.size());
+	for(Vector2i origin : origins)
+		results.push_back(found[std::make_tuple(origin.x, origin.y, radius)]);
+	return results;
+}
+
+void FieldOfView::clearCache() {
+	cache.clear();
+	cacheOrder.clear();
+}
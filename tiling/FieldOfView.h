@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include "GridMaker.h"
+
+/*
+ * Line of sight over an occlusion indexer, shared by AI, fog of war and stealth
+ */
+
+//Based on http://journal.stuffwithstuff.com/2015/09/07/what-the-hero-sees/
+//Slopes hidden behind a tile, blocking strength percent of light
+struct Shadow {
+	float start;
+	float end;
+	int strength = 100;
+};
+
+//Sorted shadows in a buffer reused between octants, only growing past its capacity for many partial shadows
+class ShadowLine {
+private:
+	std::vector<Shadow> shadows;
+	int count = 0;
+	bool full = false;
+
+public:
+	ShadowLine(int capacity) : shadows(std::max(capacity, 1)) {
+
+	}
+
+	void clear() {
+		count = 0;
+		full = false;
+	}
+
+	//Light left after shadows overlapping projection, or only those covering it when full
+	float visibility(Shadow projection, bool full) const;
+
+	//Whether a full strength shadow covers projection
+	bool covers(Shadow projection) const;
+
+	bool isFullShadow() const {
+		return full;
+	}
+
+	//Insert shadow, merging with an overlapping neighbour of the same strength on either side
+	void add(Shadow shadow);
+};
+
+//Tiles seen from an origin, as one bit per tile of the square around it
+class VisibilitySet {
+private:
+	Vector2i origin;
+	int radius = 0;
+	IntRect area;
+	std::vector<uint64_t> bits;
+
+public:
+	VisibilitySet() {}
+
+	//Clear for a new origin, keeping storage
+	void reset(Vector2i _origin, int _radius);
+
+	bool isVisible(int x, int y) const {
+		x -= area.left;
+		y -= area.top;
+		if(x < 0 || y < 0 || x >= area.width || y >= area.height)
+			return false;
+		int i = x + y * area.width;
+		return (bits[i >> 6] >> (i & 63)) & 1;
+	}
+
+	bool isVisible(Vector2i pos) const {
+		return isVisible(pos.x, pos.y);
+	}
+
+	void setVisible(int x, int y) {
+		int i = (x - area.left) + (y - area.top) * area.width;
+		bits[i >> 6] |= (uint64_t)1 << (i & 63);
+	}
+
+	//Number of visible tiles
+	int count() const;
+
+	Vector2i getOrigin() const {
+		return origin;
+	}
+
+	int getRadius() const {
+		return radius;
+	}
+
+	IntRect getArea() const {
+		return area;
+	}
+};
+
+class FieldOfView {
+private:
+	Indexer *occlusion;
+	int opaque;
+
+	//Results for the occlusion version in cacheVersion, oldest first in cacheOrder
+	std::map<std::tuple<int, int, int>, std::shared_ptr<const VisibilitySet>> cache;
+	std::deque<std::tuple<int, int, int>> cacheOrder;
+	uint cacheVersion = 0;
+	unsigned int capacity;
+	unsigned int hits = 0;
+	unsigned int misses = 0;
+
+	void refreshCache();
+	void store(std::shared_ptr<const VisibilitySet> visible);
+
+public:
+	//Silhouette of the tile at row and col of an octant, and its offset from the origin
+	static Shadow projectTile(float row, float col);
+	static Vector2i transformOctant(int row, int col, int octant);
+
+	//Visit tiles of one octant nearest first, stopping once the line is in full shadow
+	//visit returns false to end its row, and the whole octant if that was the first tile in the row
+	template<typename Visit>
+	static void castOctant(ShadowLine &line, int octant, int rows, Visit visit) {
+		line.clear();
+		for(int row = 1; row <= rows; row++) {
+			for(int col = 0; col <= row; col++) {
+				if(!visit(row, col, transformOctant(row, col, octant), projectTile(row, col))) {
+					if(col == 0)
+						return;
+					break;
+				}
+				if(line.isFullShadow())
+					return;
+			}
+		}
+	}
+
+	//Tiles at or below opaque block sight, matching full shadows in LightMap
+	FieldOfView(Indexer *_occlusion, int _opaque=-100, unsigned int _capacity=256);
+
+	//Calculate visibility without the cache
+	void compute(Vector2i origin, int radius, VisibilitySet &visible);
+
+	//Cached visibility, valid until tiles near it change
+	std::shared_ptr<const VisibilitySet> getVisible(Vector2i origin, int radius);
+	bool canSee(Vector2i from, Vector2i to, int radius);
+
+	//Calculate missing origins across threads, in the same order as origins
+	std::vector<std::shared_ptr<const VisibilitySet>> getVisible(const std::vector<Vector2i> &origins, int radius, int threads=0);
+
+	void clearCache();
+
+	unsigned int getCacheSize() {
+		return cache.size();
+	}
+
+	unsigned int getHits() {
+		return hits;
+	}
+
+	unsigned int getMisses() {
+		return misses;
+	}
+};
@@ -0,0 +1,370 @@
+#include "FlowField.h"
+#include "../util/Parallel.hpp"
+
+#include <algorithm>
+
+#define FLOW_DIAGONAL_COST 1.41421356f
+#define FLOW_NONE 8
+
+//Chunk solves either only spread lowered edges or recheck every cell
+#define FLOW_EDGE 1
+#define FLOW_FULL 2
+
+static const int FLOW_OFFSETS[8][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {-1, 1}, {1, -1}, {-1, -1}};
+static const Vector2f FLOW_DIRECTIONS[9] = {
+	Vector2f(1, 0), Vector2f(-1, 0), Vector2f(0, 1), Vector2f(0, -1),
+	Vector2f(0.70710678f, 0.70710678f), Vector2f(-0.70710678f, 0.70710678f),
+	Vector2f(0.70710678f, -0.70710678f), Vector2f(-0.70710678f, -0.70710678f),
+	Vector2f(0, 0)
+};
+
+static bool inArea(const IntRect &area, int x, int y) {
+	return x >= area.left && y >= area.top && x < area.left + area.width && y < area.top + area.height;
+}
+
+static IntRect clipArea(const IntRect &a, const IntRect &b) {
+	int left = std::max(a.left, b.left);
+	int top = std::max(a.top, b.top);
+	int right = std::min(a.left + a.width, b.left + b.width);
+	int bottom = std::min(a.top + a.height, b.top + b.height);
+	return IntRect(left, top, std::max(right - left, 0), std::max(bottom - top, 0));
+}
+
+FlowField::FlowField(Indexer *_collision, std::function<bool(int)> _passable, int _chunkSize, int _threads)
+	: collision(_collision), passable(_passable), chunkSize(_chunkSize), threads(_threads) {
+
+	if(chunkSize < 1)
+		throw new std::invalid_argument("Flow field chunk size must be positive");
+
+	size = collision->getSize();
+	chunkCount = Vector2i((size.x + chunkSize - 1) / chunkSize, (size.y + chunkSize - 1) / chunkSize);
+	region = IntRect(0, 0, size.x, size.y);
+
+	int count = size.x * size.y;
+	std::vector<int> tiles(count);
+	collision->getBlock(region, tiles.data(), size.x);
+	open.resize(count);
+	for(int i = 0; i < count; i++)
+		open[i] = passable(tiles[i]);
+	gridVersion = collision->getUpdateCount();
+
+	cost.assign(count, std::numeric_limits<float>::infinity());
+	direction.assign(count, FLOW_NONE);
+	active.assign(chunkCount.x * chunkCount.y, 0);
+	changed.assign(chunkCount.x * chunkCount.y, 0);
+	stale.assign(chunkCount.x * chunkCount.y, 0);
+}
+
+IntRect FlowField::chunkArea(int chunk) const {
+	int left = (chunk % chunkCount.x) * chunkSize;
+	int top = (chunk / chunkCount.x) * chunkSize;
+	return IntRect(left, top, std::min(chunkSize, size.x - left), std::min(chunkSize, size.y - top));
+}
+
+//Flag every chunk touching area
+void FlowField::markArea(std::vector<uint8_t> &flags, IntRect area, uint8_t value) {
+	area = clipArea(area, IntRect(0, 0, size.x, size.y));
+	if(area.width <= 0 || area.height <= 0)
+		return;
+	for(int cy = area.top / chunkSize; cy <= (area.top + area.height - 1) / chunkSize; cy++)
+		for(int cx = area.left / chunkSize; cx <= (area.left + area.width - 1) / chunkSize; cx++)
+			flags[cx + cy * chunkCount.x] = std::max(flags[cx + cy * chunkCount.x], value);
+}
+
+void FlowField::markNeighbors(std::vector<uint8_t> &flags, int chunk) {
+	IntRect area = chunkArea(chunk);
+	markArea(flags, IntRect(area.left - 1, area.top - 1, area.width + 2, area.height + 2));
+}
+
+//Clear every cost and start again from the goals
+void FlowField::reset() {
+	std::fill(cost.begin(), cost.end(), std::numeric_limits<float>::infinity());
+	std::fill(direction.begin(), direction.end(), FLOW_NONE);
+	for(Vector2i goal : goals)
+		lowerGoal(goal);
+	markArea(stale, region);
+}
+
+//Goals on a chunk edge also start the chunks beside them, which pull the goal in from their borders
+void FlowField::lowerGoal(Vector2i goal) {
+	if(!isOpen(goal.x, goal.y) || cost[goal.x + goal.y * size.x] == 0)
+		return;
+	cost[goal.x + goal.y * size.x] = 0;
+	markArea(active, IntRect(goal.x - 1, goal.y - 1, 3, 3), FLOW_FULL);
+	markArea(stale, IntRect(goal.x - 1, goal.y - 1, 3, 3));
+}
+
+//Clear every tile whose cost came through the goal, following costs outward from it
+//Only valid once the last update finished, since partly spread costs can hide where they came from
+void FlowField::raiseGoal(Vector2i goal) {
+	if(!isOpen(goal.x, goal.y) || cost[goal.x + goal.y * size.x] != 0)
+		return;
+
+	std::vector<std::pair<int, float>> queue = {{goal.x + goal.y * size.x, 0.0f}};
+	cost[goal.x + goal.y * size.x] = std::numeric_limits<float>::infinity();
+	markArea(active, IntRect(goal.x, goal.y, 1, 1), FLOW_FULL);
+	markArea(stale, IntRect(goal.x - 1, goal.y - 1, 3, 3));
+	while(!queue.empty()) {
+		auto [i, value] = queue.back();
+		queue.pop_back();
+
+		int x = i % size.x, y = i / size.x;
+		for(int d = 0; d < 8; d++) {
+			int nx = x + FLOW_OFFSETS[d][0];
+			int ny = y + FLOW_OFFSETS[d][1];
+			if(!isOpen(nx, ny))
+				continue;
+			bool diagonal = d >= 4;
+			if(diagonal && !(isOpen(nx, y) && isOpen(x, ny)))
+				continue;
+
+			int n = nx + ny * size.x;
+			if(cost[n] == 0 || std::abs(cost[n] - (value + (diagonal ? FLOW_DIAGONAL_COST : 1))) > 0.0001f)
+				continue;
+			queue.emplace_back(n, cost[n]);
+			cost[n] = std::numeric_limits<float>::infinity();
+			markArea(active, IntRect(nx, ny, 1, 1), FLOW_FULL);
+			markArea(stale, IntRect(nx - 1, ny - 1, 3, 3));
+		}
+	}
+}
+
+void FlowField::setGoals(const std::vector<Vector2i> &_goals) {
+	std::vector<Vector2i> removed;
+	for(Vector2i goal : goals)
+		if(std::find(_goals.begin(), _goals.end(), goal) == _goals.end())
+			removed.push_back(goal);
+	goals = _goals;
+
+	if(!removed.empty()) {
+		//Costs still spreading from the last change can't be traced back to a goal
+		if(std::any_of(active.begin(), active.end(), [](uint8_t a) { return a != 0; })) {
+			reset();
+			return;
+		}
+		for(Vector2i goal : removed)
+			raiseGoal(goal);
+	}
+	for(Vector2i goal : goals)
+		lowerGoal(goal);
+}
+
+void FlowField::setRegion(IntRect area) {
+	region = clipArea(area, IntRect(0, 0, size.x, size.y));
+	reset();
+}
+
+//Opened tiles only lower costs, while blocked tiles clear every cost that could have passed through them
+void FlowField::refreshTiles() {
+	uint version = collision->getUpdateCount();
+	if(version == gridVersion)
+		return;
+
+	float threshold = std::numeric_limits<float>::infinity();
+	std::vector<int> tiles;
+	for(IntRect area : collision->getChanges(gridVersion, version)) {
+		area = clipArea(area, IntRect(0, 0, size.x, size.y));
+		if(area.width <= 0 || area.height <= 0)
+			continue;
+
+		tiles.resize(area.width * area.height);
+		collision->getBlock(area, tiles.data(), area.width);
+		for(int y = area.top; y < area.top + area.height; y++) {
+			for(int x = area.left; x < area.left + area.width; x++) {
+				int i = x + y * size.x;
+				bool now = passable(tiles[(x - area.left) + (y - area.top) * area.width]);
+				if(now == (bool)open[i])
+					continue;
+
+				open[i] = now;
+				if(now && std::find(goals.begin(), goals.end(), Vector2i(x, y)) != goals.end())
+					lowerGoal(Vector2i(x, y));
+				else if(!now) {
+					threshold = std::min(threshold, cost[i]);
+					cost[i] = std::numeric_limits<float>::infinity();
+				}
+				markArea(active, IntRect(x, y, 1, 1), FLOW_FULL);
+				markArea(stale, IntRect(x - 1, y - 1, 3, 3));
+			}
+		}
+	}
+	gridVersion = version;
+
+	if(threshold == std::numeric_limits<float>::infinity())
+		return;
+	for(int y = region.top; y < region.top + region.height; y++) {
+		for(int x = region.left; x < region.left + region.width; x++) {
+			int i = x + y * size.x;
+			if(cost[i] >= threshold && cost[i] != 0 && cost[i] != std::numeric_limits<float>::infinity()) {
+				cost[i] = std::numeric_limits<float>::infinity();
+				markArea(active, IntRect(x, y, 1, 1), FLOW_FULL);
+				markArea(stale, IntRect(x - 1, y - 1, 3, 3));
+			}
+		}
+	}
+}
+
+//Dijkstra inside one chunk, starting from its own costs and the edges of its neighbors
+//Marks the chunk changed, or 2 if its edge changed and neighbors need solving again
+bool FlowField::solveChunk(int chunk, uint8_t mode, std::vector<std::pair<float, int>> &heap) {
+	IntRect area = clipArea(chunkArea(chunk), region);
+	heap.clear();
+	changed[chunk] = 0;
+
+	auto lower = [&](int x, int y, float value) {
+		int i = x + y * size.x;
+		if(value >= cost[i])
+			return false;
+		cost[i] = value;
+
+		bool edge = x == area.left || y == area.top || x == area.left + area.width - 1 || y == area.top + area.height - 1;
+		changed[chunk] = std::max(changed[chunk], (uint8_t)(edge ? 2 : 1));
+		return true;
+	};
+
+	for(int y = area.top; y < area.top + area.height; y++) {
+		for(int x = area.left; x < area.left + area.width; x++) {
+			if(!isOpen(x, y))
+				continue;
+
+			//Pull costs in from outside cells
+			bool lowered = false;
+			bool border = x == area.left || y == area.top || x == area.left + area.width - 1 || y == area.top + area.height - 1;
+			for(int d = 0; border && d < 8; d++) {
+				int nx = x + FLOW_OFFSETS[d][0];
+				int ny = y + FLOW_OFFSETS[d][1];
+				if(inArea(area, nx, ny) || !isOpen(nx, ny))
+					continue;
+				bool diagonal = d >= 4;
+				if(diagonal && !(isOpen(nx, y) && isOpen(x, ny)))
+					continue;
+				lowered = lower(x, y, cost[nx + ny * size.x] + (diagonal ? FLOW_DIAGONAL_COST : 1)) || lowered;
+			}
+
+			//Unchanged cells already agree with the rest of the chunk
+			int i = x + y * size.x;
+			if(lowered || (mode == FLOW_FULL && cost[i] != std::numeric_limits<float>::infinity()))
+				heap.emplace_back(-cost[i], i);
+		}
+	}
+	std::make_heap(heap.begin(), heap.end());
+
+	while(!heap.empty()) {
+		std::pop_heap(heap.begin(), heap.end());
+		float value = -heap.back().first;
+		int i = heap.back().second;
+		heap.pop_back();
+		if(value > cost[i])
+			continue;
+
+		int x = i % size.x, y = i / size.x;
+		for(int d = 0; d < 8; d++) {
+			int nx = x + FLOW_OFFSETS[d][0];
+			int ny = y + FLOW_OFFSETS[d][1];
+			if(!inArea(area, nx, ny) || !isOpen(nx, ny))
+				continue;
+			bool diagonal = d >= 4;
+			if(diagonal && !(isOpen(nx, y) && isOpen(x, ny)))
+				continue;
+			if(lower(nx, ny, value + (diagonal ? FLOW_DIAGONAL_COST : 1))) {
+				heap.emplace_back(-cost[nx + ny * size.x], nx + ny * size.x);
+				std::push_heap(heap.begin(), heap.end());
+			}
+		}
+	}
+	return changed[chunk] != 0;
+}
+
+//Point each tile at the neighbor its cost came from
+void FlowField::solveDirections(int chunk) {
+	IntRect area = chunkArea(chunk);
+	for(int y = area.top; y < area.top + area.height; y++) {
+		for(int x = area.left; x < area.left + area.width; x++) {
+			int i = x + y * size.x;
+			direction[i] = FLOW_NONE;
+			if(!isOpen(x, y) || cost[i] == 0 || cost[i] == std::numeric_limits<float>::infinity())
+				continue;
+
+			float best = cost[i];
+			for(int d = 0; d < 8; d++) {
+				int nx = x + FLOW_OFFSETS[d][0];
+				int ny = y + FLOW_OFFSETS[d][1];
+				if(!isOpen(nx, ny))
+					continue;
+				bool diagonal = d >= 4;
+				if(diagonal && !(isOpen(nx, y) && isOpen(x, ny)))
+					continue;
+				float value = cost[nx + ny * size.x] + (diagonal ? FLOW_DIAGONAL_COST : 1);
+				if(value <= best + 0.0001f && cost[nx + ny * size.x] < cost[i]) {
+					best = value;
+					direction[i] = d;
+				}
+			}
+		}
+	}
+}
+
+//Solve chunks in four alternating colors so no two neighbors run at once
+void FlowField::update() {
+	refreshTiles();
+	solvedChunks = 0;
+
+	std::vector<std::pair<int, uint8_t>> list;
+	std::vector<std::pair<float, int>> heap;
+	bool any = true;
+	while(any) {
+		any = false;
+		for(int color = 0; color < 4; color++) {
+			list.clear();
+			for(int c = 0; c < (int)active.size(); c++) {
+				int cx = c % chunkCount.x, cy = c / chunkCount.x;
+				if(active[c] && (cx & 1) + (cy & 1) * 2 == color) {
+					list.emplace_back(c, active[c]);
+					active[c] = 0;
+				}
+			}
+			if(list.empty())
+				continue;
+
+			any = true;
+			solvedChunks += list.size();
+			if(list.size() == 1)
+				solveChunk(list[0].first, list[0].second, heap);
+			else {
+				parallelRange(list.size(), threads, [&](int start, int end) {
+					std::vector<std::pair<float, int>> localHeap;
+					localHeap.reserve(chunkSize * chunkSize);
+					for(int i = start; i < end; i++)
+						solveChunk(list[i].first, list[i].second, localHeap);
+				});
+			}
+
+			for(auto [c, mode] : list) {
+				if(changed[c])
+					stale[c] = 1;
+				if(changed[c] == 2) {
+					markNeighbors(active, c);
+					markNeighbors(stale, c);
+				}
+			}
+		}
+	}
+
+	std::vector<int> rebuild;
+	for(int c = 0; c < (int)stale.size(); c++) {
+		if(stale[c]) {
+			rebuild.push_back(c);
+			stale[c] = 0;
+		}
+	}
+	parallelRange(rebuild.size(), threads, [&](int start, int end) {
+		for(int i = start; i < end; i++)
+			solveDirections(rebuild[i]);
+	});
+}
+
+Vector2f FlowField::getDirection(Vector2i cell) const {
+	if(cell.x < 0 || cell.y < 0 || cell.x >= size.x || cell.y >= size.y)
+		return FLOW_DIRECTIONS[FLOW_NONE];
+	return FLOW_DIRECTIONS[direction[cell.x + cell.y * size.x]];
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <vector>
+
+#include "GridMaker.h"
+
+/*
+ * Shared directions toward the nearest goal, for crowds following the same target
+ */
+
+class FlowField {
+private:
+	Indexer *collision;
+	std::function<bool(int)> passable;
+	int chunkSize;
+	int threads;
+
+	Vector2i size;
+	Vector2i chunkCount;
+	IntRect region;
+	std::vector<uint8_t> open;
+	uint gridVersion = 0;
+
+	//Integration costs and the neighbor each cell points toward
+	std::vector<float> cost;
+	std::vector<uint8_t> direction;
+	std::vector<Vector2i> goals;
+
+	//Chunks waiting to be solved or to have directions rebuilt
+	std::vector<uint8_t> active;
+	std::vector<uint8_t> changed;
+	std::vector<uint8_t> stale;
+	int solvedChunks = 0;
+
+	bool isOpen(int x, int y) const {
+		return x >= region.left && y >= region.top && x < region.left + region.width &&
+			y < region.top + region.height && open[x + y * size.x];
+	}
+
+	IntRect chunkArea(int chunk) const;
+	void markArea(std::vector<uint8_t> &flags, IntRect area, uint8_t value=1);
+	void markNeighbors(std::vector<uint8_t> &flags, int chunk);
+	void reset();
+	void lowerGoal(Vector2i goal);
+	void raiseGoal(Vector2i goal);
+	void refreshTiles();
+	bool solveChunk(int chunk, uint8_t mode, std::vector<std::pair<float, int>> &heap);
+	void solveDirections(int chunk);
+
+public:
+	//Tiles passing the predicate can be crossed, by default EMPTY collision tiles
+	FlowField(Indexer *_collision, std::function<bool(int)> _passable=[](int c) { return c == 0; },
+		int _chunkSize=32, int _threads=0);
+
+	//Added goals only spread lower costs, removed goals only recalculate the tiles that led to them
+	void setGoals(const std::vector<Vector2i> &_goals);
+	void setGoal(Vector2i goal) {
+		setGoals({goal});
+	}
+
+	//Only calculate tiles inside area, the rest have no direction
+	void setRegion(IntRect area);
+	void clearRegion() {
+		setRegion(IntRect(0, 0, size.x, size.y));
+	}
+
+	//Apply goal and collision changes, usually once per frame before agents read directions
+	void update();
+
+	//Steps to the closest goal, or infinity if unreachable
+	float getCost(Vector2i cell) const {
+		if(!isOpen(cell.x, cell.y))
+			return std::numeric_limits<float>::infinity();
+		return cost[cell.x + cell.y * size.x];
+	}
+
+	//Unit direction toward the closest goal, zero at goals and unreachable tiles
+	Vector2f getDirection(Vector2i cell) const;
+	Vector2f getDirection(Vector2f position) const {
+		Vector2i scale = collision->getScale();
+		return getDirection(Vector2i(std::floor(position.x / scale.x), std::floor(position.y / scale.y)));
+	}
+
+	IntRect getRegion() const {
+		return region;
+	}
+
+	//Chunks solved by the last update
+	int getSolvedChunks() const {
+		return solvedChunks;
+	}
+};
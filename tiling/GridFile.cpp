@@ -0,0 +1,360 @@
+#include "GridFile.h"
+#include "GridMaker.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define GRID_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Layout (host byte order):
+ *   GridFileHeader, GridChannelEntry[channels], channel data
+ * Raw channels are 4 byte aligned tiles in row order
+ * RLE channels start with uint32 row offsets[height+1], then runs of (uint16 count, value)
+ */
+
+//Store value in tile type bytes
+static void writeTile(char *out, int value, int tileType) {
+	if(tileType == GRID_INT8) {
+		int8_t v = value;
+		std::memcpy(out, &v, 1);
+	} else if(tileType == GRID_INT16) {
+		int16_t v = value;
+		std::memcpy(out, &v, 2);
+	} else {
+		int32_t v = value;
+		std::memcpy(out, &v, 4);
+	}
+}
+
+static int readTile(const char *in, int tileType) {
+	if(tileType == GRID_INT8) {
+		int8_t v;
+		std::memcpy(&v, in, 1);
+		return v;
+	} else if(tileType == GRID_INT16) {
+		int16_t v;
+		std::memcpy(&v, in, 2);
+		return v;
+	}
+	int32_t v;
+	std::memcpy(&v, in, 4);
+	return v;
+}
+
+GridFileWriter::GridFileWriter(std::string filename, Vector2i _size, int channels) : size(_size) {
+	file.open(filename, std::ios::binary | std::ios::trunc);
+	if(!file.is_open())
+		throw new std::invalid_argument("Failed to write grid file: " + filename);
+
+	//Reserve header and channel table
+	GridFileHeader header;
+	std::memcpy(header.magic, GRID_FILE_MAGIC, 4);
+	header.version = GRID_FILE_VERSION;
+	header.channels = channels;
+	header.width = size.x;
+	header.height = size.y;
+	file.write((char*)&header, sizeof(header));
+
+	entries.resize(channels);
+	std::memset(entries.data(), 0, sizeof(GridChannelEntry) * channels);
+	file.write((char*)entries.data(), sizeof(GridChannelEntry) * channels);
+	rowBuffer.resize(size.x * (sizeof(uint16_t) + sizeof(int32_t)));
+}
+
+GridFileWriter::~GridFileWriter() {
+	close();
+}
+
+void GridFileWriter::beginChannel(std::string name, int fallback, int tileType, int compression) {
+	endChannel();
+	if(++channel >= (int)entries.size())
+		throw new std::invalid_argument("Too many grid channels");
+
+	GridChannelEntry &entry = entries[channel];
+	std::strncpy(entry.name, name.c_str(), GRID_CHANNEL_NAME - 1);
+	entry.fallback = fallback;
+	entry.tileType = tileType;
+	entry.compression = compression;
+
+	//Align raw data so it can be used in place
+	uint64_t pos = file.tellp();
+	while(pos % sizeof(int32_t) != 0) {
+		file.put(0);
+		pos++;
+	}
+	entry.offset = pos;
+	row = 0;
+
+	//Placeholder row table, filled in at end of channel
+	if(compression == GRID_RLE) {
+		rowOffsets.assign(size.y + 1, 0);
+		file.write((char*)rowOffsets.data(), sizeof(uint32_t) * rowOffsets.size());
+	}
+}
+
+void GridFileWriter::writeRow(const int *values) {
+	if(channel < 0 || row >= size.y)
+		throw new std::invalid_argument("Grid row outside of channel");
+
+	GridChannelEntry &entry = entries[channel];
+	char *out = rowBuffer.data();
+	if(entry.compression == GRID_RLE) {
+		rowOffsets[row] = (uint64_t)file.tellp() - entry.offset;
+		int x = 0;
+		while(x < size.x) {
+			uint16_t count = 1;
+			while(x + count < size.x && count < UINT16_MAX && values[x + count] == values[x])
+				count++;
+			std::memcpy(out, &count, sizeof(count));
+			writeTile(out + sizeof(count), values[x], entry.tileType);
+			out += sizeof(count) + entry.tileType;
+			x += count;
+		}
+	} else {
+		for(int x = 0; x < size.x; x++) {
+			writeTile(out, values[x], entry.tileType);
+			out += entry.tileType;
+		}
+	}
+	file.write(rowBuffer.data(), out - rowBuffer.data());
+	row++;
+}
+
+//Finish channel length and row table
+void GridFileWriter::endChannel() {
+	if(channel < 0 || channel >= (int)entries.size() || entries[channel].length != 0)
+		return;
+
+	GridChannelEntry &entry = entries[channel];
+	if(row != size.y)
+		std::cout << "Grid channel " << entry.name << " missing " << (size.y - row) << " rows\n";
+
+	uint64_t end = file.tellp();
+	entry.length = end - entry.offset;
+	if(entry.compression == GRID_RLE) {
+		rowOffsets[size.y] = entry.length;
+		file.seekp(entry.offset);
+		file.write((char*)rowOffsets.data(), sizeof(uint32_t) * rowOffsets.size());
+		file.seekp(end);
+	}
+}
+
+void GridFileWriter::close() {
+	if(!file.is_open())
+		return;
+	endChannel();
+
+	file.seekp(sizeof(GridFileHeader));
+	file.write((char*)entries.data(), sizeof(GridChannelEntry) * entries.size());
+	file.close();
+}
+
+void GridFileWriter::save(std::string filename, std::vector<std::pair<std::string, Indexer*>> channels, int compression, int tileType) {
+	if(channels.size() == 0)
+		return;
+
+	Vector2i size = channels[0].second->getSize();
+	GridFileWriter writer(filename, size, channels.size());
+	std::vector<int> row(size.x);
+
+	for(auto &channel : channels) {
+		Indexer *indexer = channel.second;
+
+		//Find range of values
+		int min = indexer->fallback;
+		int max = indexer->fallback;
+		for(int y = 0; y < size.y; y++)
+			for(int x = 0; x < size.x; x++) {
+				int value = indexer->getTileI(x, y);
+				min = std::min(min, value);
+				max = std::max(max, value);
+			}
+
+		int channelType = GRID_INT32;
+		if(tileType != 0)
+			channelType = tileType;
+		else if(min >= INT8_MIN && max <= INT8_MAX)
+			channelType = GRID_INT8;
+		else if(min >= INT16_MIN && max <= INT16_MAX)
+			channelType = GRID_INT16;
+
+		writer.beginChannel(channel.first, indexer->fallback, channelType, compression);
+		for(int y = 0; y < size.y; y++) {
+			for(int x = 0; x < size.x; x++)
+				row[x] = indexer->getTileI(x, y);
+			writer.writeRow(row.data());
+		}
+	}
+	writer.close();
+}
+
+//Map file into memory, or read it when mapping is not available
+GridFile::GridFile(std::string filename) {
+#ifdef GRID_MMAP
+	int fd = open(filename.c_str(), O_RDONLY);
+	if(fd < 0)
+		throw new std::invalid_argument("Failed to read grid file: " + filename);
+	struct stat info;
+	if(fstat(fd, &info) == 0 && info.st_size > 0) {
+		length = info.st_size;
+		//Private mapping lets tiles be edited without touching the file
+		void *map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if(map != MAP_FAILED) {
+			data = (char*)map;
+			mapped = true;
+		}
+	}
+	::close(fd);
+#endif
+
+	if(data == NULL) {
+		std::ifstream file(filename, std::ios::binary | std::ios::ate);
+		if(!file.is_open())
+			throw new std::invalid_argument("Failed to read grid file: " + filename);
+		length = file.tellg();
+		data = new char[length];
+		file.seekg(0);
+		file.read(data, length);
+	}
+
+	header = (GridFileHeader*)data;
+	entries = (GridChannelEntry*)(data + sizeof(GridFileHeader));
+	std::string error = "";
+	if(length < sizeof(GridFileHeader) || std::memcmp(header->magic, GRID_FILE_MAGIC, 4) != 0)
+		error = "Not a grid file: ";
+	else if(header->version > GRID_FILE_VERSION)
+		error = "Unsupported grid file version: ";
+	else if(length < sizeof(GridFileHeader) + sizeof(GridChannelEntry) * header->channels ||
+		header->width < 0 || header->height < 0)
+		error = "Failed to read grid file: ";
+	else {
+		for(int i = 0; i < header->channels; i++) {
+			GridChannelEntry &entry = entries[i];
+			if(entry.tileType != GRID_INT8 && entry.tileType != GRID_INT16 && entry.tileType != GRID_INT32)
+				error = "Unsupported grid tile type: ";
+			else if(entry.compression != GRID_RAW && entry.compression != GRID_RLE)
+				error = "Unsupported grid compression: ";
+		}
+	}
+
+	if(error != "") {
+		release();
+		throw new std::invalid_argument(error + filename);
+	}
+}
+
+GridFile::~GridFile() {
+	release();
+}
+
+void GridFile::release() {
+	if(data == NULL)
+		return;
+#ifdef GRID_MMAP
+	if(mapped)
+		munmap(data, length);
+	else
+		delete[] data;
+#else
+	delete[] data;
+#endif
+	data = NULL;
+}
+
+//Check a channel's data lies inside the file and holds at least size bytes
+bool GridFile::channelFits(int channel, uint64_t size) {
+	GridChannelEntry &entry = entries[channel];
+	return entry.offset <= length && entry.length <= length - entry.offset && size <= entry.length;
+}
+
+//Check for header without loading file
+bool GridFile::isGridFile(std::string filename) {
+	char magic[4] = {0};
+	std::ifstream file(filename, std::ios::binary);
+	file.read(magic, 4);
+	return file.good() && std::memcmp(magic, GRID_FILE_MAGIC, 4) == 0;
+}
+
+Vector2i GridFile::getSize() {
+	return Vector2i(header->width, header->height);
+}
+
+int GridFile::getChannelCount() {
+	return header->channels;
+}
+
+int GridFile::findChannel(std::string name) {
+	for(int i = 0; i < header->channels; i++)
+		if(name == getChannelName(i))
+			return i;
+	return -1;
+}
+
+std::string GridFile::getChannelName(int channel) {
+	return std::string(entries[channel].name, strnlen(entries[channel].name, GRID_CHANNEL_NAME));
+}
+
+int GridFile::getFallback(int channel) {
+	return entries[channel].fallback;
+}
+
+void GridFile::readRows(int channel, int *values, int startRow, int rows, int offset) {
+	GridChannelEntry &entry = entries[channel];
+	const int width = header->width;
+	const int height = header->height;
+	if(startRow < 0 || rows < 0 || startRow + rows > height)
+		throw new std::invalid_argument("Grid rows outside of channel");
+
+	const char *start = data + entry.offset;
+	if(entry.compression == GRID_RLE) {
+		uint64_t tableSize = sizeof(uint32_t) * ((uint64_t)height + 1);
+		if(!channelFits(channel, tableSize))
+			throw new std::invalid_argument("Grid channel past end of file");
+
+		const uint32_t *rowOffsets = (const uint32_t*)start;
+		for(int y = 0; y < rows; y++) {
+			uint32_t rowStart = rowOffsets[startRow + y];
+			uint32_t rowEnd = rowOffsets[startRow + y + 1];
+			if(rowStart < tableSize || rowStart > rowEnd || rowEnd > entry.length)
+				throw new std::invalid_argument("Grid channel has invalid row offsets");
+
+			const char *in = start + rowStart;
+			const char *end = start + rowEnd;
+			int *out = values + y * width;
+			int x = 0;
+			while(in + sizeof(uint16_t) + entry.tileType <= end && x < width) {
+				uint16_t count;
+				std::memcpy(&count, in, sizeof(count));
+				int value = readTile(in + sizeof(count), entry.tileType) + offset;
+				std::fill(out + x, out + std::min(x + count, width), value);
+				x += count;
+				in += sizeof(count) + entry.tileType;
+			}
+			if(x < width)
+				throw new std::invalid_argument("Grid channel has short rows");
+		}
+	} else {
+		if(!channelFits(channel, (uint64_t)width * height * entry.tileType))
+			throw new std::invalid_argument("Grid channel past end of file");
+		const char *in = start + (size_t)startRow * width * entry.tileType;
+		for(int i = 0; i < rows * width; i++)
+			values[i] = readTile(in + i * entry.tileType, entry.tileType) + offset;
+	}
+}
+
+int *GridFile::mapChannel(int channel) {
+	GridChannelEntry &entry = entries[channel];
+	if(entry.compression != GRID_RAW || entry.tileType != GRID_INT32 || entry.offset % sizeof(int32_t) != 0)
+		return NULL;
+	if(!channelFits(channel, (uint64_t)header->width * header->height * sizeof(int32_t)))
+		throw new std::invalid_argument("Grid channel past end of file");
+	return (int*)(data + entry.offset);
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "../core/Vector.h"
+
+#define GRID_FILE_MAGIC "SKGR"
+#define GRID_FILE_VERSION 1
+#define GRID_CHANNEL_NAME 32
+
+/*
+ * Versioned binary grid files with compressed named channels
+ */
+
+class Indexer;
+
+//Bytes stored per tile
+enum GridTileType {
+	GRID_INT8 = 1,
+	GRID_INT16 = 2,
+	GRID_INT32 = 4
+};
+
+//Channel data layout
+enum GridCompression {
+	GRID_RAW,
+	GRID_RLE
+};
+
+//Fixed header at start of file, followed by one entry per channel
+struct GridFileHeader {
+	char magic[4];
+	uint16_t version;
+	uint16_t channels;
+	int32_t width;
+	int32_t height;
+};
+
+struct GridChannelEntry {
+	char name[GRID_CHANNEL_NAME];
+	int32_t fallback;
+	uint8_t tileType;
+	uint8_t compression;
+	uint16_t padding;
+	uint64_t offset;
+	uint64_t length;
+};
+
+//Writes channels row by row without holding the full grid
+class GridFileWriter {
+private:
+	std::ofstream file;
+	Vector2i size;
+	std::vector<GridChannelEntry> entries;
+	std::vector<uint32_t> rowOffsets;
+	std::vector<char> rowBuffer;
+
+	int channel = -1;
+	int row = 0;
+
+	void endChannel();
+
+public:
+	GridFileWriter(std::string filename, Vector2i size, int channels);
+	~GridFileWriter();
+
+	void beginChannel(std::string name, int fallback, int tileType=GRID_INT32, int compression=GRID_RLE);
+	void writeRow(const int *values);
+	void close();
+
+	//Write each indexer as a channel, picking smallest tile type that fits unless one is given
+	//Only GRID_RAW with GRID_INT32 channels can be mapped in place
+	static void save(std::string filename, std::vector<std::pair<std::string, Indexer*>> channels,
+		int compression=GRID_RLE, int tileType=0);
+};
+
+//Memory mapped grid file, with raw channels readable in place
+class GridFile {
+private:
+	char *data = NULL;
+	size_t length = 0;
+	bool mapped = false;
+
+	GridFileHeader *header;
+	GridChannelEntry *entries;
+
+	void release();
+	bool channelFits(int channel, uint64_t size);
+
+public:
+	GridFile(std::string filename);
+	~GridFile();
+
+	static bool isGridFile(std::string filename);
+
+	Vector2i getSize();
+	int getChannelCount();
+	int findChannel(std::string name);
+	std::string getChannelName(int channel);
+	int getFallback(int channel);
+
+	//Decode rows of a channel into a width*rows buffer
+	void readRows(int channel, int *values, int startRow, int rows, int offset=0);
+
+	//Direct pointer to tiles if channel is raw 32 bit, otherwise NULL
+	int *mapChannel(int channel);
+};
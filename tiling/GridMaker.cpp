@@ -1,15 +1,34 @@
 #include "GridMaker.h"
 
 #include "../core/Event.h"
+#include "../util/Parallel.hpp"
+
+#include <algorithm>
+#include <chrono>
 
 /*
  * Generates and stores main tilemap
  */
 
+//Unlink in both directions so neither side keeps a dangling pointer
+Indexer::~Indexer() {
+	for(Indexer *source : sources)
+		source->dependents.erase(std::remove(source->dependents.begin(), source->dependents.end(), this), source->dependents.end());
+	for(Indexer *indexer : dependents) {
+		indexer->sources.erase(std::remove(indexer->sources.begin(), indexer->sources.end(), this), indexer->sources.end());
+		indexer->sourceRemoved(this);
+	}
+}
+
 int Indexer::mapTile(int c) {
 	return c;
 }
 
+//Map tile with known position, for indexers that vary by location
+int Indexer::mapTileI(int c, int x, int y) {
+	return mapTile(c);
+}
+
 //Scale vector before retrieving value
 int Indexer::getTile(Vector2f position) {
 	return getTileI(position.x / getScale().x, position.y / getScale().y);
@@ -23,7 +42,7 @@ void Indexer::setTile(Vector2f position, int value) {
 //Get tile int from previous
 int Indexer::getTileI(int x, int y) {
 	if(inBounds(x, y))
-		return mapTile(previous->getTileI(x, y));
+		return mapTileI(previous->getTileI(x, y), x, y);
 	return fallback;
 }
 
@@ -65,9 +84,166 @@ void Indexer::setGrid(int *values) {
 }
 
 uint Indexer::getUpdateCount() {
+	if(previous == NULL)
+		return 0;
 	return previous->getUpdateCount();
 }
 
+//Shared version counter across every grid and indexer
+static std::atomic<uint> versionCounter = 0;
+uint Indexer::nextVersion() {
+	return ++versionCounter;
+}
+
+void ChangeJournal::mark(IntRect area) {
+	updates = Indexer::nextVersion();
+	changes.push_back({updates, area});
+	while(changes.size() > GRID_JOURNAL_SIZE) {
+		start = changes.front().version;
+		changes.pop_front();
+	}
+}
+
+std::vector<IntRect> ChangeJournal::getChanges(uint since, uint until, IntRect full) {
+	std::vector<IntRect> areas;
+	if(since >= updates)
+		return areas;
+	if(since < start) {
+		areas.push_back(full);
+		return areas;
+	}
+
+	//Journal is sorted by version
+	auto change = std::upper_bound(changes.begin(), changes.end(), since,
+		[](uint version, const Change &c) { return version < c.version; });
+	for(; change != changes.end() && change->version <= until; ++change)
+		areas.push_back(change->area);
+	return areas;
+}
+
+//Get areas changed after version since, up to and including until
+std::vector<IntRect> Indexer::getChanges(uint since, uint until) {
+	if(previous == NULL)
+		return std::vector<IntRect>();
+
+	std::vector<IntRect> changes = previous->getChanges(since, until);
+	IntRect footprint = getFootprint();
+	if(footprint.width != 0 || footprint.height != 0 || footprint.left != 0 || footprint.top != 0) {
+		for(IntRect &area : changes) {
+			area.left += footprint.left;
+			area.top += footprint.top;
+			area.width += footprint.width;
+			area.height += footprint.height;
+		}
+	}
+	return changes;
+}
+
+//Offset and extra size of tiles affected by a change below this indexer
+IntRect Indexer::getFootprint() {
+	return IntRect(0, 0, 0, 0);
+}
+
+IntRect Indexer::fullRect() {
+	return IntRect(Vector2i(0, 0), getSize());
+}
+
+//Call function whenever this indexer or anything below it changes
+int Indexer::subscribe(std::function<void()> func) {
+	listeners.emplace_back(nextListener, func);
+	return nextListener++;
+}
+
+void Indexer::unsubscribe(int id) {
+	for(auto it = listeners.begin(); it != listeners.end(); ++it)
+		if(it->first == id) {
+			listeners.erase(it);
+			return;
+		}
+}
+
+//Mark indexer as reading from this one
+void Indexer::addDependent(Indexer *indexer) {
+	dependents.push_back(indexer);
+	indexer->sources.push_back(this);
+}
+
+void Indexer::removeDependent(Indexer *indexer) {
+	dependents.erase(std::remove(dependents.begin(), dependents.end(), indexer), dependents.end());
+	indexer->sources.erase(std::remove(indexer->sources.begin(), indexer->sources.end(), this), indexer->sources.end());
+}
+
+//A detached indexer reads as an empty grid
+void Indexer::sourceRemoved(Indexer *source) {
+	if(previous == source)
+		previous = NULL;
+}
+
+//Send change to listeners and every indexer stacked on this one
+void Indexer::notifyChanged() {
+	for(auto &listener : listeners)
+		listener.second();
+	for(Indexer *indexer : dependents)
+		indexer->notifyChanged();
+}
+
+//Merge change lists without repeating areas
+void Indexer::addChanges(std::vector<IntRect> &changes, const std::vector<IntRect> &other) {
+	for(const IntRect &area : other) {
+		bool found = false;
+		for(const IntRect &existing : changes)
+			if(existing.left == area.left && existing.top == area.top &&
+				existing.width == area.width && existing.height == area.height)
+				found = true;
+		if(!found)
+			changes.push_back(area);
+	}
+}
+
+//Read an area of tiles into a buffer with the given row stride
+void Indexer::getBlock(IntRect area, int *values, int stride) {
+	for(int y = 0; y < area.height; y++)
+		for(int x = 0; x < area.width; x++)
+			values[y * stride + x] = getTileI(area.left + x, area.top + y);
+}
+
+//Evaluate full indexer stack into a grid, split into blocks across threads
+BakeStats Indexer::bake(GridMaker *target, int threads, int blockSize) {
+	using clock = std::chrono::steady_clock;
+	BakeStats stats;
+	clock::time_point start = clock::now();
+
+	//Results are buffered so the stack can safely read from its own target
+	const Vector2i size = min(getSize(), target->getSize());
+	std::vector<int> values(target->getSize().x * target->getSize().y);
+	const int width = target->getSize().x;
+	for(int y = 0; y < target->getSize().y; y++)
+		for(int x = 0; x < width; x++)
+			values[y * width + x] = (x < size.x && y < size.y) ? 0 : target->getTileI(x, y);
+
+	stats.threads = std::min(parallelThreadCount(threads),
+		std::max(((size.x + blockSize - 1) / blockSize) * ((size.y + blockSize - 1) / blockSize), 1));
+	stats.threadTimes.resize(stats.threads);
+	clock::time_point evaluate = clock::now();
+	stats.prepareTime = std::chrono::duration<double>(evaluate - start).count();
+
+	//Each block only depends on its own positions
+	std::atomic<int> blocks = 0;
+	parallelBlocks(size, blockSize, stats.threads, [&](IntRect block, int thread) {
+		clock::time_point blockStart = clock::now();
+		getBlock(block, values.data() + block.top * width + block.left, width);
+		stats.threadTimes[thread] += std::chrono::duration<double>(clock::now() - blockStart).count();
+		blocks++;
+	});
+	stats.blocks = blocks;
+
+	clock::time_point write = clock::now();
+	stats.evaluateTime = std::chrono::duration<double>(write - evaluate).count();
+	target->setGrid(values.data());
+	stats.writeTime = std::chrono::duration<double>(clock::now() - write).count();
+	return stats;
+}
+
 bool Indexer::inBounds(Vector2f pos) {
 	return pos.x >= 0 && pos.x < getSize().x*getScale().x &&
 		pos.y >= 0 && pos.y < getSize().y*getScale().y;
@@ -85,6 +261,8 @@ Vector2f Indexer::snapPosition(Vector2f position) {
 
 //Get size of grid
 Vector2i Indexer::getSize() {
+	if(previous == NULL)
+		return Vector2i(0, 0);
 	return previous->getSize();
 }
 
@@ -110,6 +288,11 @@ void Indexer::printGrid() {
 
 //Convert file to int[][]
 GridMaker::GridMaker(std::string file, int fallback) : Indexer(NULL, fallback, Vector2i(1, 1)) {
+	if(file != "" && GridFile::isGridFile(file)) {
+		loadGrid(file);
+		return;
+	}
+
 	char *mapFile = IO::openFile(file);
 	char *line = mapFile;
 
@@ -130,35 +313,69 @@ GridMaker::GridMaker(std::string file, int fallback) : Indexer(NULL, fallback, V
 	IO::closeFile(mapFile);
 
 	//Build array
-	this->tiles = new int*[height];
-	for(int i = 0; i < height; i++) {
-		tiles[i] = new int[width];
-		for(int j = 0; j < width; j++)
-			tiles[i][j] = fallback;
-	}
+	buildRows(new int[width * height]);
+	std::fill(data, data + width * height, fallback);
 	reload(file);
 }
 
+//Open named channel of binary grid file
+GridMaker::GridMaker(std::string file, std::string _channel) : Indexer(NULL, 0, Vector2i(1, 1)), channel(_channel) {
+	loadGrid(file);
+}
+
 //Create blank int[][]
 GridMaker::GridMaker(int width, int height, int fallback) : Indexer(NULL, fallback, Vector2i(1, 1)) {
 	this->width = width;
 	this->height = height;
 
 	//Build array
-	this->tiles = new int*[height];
-	for(int i = 0; i < height; i++) {
-		tiles[i] = new int[width];
-		for(int j = 0; j < width; j++)
-			tiles[i][j] = fallback;
-	}
+	buildRows(new int[width * height]);
+	std::fill(data, data + width * height, fallback);
 }
 
 GridMaker::~GridMaker() {
-	for(int y = 0; y < height; y++)
-		delete[] tiles[y];
+	if(source == NULL)
+		delete[] data;
+	delete source;
 	delete[] tiles;
 }
 
+//Point rows into one contiguous block
+void GridMaker::buildRows(int *block) {
+	data = block;
+	tiles = new int*[height];
+	for(int y = 0; y < height; y++)
+		tiles[y] = data + y * width;
+}
+
+//Use mapped tiles in place when stored raw, otherwise decode
+void GridMaker::loadGrid(std::string file) {
+	source = new GridFile(file);
+	if(source->getChannelCount() == 0)
+		throw new std::invalid_argument("Grid file has no channels: " + file);
+	int c = source->findChannel(channel);
+	if(c == -1 && channel != "") {
+		delete source;
+		source = NULL;
+		throw new std::invalid_argument("Grid file has no channel " + channel + ": " + file);
+	}
+	c = std::max(c, 0);
+
+	width = source->getSize().x;
+	height = source->getSize().y;
+	fallback = source->getFallback(c);
+
+	int *mapped = source->mapChannel(c);
+	if(mapped != NULL)
+		buildRows(mapped);
+	else {
+		buildRows(new int[width * height]);
+		source->readRows(c, data, 0, height);
+		delete source;
+		source = NULL;
+	}
+}
+
 void GridMaker::reload(std::string file, int offset, Rect<int> border) {
 	if(file == "")
 		return;
@@ -168,6 +385,11 @@ void GridMaker::reload(std::string file, int offset, Rect<int> border) {
 	if(border.height == 0 || border.top + border.height > height)
 		border.height = height-border.top;
 
+	if(GridFile::isGridFile(file)) {
+		reloadGrid(file, offset, border);
+		return;
+	}
+
 	//Set reading variables
 	int i = border.top;
 	char *mapFile = IO::openFile(file);
@@ -192,30 +414,56 @@ void GridMaker::reload(std::string file, int offset, Rect<int> border) {
 		line += j;
 	}
 	IO::closeFile(mapFile);
-	updates++;
+	markChanged(border);
 }
 
+//Copy binary file into border, starting from the file's top left
+void GridMaker::reloadGrid(std::string file, int offset, Rect<int> border) {
+	GridFile grid(file);
+	int c = grid.findChannel(channel);
+	if(c == -1 && channel != "")
+		throw new std::invalid_argument("Grid file has no channel " + channel + ": " + file);
+	c = std::max(c, 0);
+	Vector2i size = grid.getSize();
+	int rows = std::min(border.height, size.y);
+	int columns = std::min(border.width, size.x);
+	if(rows <= 0 || columns <= 0 || grid.getChannelCount() == 0)
+		return;
+
+	std::vector<int> values(size.x * rows);
+	grid.readRows(c, values.data(), 0, rows, offset);
+	for(int y = 0; y < rows; y++)
+		std::copy(values.begin() + y * size.x, values.begin() + y * size.x + columns, tiles[y + border.top] + border.left);
+	markChanged(IntRect(border.left, border.top, columns, rows));
+}
+
+//Export as one char per tile
 void GridMaker::save(std::string file) {
 	if(file == "")
 		return;
 
-	const int width = getSize().x+1;
-	const int height = getSize().y;
-
-	char text[height*width+height];
+	std::string text;
+	text.reserve((width + 1) * height);
 
 	//Loop through tiles
 	for(int y = 0; y < height; y++) {
-		for(int x = 0; x < width; x++) {
-			text[y*width+x] = tiles[y][x];
-		}
-		text[y*width+width-1] = '\n';
+		if(y > 0)
+			text += '\n';
+		for(int x = 0; x < width; x++)
+			text += (char)tiles[y][x];
 	}
-	text[(height-1)*width+width-1] = '\0';
 
 	IO::writeFile(file, text);
 }
 
+//Export as binary grid file, streamed by row
+void GridMaker::saveBinary(std::string file, std::string name, int compression, int tileType) {
+	if(file == "")
+		return;
+
+	GridFileWriter::save(file, {{name, this}}, compression, tileType);
+}
+
 //Get tile value
 int GridMaker::getTileI(int x, int y) {
 	if(inBounds(x, y))
@@ -228,20 +476,48 @@ int GridMaker::getTileI(int x, int y) {
 void GridMaker::setTileI(int x, int y, int value) {
 	if(inBounds(x, y)) {
 		tiles[y][x] = value;
-		updates++;
+		markChanged(IntRect(x, y, 1, 1));
 	}
 }
 
+//Copy full grid of values in one update
+void GridMaker::setGrid(int *values) {
+	std::copy(values, values + width * height, data);
+	markChanged(fullRect());
+}
+
 //Set all tiles
 void GridMaker::clearTiles() {
-	for(int y = 0; y < height; y++)
-		for(int x = 0; x < width; x++)
-			tiles[y][x] = fallback;
-	updates++;
+	std::fill(data, data + width * height, fallback);
+	markChanged(fullRect());
 }
 
 uint GridMaker::getUpdateCount() {
-	return updates;
+	return journal.getUpdateCount();
+}
+
+void GridMaker::markChanged(IntRect area) {
+	journal.mark(area);
+	notifyChanged();
+}
+
+std::vector<IntRect> GridMaker::getChanges(uint since, uint until) {
+	return journal.getChanges(since, until, fullRect());
+}
+
+//Copy rows directly when area is inside grid
+void GridMaker::getBlock(IntRect area, int *values, int stride) {
+	if(area.left < 0 || area.top < 0 || area.left + area.width > width || area.top + area.height > height) {
+		Indexer::getBlock(area, values, stride);
+		return;
+	}
+
+	for(int y = 0; y < area.height; y++)
+		std::copy(tiles[area.top + y] + area.left, tiles[area.top + y] + area.left + area.width, values + y * stride);
+}
+
+int *GridMaker::getRow(int y) {
+	return tiles[y];
 }
 
 //Get size of grid
@@ -249,6 +525,15 @@ Vector2i GridMaker::getSize() {
 	return Vector2i(width, height);
 }
 
+std::ostream& operator<<(std::ostream& os, const BakeStats &stats) {
+	os << "Bake " << stats.blocks << " blocks on " << stats.threads << " threads: prepare " <<
+		stats.prepareTime * 1000 << "ms, evaluate " << stats.evaluateTime * 1000 << "ms, write " <<
+		stats.writeTime * 1000 << "ms (";
+	for(double time : stats.threadTimes)
+		os << time * 1000 << "ms ";
+	return os << "per thread)";
+}
+
 //Concat 2 maps
 std::map<int, int> operator+(const std::map<int, int> &first, const std::map<int, int> &second) {
 	std::map<int, int> third;
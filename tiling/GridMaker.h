@@ -1,31 +1,69 @@
 #pragma once
 
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <deque>
 #include <functional>
 #include <iostream>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "../core/Vector.h"
+#include "GridFile.h"
 
 /*
  * Generates and stores tiles for maps
  */
 
+#define MAP_TABLE_SIZE 4096
+#define MAP_TABLE_MISSING INT_MIN
+#define GRID_JOURNAL_SIZE 1024
+
+class GridMaker;
+
+//Timing results from baking an indexer into a grid
+struct BakeStats {
+	int threads = 1;
+	int blocks = 0;
+	double prepareTime = 0;
+	double evaluateTime = 0;
+	double writeTime = 0;
+	std::vector<double> threadTimes;
+
+	double totalTime() {
+		return prepareTime + evaluateTime + writeTime;
+	}
+};
+std::ostream& operator<<(std::ostream& os, const BakeStats &stats);
+
 //Base class for reading tile properties, can be stacked
 class Indexer {
 private:
 	Indexer *previous = NULL;
 	const Vector2i scale;
 
+	//Indexers and functions to notify on change, and indexers this one reads from
+	std::vector<Indexer *> dependents;
+	std::vector<Indexer *> sources;
+	std::vector<std::pair<int, std::function<void()>>> listeners;
+	int nextListener = 0;
+
 public:
 	int fallback;
 
 	Indexer(Indexer *_previous, int _fallback, Vector2i _scale)
 		: previous(_previous), scale(_scale), fallback(_fallback) {
 
+		if(previous != NULL)
+			previous->addDependent(this);
 	}
 
+	virtual ~Indexer();
+
 	virtual int mapTile(int c);
+	virtual int mapTileI(int c, int x, int y);
 
 	//Indexing access functions
 	virtual int getTile(Vector2f position);
@@ -36,10 +74,29 @@ public:
 	void setTileB(int x, int y, int place, bool value);
 
 	//Full grid access
+	virtual void getBlock(IntRect area, int *values, int stride);
 	void mapGrid(std::function<void(int, Vector2f)> func);
-	void setGrid(int *values);
+	virtual void setGrid(int *values);
 	void printGrid();
 	virtual uint getUpdateCount();
+	BakeStats bake(GridMaker *target, int threads=0, int blockSize=64);
+
+	//Change tracking, versions come from a shared counter so any indexer can be compared
+	static uint nextVersion();
+	virtual std::vector<IntRect> getChanges(uint since, uint until=(uint)-1);
+	virtual IntRect getFootprint();
+	IntRect fullRect();
+	static void addChanges(std::vector<IntRect> &changes, const std::vector<IntRect> &other);
+
+	//Push change notifications up the stack
+	int subscribe(std::function<void()> func);
+	void unsubscribe(int id);
+	void addDependent(Indexer *indexer);
+	void removeDependent(Indexer *indexer);
+	virtual void notifyChanged();
+
+	//Called when an indexer this one reads from is destroyed first
+	virtual void sourceRemoved(Indexer *source);
 
 	//Check grid size
 	virtual Vector2i getSize();
@@ -50,52 +107,140 @@ public:
 	Indexer *getPrevious();
 };
 
+//Recent changed areas by version, for indexers that store their own tiles
+class ChangeJournal {
+private:
+	struct Change {
+		uint version;
+		IntRect area;
+	};
+	std::deque<Change> changes;
+	uint updates = 0;
+	uint start = 0;
+
+public:
+	//Record area under a new version
+	void mark(IntRect area);
+	uint getUpdateCount() {
+		return updates;
+	}
+
+	//Areas changed after since up to until, or full if the journal no longer covers since
+	std::vector<IntRect> getChanges(uint since, uint until, IntRect full);
+};
+
 //Lowest level indexer to store the actual grid
 class GridMaker : public Indexer {
 private:
 	int height = 0;
 	int width = 0;
-	int **tiles;
+	int *data = NULL;
+	int **tiles = NULL;
 
-	uint updates = 0;
+	//Binary file the tiles may be mapped from
+	GridFile *source = NULL;
+	std::string channel = "";
+
+	void buildRows(int *block);
+	void loadGrid(std::string file);
+	void reloadGrid(std::string file, int offset, Rect<int> border);
+
+	ChangeJournal journal;
+	void markChanged(IntRect area);
 
 public:
 	//Build and convert grid
 	GridMaker(std::string file, int fallback=' ');
+	GridMaker(std::string file, std::string channel);
 	GridMaker(int width, int height, int fallback=' ');
 	~GridMaker();
 	void reload(std::string file, int offset=0, Rect<int> border=Rect<int>());
 	void save(std::string file);
+	//Save with GRID_RAW and GRID_INT32 for files that can be mapped in place when loaded
+	void saveBinary(std::string file, std::string name="tiles", int compression=GRID_RLE, int tileType=0);
 
 	//Set or get tiles
 	int getTileI(int x, int y) override;
 	void setTileI(int x, int y, int value) override;
+	void setGrid(int *values) override;
 	void clearTiles();
 	uint getUpdateCount() override;
+	std::vector<IntRect> getChanges(uint since, uint until=(uint)-1) override;
+
+	void getBlock(IntRect area, int *values, int stride) override;
+
+	//Direct row access for bulk readers, without bounds checks
+	int *getRow(int y);
 
 	//Check grid size
 	Vector2i getSize() override;
 };
 
+//Dense copy of a tile map when keys are close together, shared by MapIndexer and MapStage
+class MapTable {
+private:
+	std::vector<int> table;
+	int tableStart = 0;
+
+public:
+	MapTable(const std::map<int, int> &indexes) {
+		if(indexes.empty())
+			return;
+		int start = indexes.begin()->first;
+		int64_t span = (int64_t)indexes.rbegin()->first - (int64_t)start + 1;
+		if(span > MAP_TABLE_SIZE)
+			return;
+
+		tableStart = start;
+		table.assign(span, MAP_TABLE_MISSING);
+		for(auto &index : indexes) {
+			if(index.second == MAP_TABLE_MISSING) {
+				table.clear();
+				return;
+			}
+			table[index.first - start] = index.second;
+		}
+	}
+
+	//Whether lookups can skip the map
+	bool empty() const {
+		return table.empty();
+	}
+
+	//Mapped value, or MAP_TABLE_MISSING if not in map
+	int find(int c) const {
+		unsigned int i = c - tableStart;
+		return (i < table.size()) ? table[i] : MAP_TABLE_MISSING;
+	}
+};
+
 //Common indexer to map from tile to property 1x1
 class MapIndexer : public Indexer {
 private:
 	const std::map<int, int> indexes;
+	const MapTable table;
 	bool keepOthers = false;
 
 public:
 	MapIndexer(Indexer *previous, std::map<int, int> _indexes, int fallback, int scaleX = 1, int scaleY = 1, bool _keepOthers=false)
-		: Indexer(previous, fallback, Vector2i(scaleX, scaleY)), indexes(_indexes), keepOthers(_keepOthers) {
+		: Indexer(previous, fallback, Vector2i(scaleX, scaleY)), indexes(_indexes), table(indexes), keepOthers(_keepOthers) {
 
 	}
 
 	MapIndexer(Indexer *previous, std::map<int, int> _indexes, int fallback, Vector2i scale)
-		: Indexer(previous, fallback, scale), indexes(_indexes) {
+		: Indexer(previous, fallback, scale), indexes(_indexes), table(indexes) {
 
 	}
 
 	//Get value of tile from map
 	int mapTile(int c) override {
+		if(!table.empty()) {
+			int value = table.find(c);
+			if(value != MAP_TABLE_MISSING)
+				return value;
+			return keepOthers ? c : fallback;
+		}
+
 		auto tile = indexes.find(c);
 		if(tile != indexes.end())
 			return tile->second;
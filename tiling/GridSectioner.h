@@ -1,10 +1,21 @@
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
 #include <fstream>
+#include <mutex>
+#include <thread>
 #include <nlohmann/json.hpp>
 using json = nlohmann::json;
 
 #include "GridMaker.h"
 #include "../util/VertexGraph.hpp"
-#include "../core/Node.h"
+#include "../core/UpdateList.h"
+
+enum SectionState {
+	SECTION_UNLOADED,
+	SECTION_LOADING,
+	SECTION_RESIDENT
+};
 
 class GridSection : public Vertex<4>, public Node {
 public:
@@ -12,6 +23,10 @@ public:
 	std::string file;
 	int tileOffset = 0;
 
+	//Tiles while streamed in
+	int state = SECTION_UNLOADED;
+	GridMaker *tiles = NULL;
+
 	sint upId = 0;
 	sint rightId = 0;
 	sint downId = 0;
@@ -35,16 +50,20 @@ public:
 		x = data.value("x_offset", 0);
 		y = data.value("y_offset", 0);
 
-		std::string line;
-		std::ifstream mapFile(file);
-
-		//Get maximum file size
-		while(std::getline(mapFile, line)) {
-			if(line.size() > width)
-				width = line.size();
-			++height;
+		//Get maximum file size, unless already listed in world
+		width = data.value("width", 0);
+		height = data.value("height", 0);
+		if(width == 0 || height == 0) {
+			width = height = 0;
+			std::string line;
+			std::ifstream mapFile(file);
+			while(std::getline(mapFile, line)) {
+				if(line.size() > width)
+					width = line.size();
+				++height;
+			}
+			mapFile.close();
 		}
-		mapFile.close();
 
 		setSize(Vector2i(width, height));
 		createPixelRect(FloatRect(0,0, width, height), Vector2i(0,0), 0);
@@ -55,22 +74,170 @@ public:
 		setSize(Vector2i(width * scale.x, height * scale.y));
 		createPixelRect(FloatRect(0,0, width * scale.x, height * scale.y), Vector2i(0,0), 0);
 	}
+
+	IntRect getArea() {
+		return IntRect(x, y, width, height);
+	}
+
+	bool hasTile(int tx, int ty) {
+		return tx >= x && ty >= y && tx < x + (int)width && ty < y + (int)height;
+	}
+
+	//Distance in tiles from position to nearest tile of section
+	float distance(Vector2f position) {
+		float dx = std::max(std::max(x - position.x, position.x - (x + width)), 0.0f);
+		float dy = std::max(std::max(y - position.y, position.y - (y + height)), 0.0f);
+		return std::sqrt(dx * dx + dy * dy);
+	}
+};
+
+//Reads tiles from resident sections, with fallback everywhere else
+class SectionIndexer : public Indexer {
+private:
+	Vector2i size;
+	std::vector<GridSection *> resident;
+	GridSection *last = NULL;
+
+	ChangeJournal journal;
+
+	GridSection *findSection(int x, int y) {
+		if(last != NULL && last->hasTile(x, y))
+			return last;
+		for(GridSection *section : resident)
+			if(section->hasTile(x, y))
+				return last = section;
+		return NULL;
+	}
+
+public:
+	SectionIndexer(Vector2i _size, int fallback) : Indexer(NULL, fallback, Vector2i(1, 1)), size(_size) {
+
+	}
+
+	int getTileI(int x, int y) override {
+		GridSection *section = findSection(x, y);
+		if(section != NULL)
+			return section->tiles->getTileI(x - section->x, y - section->y);
+		return fallback;
+	}
+
+	//Edits are kept only while the section stays resident
+	void setTileI(int x, int y, int value) override {
+		GridSection *section = findSection(x, y);
+		if(section != NULL) {
+			section->tiles->setTileI(x - section->x, y - section->y, value);
+			markChanged(IntRect(x, y, 1, 1));
+		}
+	}
+
+	//Copy rows from each resident section in area
+	void getBlock(IntRect area, int *values, int stride) override {
+		for(int y = 0; y < area.height; y++)
+			std::fill(values + y * stride, values + y * stride + area.width, fallback);
+		for(GridSection *section : resident) {
+			int left = std::max(area.left, section->x);
+			int top = std::max(area.top, section->y);
+			int right = std::min(area.left + area.width, section->x + (int)section->width);
+			int bottom = std::min(area.top + area.height, section->y + (int)section->height);
+			if(left < right && top < bottom)
+				section->tiles->getBlock(IntRect(left - section->x, top - section->y, right - left, bottom - top),
+					values + (left - area.left) + (top - area.top) * stride, stride);
+		}
+	}
+
+	void addSection(GridSection *section) {
+		resident.push_back(section);
+		markChanged(section->getArea());
+	}
+
+	void removeSection(GridSection *section) {
+		resident.erase(std::remove(resident.begin(), resident.end(), section), resident.end());
+		if(last == section)
+			last = NULL;
+		markChanged(section->getArea());
+	}
+
+	void markChanged(IntRect area) {
+		journal.mark(area);
+		notifyChanged();
+	}
+
+	uint getUpdateCount() override {
+		return journal.getUpdateCount();
+	}
+
+	std::vector<IntRect> getChanges(uint since, uint until=(uint)-1) override {
+		return journal.getChanges(since, until, fullRect());
+	}
+
+	Vector2i getSize() override {
+		return size;
+	}
 };
 
 class GridSectioner {
 	std::vector<GridSection *> sections;
 	GridSection *root;
 	json world;
+	Vector2i scale;
 
 	int x = 0;
 	int y = 0;
 
+	//Streaming sections are read on a background thread, then published by stream
+	SectionIndexer *streamed = NULL;
+	float loadRadius = 0;
+	float unloadRadius = 0;
+	std::thread loader;
+	std::mutex loadLock;
+	std::condition_variable loadWake;
+	std::deque<GridSection *> loadQueue;
+	std::vector<GridSection *> loadDone;
+	bool loaderRunning = false;
+
+	void loadSections() {
+		std::unique_lock<std::mutex> lock(loadLock);
+		while(loaderRunning) {
+			if(loadQueue.empty()) {
+				loadWake.wait(lock);
+				continue;
+			}
+			GridSection *section = loadQueue.front();
+			loadQueue.pop_front();
+
+			lock.unlock();
+			GridMaker *tiles = new GridMaker(section->width, section->height);
+			tiles->reload(section->file, section->tileOffset);
+			lock.lock();
+
+			section->tiles = tiles;
+			loadDone.push_back(section);
+		}
+	}
+
+	void queueSection(GridSection *section) {
+		section->state = SECTION_LOADING;
+		std::lock_guard<std::mutex> guard(loadLock);
+		loadQueue.push_back(section);
+		loadWake.notify_one();
+	}
+
+	void unloadSection(GridSection *section) {
+		streamed->removeSection(section);
+		delete section->tiles;
+		section->tiles = NULL;
+		section->state = SECTION_UNLOADED;
+		UpdateList::queueEvent(EVENT_SECTION, false, section->id, section->x, section->y);
+	}
+
 public:
-	GridMaker *grid;
+	GridMaker *grid = NULL;
 	sint width = 0;
 	sint height = 0;
 
-	GridSectioner(std::string file, Layer _layer, Vector2i scale, std::function<GridSection*(GridSection *root, json data, Layer layer)> factory) {
+	//Streaming leaves grid empty, reading only sections near the position passed to stream
+	GridSectioner(std::string file, Layer _layer, Vector2i _scale, std::function<GridSection*(GridSection *root, json data, Layer layer)> factory, bool streaming=false)
+		: scale(_scale) {
 		std::ifstream f(file);
 		world = json::parse(f);
 		root = factory(NULL, world["maps"][0], _layer);
@@ -99,7 +266,10 @@ public:
 		width -= x;
 		height -= y;
 
-		grid = new GridMaker(width, height);
+		if(streaming)
+			streamed = new SectionIndexer(Vector2i(width, height), ' ');
+		else
+			grid = new GridMaker(width, height);
 		for(sint i = 0; i < sections.size(); i++) {
 			next = sections[i];
 			if(next != NULL) {
@@ -109,12 +279,129 @@ public:
 
 				//std::cout << next->file << " " << next->tileOffset << "\n";
 				//std::cout << next->x << "," << next->y << "," << next->width << "," << next->height << "\n";
-				grid->reload(next->file, next->tileOffset, Rect<int>(next->x, next->y, next->width, next->height));
+				if(!streaming)
+					grid->reload(next->file, next->tileOffset, Rect<int>(next->x, next->y, next->width, next->height));
 			}
 		}
 		//grid->printGrid();
 	}
 
+	~GridSectioner() {
+		if(loader.joinable()) {
+			{
+				std::lock_guard<std::mutex> guard(loadLock);
+				loaderRunning = false;
+				loadWake.notify_one();
+			}
+			loader.join();
+		}
+
+		//Streamed tiles belong to the sectioner, including sections loaded but not yet published
+		if(streamed != NULL) {
+			delete streamed;
+			for(GridSection *section : sections) {
+				if(section != NULL && section->tiles != NULL) {
+					delete section->tiles;
+					section->tiles = NULL;
+					section->state = SECTION_UNLOADED;
+				}
+			}
+		}
+	}
+
+	//Tiles of whole world, either fully loaded or streamed
+	Indexer *getIndexer() {
+		if(streamed != NULL)
+			return streamed;
+		return grid;
+	}
+
+	//Distances in tiles, sections are dropped only past the unload radius
+	void setStreamRadius(float load, float unload=-1) {
+		loadRadius = load;
+		unloadRadius = (unload < load) ? load * 1.5 : unload;
+	}
+
+	//Load sections near position in pixels and drop far ones, following neighbor links out from the closest section
+	void stream(Vector2f position) {
+		if(streamed == NULL)
+			return;
+		if(!loader.joinable()) {
+			loaderRunning = true;
+			loader = std::thread(&GridSectioner::loadSections, this);
+		}
+		position = position / scale;
+
+		//Publish finished sections that are still wanted
+		std::vector<GridSection *> done;
+		{
+			std::lock_guard<std::mutex> guard(loadLock);
+			done.swap(loadDone);
+		}
+		for(GridSection *section : done) {
+			if(section->distance(position) > unloadRadius) {
+				delete section->tiles;
+				section->tiles = NULL;
+				section->state = SECTION_UNLOADED;
+				continue;
+			}
+			section->state = SECTION_RESIDENT;
+			streamed->addSection(section);
+			UpdateList::queueEvent(EVENT_SECTION, true, section->id, section->x, section->y);
+		}
+
+		//Closest section to start search from
+		GridSection *start = NULL;
+		float closest = 0;
+		for(GridSection *section : sections) {
+			if(section != NULL && (start == NULL || section->distance(position) < closest)) {
+				start = section;
+				closest = section->distance(position);
+			}
+		}
+
+		//Breadth first through neighbors within unload radius
+		std::vector<bool> visited(sections.size(), false);
+		std::deque<GridSection *> open;
+		if(start != NULL && closest <= unloadRadius) {
+			open.push_back(start);
+			visited[start->id] = true;
+		}
+		while(!open.empty()) {
+			GridSection *section = open.front();
+			open.pop_front();
+			if(section->state == SECTION_UNLOADED && section->distance(position) <= loadRadius)
+				queueSection(section);
+
+			for(sint id : {section->upId, section->rightId, section->downId, section->leftId}) {
+				if(id != 0 && id < sections.size() && !visited[id] && sections[id] != NULL &&
+					sections[id]->distance(position) <= unloadRadius) {
+					visited[id] = true;
+					open.push_back(sections[id]);
+				}
+			}
+		}
+
+		//Drop far sections, including ones still waiting to load
+		{
+			std::lock_guard<std::mutex> guard(loadLock);
+			for(auto it = loadQueue.begin(); it != loadQueue.end();) {
+				if((*it)->distance(position) > unloadRadius) {
+					(*it)->state = SECTION_UNLOADED;
+					it = loadQueue.erase(it);
+				} else
+					++it;
+			}
+		}
+		for(GridSection *section : sections)
+			if(section != NULL && section->state == SECTION_RESIDENT && section->distance(position) > unloadRadius)
+				unloadSection(section);
+	}
+
+	bool isResident(sint id) {
+		return id < sections.size() && sections[id] != NULL && sections[id]->state == SECTION_RESIDENT;
+	}
+
 	void readNeighbors(int i, GridSection *prev) {
 		GridSection *next;
 		x = std::min(x, prev->x);
@@ -123,7 +410,7 @@ public:
 		if(prev->upId != 0 && !prev->hasEdge(UP) && prev->upId < sections.size()) {
 			next = sections[prev->upId];
 			if(next != NULL) {
-				root->addVertex(UP, next, DOWN);
+				root->addVertex(UP, DOWN, next);
 
 				next->x += prev->x;
 				next->y += prev->y - next->height;
@@ -135,7 +422,7 @@ public:
 		if(prev->rightId != 0 && !prev->hasEdge(RIGHT) && prev->rightId < sections.size()) {
 			next = sections[prev->rightId];
 			if(next != NULL) {
-				root->addVertex(RIGHT, next, LEFT);
+				root->addVertex(RIGHT, LEFT, next);
 
 				next->x += prev->x + prev->width;
 				next->y += prev->y;
@@ -147,7 +434,7 @@ public:
 		if(prev->downId != 0 && !prev->hasEdge(DOWN) && prev->downId < sections.size()) {
 			next = sections[prev->downId];
 			if(next != NULL) {
-				root->addVertex(DOWN, next, UP);
+				root->addVertex(DOWN, UP, next);
 
 				next->x += prev->x;
 				next->y += prev->y + prev->height;
@@ -159,7 +446,7 @@ public:
 		if(prev->leftId != 0 && !prev->hasEdge(LEFT) && prev->leftId < sections.size()) {
 			next = sections[prev->leftId];
 			if(next != NULL) {
-				root->addVertex(LEFT, next, RIGHT);
+				root->addVertex(LEFT, RIGHT, next);
 				std::cout << "left " << next->width << "\n";
 
 				next->x += prev->x - next->width;
@@ -0,0 +1,210 @@
+#include "IndexerPyramid.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+static bool contains(const IntRect &outer, const IntRect &inner) {
+	return inner.left >= outer.left && inner.top >= outer.top &&
+		inner.left + inner.width <= outer.left + outer.width &&
+		inner.top + inner.height <= outer.top + outer.height;
+}
+
+IndexerPyramid::IndexerPyramid(Indexer *_source, int _maxLevels) : source(_source), maxLevels(_maxLevels) {
+	resize();
+	sourceListener = source->subscribe([this]() { sourceChanged = true; });
+}
+
+IndexerPyramid::~IndexerPyramid() {
+	source->unsubscribe(sourceListener);
+}
+
+//Rebuild every level for the current source size
+void IndexerPyramid::resize() {
+	size = source->getSize();
+	tiles.assign(size.x * size.y, source->fallback);
+	levels.clear();
+
+	Vector2i levelSize = size;
+	while((levelSize.x > 1 || levelSize.y > 1) && (maxLevels <= 0 || (int)levels.size() < maxLevels)) {
+		levelSize = Vector2i((levelSize.x + 1) / 2, (levelSize.y + 1) / 2);
+		PyramidLevel level;
+		level.size = levelSize;
+		level.min.resize(levelSize.x * levelSize.y);
+		level.max.resize(levelSize.x * levelSize.y);
+		level.mode.resize(levelSize.x * levelSize.y);
+		level.any.resize(levelSize.x * levelSize.y);
+		levels.push_back(std::move(level));
+	}
+
+	sourceUpdates = source->getUpdateCount();
+	updateArea(IntRect(0, 0, size.x, size.y));
+}
+
+//Recalculate cells of a level from the one below
+void IndexerPyramid::reduceArea(int level, IntRect cells) {
+	PyramidLevel &target = levels[level - 1];
+	Vector2i below = getLevelSize(level - 1);
+	for(int y = cells.top; y < cells.top + cells.height; y++) {
+		for(int x = cells.left; x < cells.left + cells.width; x++) {
+			int values[4][3];
+			bool any = false;
+			int count = 0;
+			for(int cy = y * 2; cy < std::min(y * 2 + 2, below.y); cy++) {
+				for(int cx = x * 2; cx < std::min(x * 2 + 2, below.x); cx++) {
+					int i = cx + cy * below.x;
+					if(level == 1) {
+						values[count][0] = values[count][1] = values[count][2] = tiles[i];
+						any = any || tiles[i] != 0;
+					} else {
+						PyramidLevel &child = levels[level - 2];
+						values[count][0] = child.min[i];
+						values[count][1] = child.max[i];
+						values[count][2] = child.mode[i];
+						any = any || child.any[i];
+					}
+					count++;
+				}
+			}
+
+			//Mode of the children's modes, ties going to the first
+			int i = x + y * target.size.x;
+			target.min[i] = values[0][0];
+			target.max[i] = values[0][1];
+			target.mode[i] = values[0][2];
+			target.any[i] = any;
+			int best = 0;
+			for(int a = 0; a < count; a++) {
+				target.min[i] = std::min(target.min[i], values[a][0]);
+				target.max[i] = std::max(target.max[i], values[a][1]);
+				int matches = 0;
+				for(int b = 0; b < count; b++)
+					matches += values[a][2] == values[b][2];
+				if(matches > best) {
+					best = matches;
+					target.mode[i] = values[a][2];
+				}
+			}
+		}
+	}
+}
+
+//Read changed source tiles and carry them up through every level
+void IndexerPyramid::updateArea(IntRect area) {
+	int left = std::max(area.left, 0);
+	int top = std::max(area.top, 0);
+	int right = std::min(area.left + area.width, size.x);
+	int bottom = std::min(area.top + area.height, size.y);
+	if(left >= right || top >= bottom)
+		return;
+
+	source->getBlock(IntRect(left, top, right - left, bottom - top), tiles.data() + left + top * size.x, size.x);
+	for(int level = 1; level <= (int)levels.size(); level++) {
+		left >>= 1;
+		top >>= 1;
+		right = (right + 1) >> 1;
+		bottom = (bottom + 1) >> 1;
+		reduceArea(level, IntRect(left, top, right - left, bottom - top));
+	}
+}
+
+void IndexerPyramid::refresh() {
+	if(!sourceChanged)
+		return;
+
+	std::lock_guard<std::mutex> guard(refreshLock);
+	sourceChanged = false;
+	uint updates = source->getUpdateCount();
+	if(updates != sourceUpdates) {
+		if(source->getSize() != size)
+			resize();
+		else
+			for(IntRect area : source->getChanges(sourceUpdates, updates))
+				updateArea(area);
+		sourceUpdates = updates;
+	}
+}
+
+Vector2i IndexerPyramid::getLevelSize(int level) {
+	if(level == 0)
+		return size;
+	return levels[level - 1].size;
+}
+
+int IndexerPyramid::getCell(int level, int x, int y, int reduce) {
+	if(level < 0 || level > (int)levels.size())
+		throw new std::invalid_argument("Pyramid level out of range");
+	refresh();
+
+	//Cells outside the level match what query returns for an area with no tiles
+	Vector2i cellCount = getLevelSize(level);
+	if(x < 0 || y < 0 || x >= cellCount.x || y >= cellCount.y)
+		return (reduce == PYRAMID_ANY) ? 0 : source->fallback;
+
+	if(level == 0) {
+		int value = tiles[x + y * size.x];
+		return (reduce == PYRAMID_ANY) ? value != 0 : value;
+	}
+
+	PyramidLevel &cells = levels[level - 1];
+	int i = x + y * cells.size.x;
+	switch(reduce) {
+		case PYRAMID_MIN: return cells.min[i];
+		case PYRAMID_MAX: return cells.max[i];
+		case PYRAMID_MODE: return cells.mode[i];
+		case PYRAMID_ANY: return cells.any[i];
+	}
+	throw new std::invalid_argument("Unknown pyramid reduction");
+}
+
+//Use fully covered cells whole, only splitting partly covered cells that could change the result
+void IndexerPyramid::queryCell(int level, int x, int y, const IntRect &area, int reduce, int &result, bool &found) {
+	IntRect cell(x << level, y << level, 1 << level, 1 << level);
+	if(!cell.overlaps(area) || (reduce == PYRAMID_ANY && result))
+		return;
+
+	int value = getCell(level, x, y, reduce);
+	if(level == 0 || contains(area, cell)) {
+		if(!found)
+			result = value;
+		else if(reduce == PYRAMID_MIN)
+			result = std::min(result, value);
+		else if(reduce == PYRAMID_MAX)
+			result = std::max(result, value);
+		else
+			result = result || value;
+		found = true;
+		return;
+	}
+
+	if(found && ((reduce == PYRAMID_MIN && value >= result) || (reduce == PYRAMID_MAX && value <= result)))
+		return;
+	if(reduce == PYRAMID_ANY && !value)
+		return;
+
+	Vector2i below = getLevelSize(level - 1);
+	for(int cy = y * 2; cy < std::min(y * 2 + 2, below.y); cy++)
+		for(int cx = x * 2; cx < std::min(x * 2 + 2, below.x); cx++)
+			queryCell(level - 1, cx, cy, area, reduce, result, found);
+}
+
+int IndexerPyramid::query(IntRect area, int reduce) {
+	if(reduce == PYRAMID_MODE)
+		throw new std::invalid_argument("Pyramid mode is only kept per cell");
+	refresh();
+
+	int result = (reduce == PYRAMID_ANY) ? 0 : source->fallback;
+	bool found = false;
+	int top = levels.size();
+	Vector2i cells = getLevelSize(top);
+	for(int y = 0; y < cells.y; y++)
+		for(int x = 0; x < cells.x; x++)
+			queryCell(top, x, y, area, reduce, result, found);
+	return result;
+}
+
+Indexer *IndexerPyramid::getIndexer(int level, int reduce) {
+	if(level < 0 || level > (int)levels.size())
+		throw new std::invalid_argument("Pyramid level out of range");
+	views.emplace_back(new PyramidIndexer(this, level, reduce));
+	return views.back().get();
+}
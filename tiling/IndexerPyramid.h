@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "GridMaker.h"
+
+/*
+ * Coarse copies of an indexer at power of two scales, for minimaps and area queries
+ */
+
+enum PyramidReduce {
+	PYRAMID_MIN,
+	PYRAMID_MAX,
+	PYRAMID_MODE,
+	PYRAMID_ANY
+};
+
+//Each cell reduces a 2x2 block of the level below
+struct PyramidLevel {
+	Vector2i size;
+	std::vector<int> min;
+	std::vector<int> max;
+	std::vector<int> mode;
+	std::vector<uint8_t> any;
+};
+
+class IndexerPyramid {
+private:
+	Indexer *source;
+	int maxLevels;
+	int sourceListener = -1;
+
+	//Level 0 is the source itself, stored only as tiles
+	Vector2i size;
+	std::vector<int> tiles;
+	std::vector<PyramidLevel> levels;
+	std::vector<std::unique_ptr<Indexer>> views;
+
+	uint sourceUpdates = 0;
+	std::atomic<bool> sourceChanged = false;
+	std::mutex refreshLock;
+
+	void resize();
+	void reduceArea(int level, IntRect cells);
+	void updateArea(IntRect area);
+	void queryCell(int level, int x, int y, const IntRect &area, int reduce, int &result, bool &found);
+
+public:
+	//Levels of 0 keeps halving until one cell covers the whole grid
+	IndexerPyramid(Indexer *_source, int _maxLevels=0);
+	~IndexerPyramid();
+
+	//Apply source changes, called automatically by reads
+	void refresh();
+
+	int getLevelCount() {
+		return levels.size() + 1;
+	}
+	Vector2i getLevelSize(int level);
+
+	//Cells outside the level give the source fallback, or 0 for PYRAMID_ANY
+	int getCell(int level, int x, int y, int reduce);
+
+	//Exact min, max or any nonzero over source tiles in area
+	int query(IntRect area, int reduce);
+	int getMin(IntRect area) {
+		return query(area, PYRAMID_MIN);
+	}
+	int getMax(IntRect area) {
+		return query(area, PYRAMID_MAX);
+	}
+	bool getAny(IntRect area) {
+		return query(area, PYRAMID_ANY);
+	}
+
+	//Level as a scaled indexer, owned by the pyramid
+	Indexer *getIndexer(int level, int reduce);
+
+	Indexer *getSource() {
+		return source;
+	}
+};
+
+//Reads one reduction of a pyramid level, scaled up to cover the source
+class PyramidIndexer : public Indexer {
+private:
+	IndexerPyramid *pyramid;
+	int level;
+	int reduce;
+
+public:
+	PyramidIndexer(IndexerPyramid *_pyramid, int _level, int _reduce)
+		: Indexer(_pyramid->getSource(), _pyramid->getSource()->fallback, Vector2i(1 << _level, 1 << _level)),
+		pyramid(_pyramid), level(_level), reduce(_reduce) {
+
+	}
+
+	int getTileI(int x, int y) override {
+		if(inBounds(x, y))
+			return pyramid->getCell(level, x, y, reduce);
+		return fallback;
+	}
+
+	void setTileI(int x, int y, int value) override {
+
+	}
+
+	//Source changes cover every cell they touch
+	std::vector<IntRect> getChanges(uint since, uint until=(uint)-1) override {
+		std::vector<IntRect> changes = Indexer::getChanges(since, until);
+		for(IntRect &area : changes) {
+			int right = (area.left + area.width + (1 << level) - 1) >> level;
+			int bottom = (area.top + area.height + (1 << level) - 1) >> level;
+			area.left >>= level;
+			area.top >>= level;
+			area.width = right - area.left;
+			area.height = bottom - area.top;
+		}
+		return changes;
+	}
+
+	Vector2i getSize() override {
+		return pyramid->getLevelSize(level);
+	}
+};
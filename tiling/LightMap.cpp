@@ -1,119 +1,8 @@
 #include "LightMap.h"
 
-#include <algorithm>
-
-//Based on http://journal.stuffwithstuff.com/2015/09/07/what-the-hero-sees/
-class Shadow {
-public:
-	float start;
-	float end;
-	int strength = 0;
-	int distance;
-
-	Shadow(float _start, float _end, int _distance) {
-		start = _start;
-		end = _end;
-		distance = _distance;
-	}
-
-	/// Returns `true` if [other] is completely covered by this shadow.
-	bool covers(Shadow other) {
-		return start <= other.start && end >= other.end;
-	}
-
-	/// Returns `true` if [other] is partially covered by this shadow.
-	bool contains(Shadow other) {
-		return start <= other.end && end >= other.start;
-	}
-
-	bool contains(Shadow other, bool full) {
-		return full ? covers(other) : contains(other);
-	}
-};
-
-class ShadowLine {
-private:
-	std::vector<Shadow> shadows;
-
-public:
-
-	float visibility(Shadow projection, bool full) {
-		int strength = 0;
-		for(Shadow shadow : shadows)
-			if(strength < 100 && shadow.contains(projection, full))
-				strength += shadow.strength;
-
-		return (100 - std::min(strength, 100)) / 100.0;
-	}
-
-	bool isFullShadow() {
-		if(shadows.size() == 1)
-			return shadows[0].start == 0 &&
-			shadows[0].end == 1 && shadows[0].strength == 100;
-
-		float pos = 0;
-		for(Shadow shadow : shadows)
-			if(shadow.strength == 100 && shadow.start <= pos)
-				pos = shadow.end;
-		return pos >= 1;
-	}
-
-	void add(Shadow shadow) {
-		// Figure out where to slot the new shadow in the list.
-		long unsigned int index = 0;
-		while(index < shadows.size()) {
-			// Stop when we hit the insertion point.
-			if(shadows[index].start >= shadow.start) 
-				break;
-			index++;
-		}
-
-		// The new shadow is going here. See if it overlaps the
-		// previous or next.
-		int strength = shadow.strength;
-		Shadow *overlappingPrevious = NULL;
-		if(index > 0 && shadows[index - 1].end >= shadow.start && shadows[index - 1].strength == strength)
-			overlappingPrevious = &(shadows[index - 1]);
-
-		Shadow *overlappingNext = NULL;
-		if(index < shadows.size() && shadows[index].start <= shadow.end && shadows[index].strength == strength)
-			overlappingNext = &(shadows[index]);
-
-		// Insert and unify with overlapping shadows.
-		if(overlappingNext != NULL) {
-			if(overlappingPrevious != NULL) {
-				// Overlaps both, so unify one and delete the other.
-				overlappingPrevious->end = overlappingNext->end;
-				shadows.erase(shadows.begin() + index);
-			} else {
-				// Overlaps the next one, so unify it with that.
-				overlappingNext->start = shadow.start;
-			}
-		} else {
-			if(overlappingPrevious != NULL) {
-				// Overlaps the previous one, so unify it with that.
-				overlappingPrevious->end = shadow.end;
-			} else {
-				// Does not overlap anything, so insert.
-				shadows.insert(shadows.begin() + index, shadow);
-			}
-		}
-	}
+#include "../util/Parallel.hpp"
 
-	void darkenPartialShadows(float absorb) {
-		for(Shadow shadow : shadows)
-			if(shadow.strength < 100)
-				shadow.strength += absorb * 100;
-	}
-};
-
-// Creates a [Shadow] that corresponds to the projected
-// silhouette of the tile at [row], [col].
-Shadow projectTile(float row, float col) {
-	float topLeft = col / (row + 2);
-	float bottomRight = (col + 1) / (row + 1);
-	return Shadow(topLeft, bottomRight, col);
-}
+#include <algorithm>
 
 skColor LightMap::applyIntensity(unsigned int x, unsigned int y) {
 	float intensity = ambientIntensity;
@@ -142,72 +31,55 @@ Vector2f LightMap::getTilePos(unsigned int x, unsigned int y) {
 	return pos;
 }
 
-Vector2f LightMap::transformOctant(int row, int col, int octant) {
-	switch(octant) {
-		case 0: return Vector2f( col, -row);
-		case 1: return Vector2f( row, -col);
-		case 2: return Vector2f( row,  col);
-		case 3: return Vector2f( col,  row);
-		case 4: return Vector2f(-col,  row);
-		case 5: return Vector2f(-row,  col);
-		case 6: return Vector2f(-row, -col);
-		case 7: return Vector2f(-col, -row);
-	}
-	return Vector2f(0, 0);
-}
-
-void LightMap::lightOctant(Vector2f light, int octant, float maxIntensity) {
-	ShadowLine line;
-	int row = 1;
-
-	while(true) {
-		// Stop once we go out of bounds.
-		Vector2f pos = light + transformOctant(row, 0, octant);
-		if(!indexes->inBounds(pos) || maxIntensity < ambientIntensity)
-			break;
-
-		float intensity = maxIntensity;
-
-		for(int col = 0; col <= row; col++) {
-			pos = light + transformOctant(row, col, octant);
+//Cast light into one octant, only writing tiles inside footprint
+void LightMap::lightOctant(Vector2f light, int octant, float maxIntensity, ShadowLine &line, const LightOcclusion &occlusion, LightFootprint &footprint) {
+	IntRect clip = footprint.area;
+	float intensity = maxIntensity;
+
+	FieldOfView::castOctant(line, octant, sourceReach(maxIntensity), [&](int row, int col, Vector2i offset, Shadow projection) {
+		//Each row starts dimmer than the last
+		if(col == 0) {
+			if(row > 1)
+				maxIntensity -= absorb;
+			intensity = maxIntensity;
+		}
 
-			// If we've traversed out of bounds, bail on this row.
-			if(!indexes->inBounds(pos) || intensity < ambientIntensity)
-				break;
+		// If we've traversed out of bounds, bail on this row.
+		Vector2f pos = light + Vector2f(offset.x, offset.y);
+		if(!occlusion.inBounds(pos) || intensity < ambientIntensity)
+			return false;
 
-			Shadow projection = projectTile(row, col);
+		// Set the visibility of this tile.
+		float visible = line.visibility(projection, false);
+		float tileIntensity = std::max(visible * intensity, ambientIntensity);
+		int tileValue = occlusion.getTile(pos);
 
-			// Set the visibility of this tile.
-			float visible = line.visibility(projection, false);
-			float tileIntensity = std::max(visible * intensity, ambientIntensity);
+		if(pos.x >= clip.left && pos.x < clip.left + clip.width &&
+			pos.y >= clip.top && pos.y < clip.top + clip.height) {
 
-			if(tileIntensity > tiles[(int)pos.x][(int)pos.y])
-				tiles[(int)pos.x][(int)pos.y] = tileIntensity;
+			float &level = footprint.levels[((int)pos.x - clip.left) + ((int)pos.y - clip.top) * clip.width];
+			if(tileIntensity > level)
+				level = tileIntensity;
 
 			// Remove shadows on top of lights
-			int tileValue = indexes->getTile(pos);
-			if(tileValue / 100.0 > tiles[(int)pos.x][(int)pos.y])
-				tiles[(int)pos.x][(int)pos.y] = tileValue / 100.0;
-
-			// Add any opaque tiles to the shadow map.
-			if(visible > 0 && tileValue < 0) {
-				tileValue /= std::sqrt(indexes->getScale().x);
-				projection.strength = line.visibility(projection, true)-tileValue;
-				line.add(projection);
-				if(line.isFullShadow())
-					return;
-			}
-			intensity -= absorb;
+			if(tileValue / 100.0 > level)
+				level = tileValue / 100.0;
 		}
-		++row;
-		maxIntensity -= absorb;
-		line.darkenPartialShadows(absorb);
-	}
+
+		// Add any opaque tiles to the shadow map.
+		if(visible > 0 && tileValue < 0) {
+			tileValue /= occlusion.scale;
+			projection.strength = line.visibility(projection, true)-tileValue;
+			line.add(projection);
+		}
+		intensity -= absorb;
+		return true;
+	});
 }
 
 LightMap::LightMap(int _tileX, int _tileY, float _ambient, float _absorb, Indexer *_indexes,
 		int layer, bool indexLights, skColor _lightColor)
-		: Node(layer, RENDER_GRADIENT_ARRAY) {
+		: Node(layer, RENDER_PIXEL_BUFFER) {
 
 	//Set arguments
 	indexes = _indexes;
@@ -224,12 +96,10 @@ LightMap::LightMap(int _tileX, int _tileY, float _ambient, float _absorb, Indexe
 	setSize(Vector2i(tileX * width, tileY * height));
 	setOrigin(_tileX / 2, _tileY / 2);
 
-	setBlendMode(SK_BLEND_ADD);
-    getRenderComponent()->getColors()->resize(width * height);
-    getRenderComponent()->setSize(width);
-	//setTexture(lightTexture);
-    setupBuffer(0, applyIntensity(ambientIntensity));
-    getRenderComponent(false)->setBlendMode(SK_BLEND_MULT);
+	//Filtered image gives smooth light between tiles
+	getRenderComponent()->setImageSize(Vector2i(width, height));
+	getRenderComponent()->setFilter(SK_FILTER_LINEAR);
+	setBlendMode(SK_BLEND_MULT);
 
 	//Build array
 	tiles = new float*[width];
@@ -248,59 +118,321 @@ LightMap::LightMap(int _tileX, int _tileY, float _ambient, float _absorb, Indexe
 		}
 	}
 
+	gridListener = indexes->subscribe([this]() { gridChanged = true; });
 	reload();
 }
 
 void LightMap::reload() {
-	//Clear existing lights
-	for(unsigned int x = 0; x < width; ++x)
-		for(unsigned int y = 0; y < height; ++y)
-			tiles[x][y] = ambientIntensity;
+	for(LightFootprint &footprint : sourceFootprint)
+		footprint.dirty = true;
+	relightSources({IntRect(0, 0, width, height)});
+}
+
+//Relight area, recasting only sources that can reach it
+void LightMap::reload(IntRect area) {
+	if(job != NULL)
+		finishJob();
+	for(LightFootprint &footprint : sourceFootprint)
+		if(footprint.area.overlaps(area))
+			footprint.dirty = true;
+	relightSources({area});
+}
 
-	//Propogate Sources
-	for(long unsigned int i = 0; i < sourcePosition.size(); i++) {
-		Vector2f light = sourcePosition[i];
-		if(indexes->inBounds(light))
-			tiles[(int)light.x][(int)light.y] = sourceIntensity[i];
+//Tiles a source at position can reach
+IntRect LightMap::sourceArea(Vector2f light, float intensity) {
+	if(intensity <= 0)
+		return IntRect();
+
+	int reach = sourceReach(intensity);
+	int startX = std::max((int)std::floor(light.x) - reach, 0);
+	int startY = std::max((int)std::floor(light.y) - reach, 0);
+	int endX = std::min((int)std::floor(light.x) + reach + 1, (int)width);
+	int endY = std::min((int)std::floor(light.y) + reach + 1, (int)height);
+	if(startX >= endX || startY >= endY)
+		return IntRect();
+	return IntRect(startX, startY, endX - startX, endY - startY);
+}
 
-		for(int octant = 0; octant < 8; octant++)
-			lightOctant(light, octant, sourceIntensity[i]);
+//Copy grid tiles under area, reading each grid tile once
+void LightMap::snapshotOcclusion(IntRect area, LightOcclusion &occlusion) {
+	Vector2i scale = indexes->getScale();
+	occlusion.area = area;
+	occlusion.bounds = Vector2i(indexes->getSize().x * scale.x, indexes->getSize().y * scale.y);
+	occlusion.scale = std::sqrt(scale.x);
+	occlusion.values.resize(area.width * area.height);
+	if(area.width <= 0 || area.height <= 0)
+		return;
+
+	IntRect grid(area.left / scale.x, area.top / scale.y, 0, 0);
+	grid.width = (area.left + area.width - 1) / scale.x + 1 - grid.left;
+	grid.height = (area.top + area.height - 1) / scale.y + 1 - grid.top;
+	std::vector<int> values(grid.width * grid.height);
+	indexes->getBlock(grid, values.data(), grid.width);
+
+	for(int y = 0; y < area.height; y++) {
+		const int *row = values.data() + ((area.top + y) / scale.y - grid.top) * grid.width;
+		for(int x = 0; x < area.width; x++)
+			occlusion.values[x + y * area.width] = row[(area.left + x) / scale.x - grid.left];
 	}
+}
 
-	//Draw lighting
-	for(unsigned int x = 0; x < width; ++x)
-		for(unsigned int y = 0; y < height; ++y) {
-			int iy = y;
-			if(singular)
-				iy = height - y - 1;
-			getRenderComponent()->setColor(applyIntensity(x-1, iy-1), x + y * width);
+//Cast one light into a footprint, touching nothing else so it can run on any thread
+void LightMap::castLight(Vector2f light, float intensity, const LightOcclusion &occlusion, LightFootprint &footprint) {
+	footprint.area = occlusion.area;
+	footprint.levels.assign(footprint.area.width * footprint.area.height, 0);
+	if(footprint.levels.empty())
+		return;
+
+	IntRect area = footprint.area;
+	if(occlusion.inBounds(light) && light.x >= area.left && light.x < area.left + area.width &&
+		light.y >= area.top && light.y < area.top + area.height)
+		footprint.levels[((int)light.x - area.left) + ((int)light.y - area.top) * area.width] = intensity;
+
+	ShadowLine line(sourceReach(intensity) + 2);
+	for(int octant = 0; octant < 8; octant++)
+		lightOctant(light, octant, intensity, line, occlusion, footprint);
+}
+
+void LightMap::castSource(int i) {
+	LightOcclusion occlusion;
+	snapshotOcclusion(sourceArea(sourcePosition[i], sourceIntensity[i]), occlusion);
+	castLight(sourcePosition[i], sourceIntensity[i], occlusion, sourceFootprint[i]);
+	sourceFootprint[i].dirty = false;
+}
+
+//Brightest of ambient and every source footprint over area
+void LightMap::combineSources(IntRect area) {
+	for(int x = area.left; x < area.left + area.width; ++x)
+		std::fill(tiles[x] + area.top, tiles[x] + area.top + area.height, ambientIntensity);
+
+	for(LightFootprint &footprint : sourceFootprint) {
+		IntRect source = footprint.area;
+		if(!source.overlaps(area))
+			continue;
+
+		int startX = std::max(area.left, source.left);
+		int startY = std::max(area.top, source.top);
+		int endX = std::min(area.left + area.width, source.left + source.width);
+		int endY = std::min(area.top + area.height, source.top + source.height);
+		for(int x = startX; x < endX; ++x) {
+			const float *levels = footprint.levels.data() + (x - source.left);
+			for(int y = startY; y < endY; ++y)
+				tiles[x][y] = std::max(tiles[x][y], levels[(y - source.top) * source.width]);
 		}
+	}
+}
+
+//Recast changed sources, then recombine only where their light was or now is
+void LightMap::relightSources(std::vector<IntRect> areas) {
+	if(job != NULL)
+		finishJob();
+
+	for(long unsigned int i = 0; i < sourceFootprint.size(); i++) {
+		if(!sourceFootprint[i].dirty)
+			continue;
+		areas.push_back(sourceFootprint[i].area);
+		castSource(i);
+		areas.push_back(sourceFootprint[i].area);
+	}
+	sourcesChanged = false;
+	redrawAreas(areas);
+	gridUpdates = indexes->getUpdateCount();
+}
+
+void LightMap::redrawAreas(std::vector<IntRect> areas) {
+	//Merge overlapping areas so no tile is combined twice
+	std::vector<IntRect> merged;
+	for(IntRect area : areas) {
+		int startX = std::max(area.left, 0);
+		int startY = std::max(area.top, 0);
+		int endX = std::min(area.left + area.width, (int)width);
+		int endY = std::min(area.top + area.height, (int)height);
+		if(startX >= endX || startY >= endY)
+			continue;
+		area = IntRect(startX, startY, endX - startX, endY - startY);
+
+		for(long unsigned int j = 0; j < merged.size(); j++) {
+			if(!merged[j].overlaps(area))
+				continue;
+			int right = std::max(area.left + area.width, merged[j].left + merged[j].width);
+			int bottom = std::max(area.top + area.height, merged[j].top + merged[j].height);
+			area.left = std::min(area.left, merged[j].left);
+			area.top = std::min(area.top, merged[j].top);
+			area.width = right - area.left;
+			area.height = bottom - area.top;
+			merged.erase(merged.begin() + j);
+			j = -1;
+		}
+		merged.push_back(area);
+	}
+
+	for(IntRect area : merged) {
+		combineSources(area);
+		drawColors(area);
+	}
+}
+
+//Start casting changed sources on another thread, from a copy of their grid tiles
+void LightMap::startJob() {
+	job = new LightJob();
+	for(long unsigned int i = 0; i < sourceFootprint.size(); i++) {
+		if(!sourceFootprint[i].dirty)
+			continue;
+		job->sources.push_back(i);
+		job->positions.push_back(sourcePosition[i]);
+		job->intensities.push_back(sourceIntensity[i]);
+		sourceFootprint[i].dirty = false;
+	}
+	sourcesChanged = false;
+
+	int count = job->sources.size();
+	job->occlusion.resize(count);
+	job->results.resize(count);
+	for(int k = 0; k < count; k++)
+		snapshotOcclusion(sourceArea(job->positions[k], job->intensities[k]), job->occlusion[k]);
+
+	LightJob *current = job;
+	current->start = std::chrono::steady_clock::now();
+	current->thread = std::thread([this, current, count]() {
+		parallelRange(count, asyncThreads, [this, current](int start, int end) {
+			for(int k = start; k < end; k++)
+				castLight(current->positions[k], current->intensities[k], current->occlusion[k], current->results[k]);
+		});
+		current->done = true;
+	});
+}
+
+//Wait for job, then swap its footprints in and redraw where they changed
+void LightMap::finishJob() {
+	job->thread.join();
+
+	std::vector<IntRect> areas;
+	for(long unsigned int k = 0; k < job->sources.size(); k++) {
+		LightFootprint &footprint = sourceFootprint[job->sources[k]];
+		areas.push_back(footprint.area);
+		footprint.area = job->results[k].area;
+		footprint.levels.swap(job->results[k].levels);
+		areas.push_back(footprint.area);
+	}
+	redrawAreas(areas);
+
+	double latency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - job->start).count();
+	stats.lastLatency = latency;
+	stats.maxLatency = std::max(stats.maxLatency, latency);
+	stats.averageLatency = (stats.averageLatency * stats.jobs + latency) / (stats.jobs + 1);
+	stats.jobs++;
+
+	delete job;
+	job = NULL;
+}
+
+void LightMap::setAsync(bool _async, int threads) {
+	if(!_async && job != NULL)
+		finishJob();
+	async = _async;
+	asyncThreads = threads;
+}
+
+//Furthest distance in tiles a source can brighten
+int LightMap::sourceReach(float intensity) {
+	if(absorb <= 0)
+		return std::max(width, height);
+	return std::ceil((intensity - ambientIntensity) / absorb) + 2;
+}
+
+//Copy light levels in area to colors
+void LightMap::drawColors(IntRect area) {
+	//Colors are offset by one tile from light levels, with an ambient border
+	int startX = (area.left <= 0) ? 0 : area.left + 1;
+	int endX = std::min(area.left + area.width + 1, (int)width);
+	for(int ty = (area.top <= 0) ? -1 : area.top; ty < area.top + area.height; ++ty) {
+		//Rows are flipped when drawn through the collection buffer
+		unsigned int y = ty + 1;
+		if(!singular)
+			y = height - y - 1;
+		if(y >= height)
+			continue;
+
+		for(int x = startX; x < endX; ++x)
+			getRenderComponent()->setColor(applyIntensity(x-1, ty), x + y * width);
+	}
 
-	scheduleBufferRefresh();
 	if(collection != NULL)
 		collection->scheduleBufferRefresh();
 }
 
+//Recast sources moved or with changed tiles in reach
+void LightMap::update(double time) {
+	//Latest finished job is shown before starting the next
+	if(job != NULL && job->done)
+		finishJob();
+	if(!gridChanged && !sourcesChanged)
+		return;
+
+	uint updates = indexes->getUpdateCount();
+	if(gridChanged && updates != gridUpdates) {
+		Vector2i scale = indexes->getScale();
+		std::vector<IntRect> changes = indexes->getChanges(gridUpdates, updates);
+		for(IntRect area : changes) {
+			area = IntRect(area.left * scale.x, area.top * scale.y, area.width * scale.x, area.height * scale.y);
+			for(LightFootprint &footprint : sourceFootprint)
+				if(footprint.area.overlaps(area))
+					footprint.dirty = sourcesChanged = true;
+
+			//Sources being cast used the tiles from before this change
+			if(job != NULL)
+				for(long unsigned int k = 0; k < job->sources.size(); k++)
+					if(job->occlusion[k].area.overlaps(area))
+						sourceFootprint[job->sources[k]].dirty = sourcesChanged = true;
+		}
+	}
+	gridChanged = false;
+	gridUpdates = updates;
+
+	if(!async)
+		relightSources({});
+	else if(job == NULL && sourcesChanged)
+		startJob();
+}
+
 int LightMap::addSource(Vector2f light, float intensity) {
 	light = light / tileSize;
 	int lastIndex = nextIndex;
 	if(nextIndex < sourcePosition.size()) {
 		sourcePosition[nextIndex] = light;
 		sourceIntensity[nextIndex] = intensity;
+		sourceFootprint[nextIndex].dirty = true;
 		while(nextIndex < sourcePosition.size() && sourceIntensity[nextIndex] > 0)
 			++nextIndex;
 	} else {
 		sourcePosition.push_back(light);
 		sourceIntensity.push_back(intensity);
+		sourceFootprint.emplace_back();
 		nextIndex = sourcePosition.size();
 	}
+	sourcesChanged = true;
 	return lastIndex;
 }
 
+//Changes replacing one not yet cast are counted as dropped
+void LightMap::markSource(int i) {
+	if(async && sourceFootprint[i].dirty)
+		stats.dropped++;
+	sourceFootprint[i].dirty = true;
+	sourcesChanged = true;
+}
+
 void LightMap::moveSource(int i, Vector2f light) {
 	sourcePosition[i] = light / tileSize;
+	markSource(i);
+}
+
+void LightMap::setSourceIntensity(int i, float intensity) {
+	sourceIntensity[i] = intensity;
+	markSource(i);
 }
 
 void LightMap::deleteSource(int i) {
 	sourceIntensity[i] = 0;
-}
\ No newline at end of file
+	markSource(i);
+}
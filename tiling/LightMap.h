@@ -1,14 +1,27 @@
 #pragma once
 
 #include "GridMaker.h"
+#include "FieldOfView.h"
 #include "../core/Node.h"
 
+#include <atomic>
+#include <chrono>
+#include <thread>
 #include <vector>
 
 /*
  * Generate and show a lightmap based on a grid
  */
 
+//Background relight timing, in milliseconds from snapshot to swap
+struct LightMapStats {
+	uint jobs = 0;
+	uint dropped = 0;
+	double lastLatency = 0;
+	double averageLatency = 0;
+	double maxLatency = 0;
+};
+
 class LightMap : public Node {
 private:
 	const Vector2f offset = Vector2f(-1,-1);
@@ -26,12 +39,60 @@ private:
 	//Tile mapping
 	float **tiles;
 	Indexer *indexes;
+	uint gridUpdates = 0;
+	bool gridChanged = false;
+	int gridListener = -1;
 
 	//Light sources
 	std::vector<Vector2f> sourcePosition;
 	std::vector<float> sourceIntensity;
 	unsigned int nextIndex = 0;
 
+	//Light each source last cast, so sources can be recast alone
+	struct LightFootprint {
+		IntRect area;
+		std::vector<float> levels;
+		bool dirty = true;
+	};
+	std::vector<LightFootprint> sourceFootprint;
+	bool sourcesChanged = false;
+
+	//Grid tiles read while casting, copied so casting can leave the main thread
+	struct LightOcclusion {
+		IntRect area;
+		Vector2i bounds;
+		double scale = 1;
+		std::vector<int> values;
+
+		bool inBounds(Vector2f pos) const {
+			return pos.x >= 0 && pos.x < bounds.x && pos.y >= 0 && pos.y < bounds.y;
+		}
+
+		int getTile(Vector2f pos) const {
+			int x = (int)pos.x - area.left;
+			int y = (int)pos.y - area.top;
+			if(x < 0 || y < 0 || x >= area.width || y >= area.height)
+				return 0;
+			return values[x + y * area.width];
+		}
+	};
+
+	//Sources cast in the background, swapped in once all are done
+	struct LightJob {
+		std::vector<int> sources;
+		std::vector<Vector2f> positions;
+		std::vector<float> intensities;
+		std::vector<LightOcclusion> occlusion;
+		std::vector<LightFootprint> results;
+		std::chrono::steady_clock::time_point start;
+		std::atomic<bool> done = false;
+		std::thread thread;
+	};
+	LightJob *job = NULL;
+	bool async = false;
+	int asyncThreads = 1;
+	LightMapStats stats;
+
 	//Graphical storage
 	bool singular = true;
 	Node *collection = NULL;
@@ -39,30 +100,63 @@ private:
 	skColor applyIntensity(unsigned int x, unsigned int y);
 	skColor applyIntensity(float intensity);
 	Vector2f getTilePos(unsigned int x, unsigned int y);
-	Vector2f transformOctant(int row, int col, int octant);
-	void lightOctant(Vector2f light, int octant, float maxIntensity);
+	void lightOctant(Vector2f light, int octant, float maxIntensity, ShadowLine &line, const LightOcclusion &occlusion, LightFootprint &footprint);
+	int sourceReach(float intensity);
+	IntRect sourceArea(Vector2f light, float intensity);
+	void snapshotOcclusion(IntRect area, LightOcclusion &occlusion);
+	void castLight(Vector2f light, float intensity, const LightOcclusion &occlusion, LightFootprint &footprint);
+	void castSource(int i);
+	void markSource(int i);
+	void combineSources(IntRect area);
+	void relightSources(std::vector<IntRect> areas);
+	void redrawAreas(std::vector<IntRect> areas);
+	void startJob();
+	void finishJob();
+	void drawColors(IntRect area);
 
 public:
 	LightMap(int _tileX, int _tileY, float _ambient, float _absorb, Indexer *_indexes,
 		int layer, bool indexLights=true, skColor _lightColor=COLOR_WHITE);
 
 	~LightMap() {
-		for(unsigned int y = 0; y < height; y++)
-			delete[] tiles[y];
+		if(job != NULL) {
+			job->thread.join();
+			delete job;
+		}
+		indexes->unsubscribe(gridListener);
+		for(unsigned int x = 0; x < width; x++)
+			delete[] tiles[x];
 		delete[] tiles;
 	}
 
 	void reload();
+	void reload(IntRect area);
+	void update(double time);
 
-	//Moving lights
+	//Moving lights, relit on next update
 	int addSource(Vector2f light, float intensity);
 	void moveSource(int i, Vector2f light);
+	void setSourceIntensity(int i, float intensity);
 	void deleteSource(int i);
 
+	//Relight on worker threads, showing old light until a full job is done
+	void setAsync(bool _async, int threads=1);
+	bool isAsync() {
+		return async;
+	}
+
+	LightMapStats getStats() {
+		return stats;
+	}
+
+	void resetStats() {
+		stats = LightMapStats();
+	}
+
 	void markCollection(Node *node) {
 		singular = false;
 		collection = node;
-		getRenderComponent(false)->setBlendMode(SK_BLEND_MAX);
+		setBlendMode(SK_BLEND_MAX);
 		setOrigin(0, 0);
 		//setHidden(true);
 		reload();
@@ -73,6 +167,8 @@ public:
 class LightMapCollection : public Node {
 private:
 	std::vector<LightMap*> lightmaps;
+	bool async = false;
+	int asyncThreads = 1;
 
 public:
 	LightMapCollection(int tileX, int tileY, Indexer *indexes, int layer, int lightLayer) : Node(layer, RENDER_TEXTURE_SINGLE) {
@@ -90,10 +186,34 @@ public:
 
 	void addLightMap(LightMap *map) {
 		map->markCollection(this);
+		if(async)
+			map->setAsync(async, asyncThreads);
 		lightmaps.push_back(map);
 		reload();
 	}
 
+	void setAsync(bool _async, int threads=1) {
+		async = _async;
+		asyncThreads = threads;
+		for(LightMap *map : lightmaps)
+			map->setAsync(async, asyncThreads);
+	}
+
+	//Combined stats of every lightmap
+	LightMapStats getStats() {
+		LightMapStats total;
+		for(LightMap *map : lightmaps) {
+			LightMapStats stats = map->getStats();
+			if(total.jobs + stats.jobs > 0)
+				total.averageLatency = (total.averageLatency * total.jobs + stats.averageLatency * stats.jobs) / (total.jobs + stats.jobs);
+			total.jobs += stats.jobs;
+			total.dropped += stats.dropped;
+			total.maxLatency = std::max(total.maxLatency, stats.maxLatency);
+			total.lastLatency = std::max(total.lastLatency, stats.lastLatency);
+		}
+		return total;
+	}
+
 	void reload() {
 		scheduleBufferRefresh();
 		//UpdateList::scheduleBufferRefresh(getTexture());
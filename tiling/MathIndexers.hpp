@@ -6,6 +6,7 @@
 //Constant value indexer
 class ConstIndexer : public Indexer {
 	Vector2i size;
+	uint constUpdateCount = 0;
 
 public:
 	ConstIndexer(int fallback, int width, int height, int scaleX=1, int scaleY=1)
@@ -20,6 +21,8 @@ public:
 
 	void setConst(int value) {
 		fallback = value;
+		constUpdateCount = nextVersion();
+		notifyChanged();
 	}
 
 	//Get tile value
@@ -33,7 +36,14 @@ public:
 	}
 
 	uint getUpdateCount() override {
-		return 0;
+		return constUpdateCount;
+	}
+
+	std::vector<IntRect> getChanges(uint since, uint until=(uint)-1) override {
+		std::vector<IntRect> changes;
+		if(constUpdateCount > since)
+			changes.push_back(fullRect());
+		return changes;
 	}
 
 	//Return actual size
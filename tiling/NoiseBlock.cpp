@@ -0,0 +1,572 @@
+#include "NoiseBlock.h"
+#include "NoiseIndexer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NOISE_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * Perlin and Value kernels follow FastNoiseLite operation for operation,
+ * so every path gives bitwise the same floats as the scalar library.
+ * Fractal weighted strength is assumed 0, as NoiseIndexer never sets it.
+ */
+
+#define NOISE_PRIME_X 501125321
+#define NOISE_PRIME_Y 1136930381
+#define NOISE_HASH 0x27d4eb2d
+#define NOISE_PERLIN_SCALE 1.4247691104677813f
+#define NOISE_VALUE_SCALE (1 / 2147483648.0f)
+#define RANDOM_GOLDEN 0x9E3779B9u
+
+//FastNoiseLite Gradients2D, rebuilt from its 24 repeated directions and 8 extras
+static const float GRADIENT_DIRECTIONS[32][2] = {
+	{0.130526192220052f, 0.99144486137381f}, {0.38268343236509f, 0.923879532511287f},
+	{0.608761429008721f, 0.793353340291235f}, {0.793353340291235f, 0.608761429008721f},
+	{0.923879532511287f, 0.38268343236509f}, {0.99144486137381f, 0.130526192220051f},
+	{0.99144486137381f, -0.130526192220051f}, {0.923879532511287f, -0.38268343236509f},
+	{0.793353340291235f, -0.60876142900872f}, {0.608761429008721f, -0.793353340291235f},
+	{0.38268343236509f, -0.923879532511287f}, {0.130526192220052f, -0.99144486137381f},
+	{-0.130526192220052f, -0.99144486137381f}, {-0.38268343236509f, -0.923879532511287f},
+	{-0.608761429008721f, -0.793353340291235f}, {-0.793353340291235f, -0.608761429008721f},
+	{-0.923879532511287f, -0.38268343236509f}, {-0.99144486137381f, -0.130526192220052f},
+	{-0.99144486137381f, 0.130526192220051f}, {-0.923879532511287f, 0.38268343236509f},
+	{-0.793353340291235f, 0.608761429008721f}, {-0.608761429008721f, 0.793353340291235f},
+	{-0.38268343236509f, 0.923879532511287f}, {-0.130526192220052f, 0.99144486137381f},
+	{0.38268343236509f, 0.923879532511287f}, {0.923879532511287f, 0.38268343236509f},
+	{0.923879532511287f, -0.38268343236509f}, {0.38268343236509f, -0.923879532511287f},
+	{-0.38268343236509f, -0.923879532511287f}, {-0.923879532511287f, -0.38268343236509f},
+	{-0.923879532511287f, 0.38268343236509f}, {-0.38268343236509f, 0.923879532511287f}
+};
+
+struct GradientTable {
+	alignas(32) float values[256];
+
+	GradientTable() {
+		for(int i = 0; i < 128; i++) {
+			int d = (i < 120) ? i % 24 : 24 + i - 120;
+			values[i * 2] = GRADIENT_DIRECTIONS[d][0];
+			values[i * 2 + 1] = GRADIENT_DIRECTIONS[d][1];
+		}
+	}
+};
+static const GradientTable GRADIENTS;
+
+//Scalar versions of FastNoiseLite functions
+static int floorScalar(float f) {
+	return f >= 0 ? (int)f : (int)f - 1;
+}
+
+static float lerpScalar(float a, float b, float t) {
+	return a + t * (b - a);
+}
+
+static int hashScalar(int seed, int xPrimed, int yPrimed) {
+	return (int)((unsigned int)(seed ^ xPrimed ^ yPrimed) * (unsigned int)NOISE_HASH);
+}
+
+static float gradScalar(int seed, int xPrimed, int yPrimed, float xd, float yd) {
+	int hash = hashScalar(seed, xPrimed, yPrimed);
+	hash ^= hash >> 15;
+	hash &= 127 << 1;
+	return xd * GRADIENTS.values[hash] + yd * GRADIENTS.values[hash | 1];
+}
+
+static float perlinScalar(int seed, float x, float y) {
+	int x0 = floorScalar(x);
+	int y0 = floorScalar(y);
+
+	float xd0 = x - x0;
+	float yd0 = y - y0;
+	float xd1 = xd0 - 1;
+	float yd1 = yd0 - 1;
+	float xs = xd0 * xd0 * xd0 * (xd0 * (xd0 * 6 - 15) + 10);
+	float ys = yd0 * yd0 * yd0 * (yd0 * (yd0 * 6 - 15) + 10);
+
+	x0 = (unsigned int)x0 * NOISE_PRIME_X;
+	y0 = (unsigned int)y0 * NOISE_PRIME_Y;
+	int x1 = (unsigned int)x0 + NOISE_PRIME_X;
+	int y1 = (unsigned int)y0 + NOISE_PRIME_Y;
+
+	float xf0 = lerpScalar(gradScalar(seed, x0, y0, xd0, yd0), gradScalar(seed, x1, y0, xd1, yd0), xs);
+	float xf1 = lerpScalar(gradScalar(seed, x0, y1, xd0, yd1), gradScalar(seed, x1, y1, xd1, yd1), xs);
+	return lerpScalar(xf0, xf1, ys) * NOISE_PERLIN_SCALE;
+}
+
+static float valCoordScalar(int seed, int xPrimed, int yPrimed) {
+	unsigned int hash = hashScalar(seed, xPrimed, yPrimed);
+	hash *= hash;
+	hash ^= hash << 19;
+	return (int)hash * NOISE_VALUE_SCALE;
+}
+
+static float valueScalar(int seed, float x, float y) {
+	int x0 = floorScalar(x);
+	int y0 = floorScalar(y);
+
+	float xd = x - x0;
+	float yd = y - y0;
+	float xs = xd * xd * (3 - 2 * xd);
+	float ys = yd * yd * (3 - 2 * yd);
+
+	x0 = (unsigned int)x0 * NOISE_PRIME_X;
+	y0 = (unsigned int)y0 * NOISE_PRIME_Y;
+	int x1 = (unsigned int)x0 + NOISE_PRIME_X;
+	int y1 = (unsigned int)y0 + NOISE_PRIME_Y;
+
+	float xf0 = lerpScalar(valCoordScalar(seed, x0, y0), valCoordScalar(seed, x1, y0), xs);
+	float xf1 = lerpScalar(valCoordScalar(seed, x0, y1), valCoordScalar(seed, x1, y1), xs);
+	return lerpScalar(xf0, xf1, ys);
+}
+
+static float singleScalar(int noiseType, int seed, float x, float y) {
+	return (noiseType == NOISEPerlin) ? perlinScalar(seed, x, y) : valueScalar(seed, x, y);
+}
+
+//Same bounding as FastNoiseLite::CalculateFractalBounding
+static float fractalBounding(const NoiseBlockSettings &settings) {
+	float gain = std::abs(settings.gain);
+	float amp = gain;
+	float ampFractal = 1.0f;
+	for(int i = 1; i < settings.octaves; i++) {
+		ampFractal += amp;
+		amp *= gain;
+	}
+	return 1 / ampFractal;
+}
+
+static void rowScalar(const NoiseBlockSettings &settings, const float *xs, float y, int count, float *out) {
+	const float fy = y * settings.frequency;
+	if(settings.octaves <= 1) {
+		for(int i = 0; i < count; i++)
+			out[i] = singleScalar(settings.noiseType, settings.seed, xs[i] * settings.frequency, fy);
+		return;
+	}
+
+	const float bounding = fractalBounding(settings);
+	for(int i = 0; i < count; i++) {
+		float x = xs[i] * settings.frequency;
+		float yo = fy;
+		float sum = 0;
+		float amp = bounding;
+		for(int o = 0; o < settings.octaves; o++) {
+			sum += singleScalar(settings.noiseType, settings.seed + o, x, yo) * amp;
+			x *= 2.0f;
+			yo *= 2.0f;
+			amp *= settings.gain;
+		}
+		out[i] = sum;
+	}
+}
+
+//Low bias 32 bit mixer from https://nullprogram.com/blog/2018/07/31/
+static uint32_t mixScalar(uint32_t x) {
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	x ^= x >> 16;
+	return x;
+}
+
+uint32_t randomKey(uint64_t seed) {
+	return mixScalar((uint32_t)seed ^ mixScalar((uint32_t)(seed >> 32) + RANDOM_GOLDEN));
+}
+
+//Row is mixed into the key, then the column into that
+uint32_t randomCounter(uint32_t key, int x, int y) {
+	return mixScalar(mixScalar((uint32_t)y * RANDOM_GOLDEN ^ key) + (uint32_t)x);
+}
+
+int integerNoiseBits(int n) {
+	n = (n >> 13) ^ n;
+	unsigned int u = n;
+	return (int)((u * (u * u * 60493 + 19990303) + 1376312589) & 0x7fffffff);
+}
+
+#ifdef NOISE_X86
+
+//8 lanes with AVX2
+__attribute__((target("avx2")))
+static inline __m256i floor8(__m256 f) {
+	__m256i t = _mm256_cvttps_epi32(f);
+	__m256i negative = _mm256_castps_si256(_mm256_cmp_ps(f, _mm256_setzero_ps(), _CMP_LT_OQ));
+	return _mm256_add_epi32(t, negative);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 lerp8(__m256 a, __m256 b, __m256 t) {
+	return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i hash8(__m256i seed, __m256i x, __m256i y) {
+	__m256i hash = _mm256_xor_si256(_mm256_xor_si256(seed, x), y);
+	return _mm256_mullo_epi32(hash, _mm256_set1_epi32(NOISE_HASH));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 grad8(__m256i seed, __m256i x, __m256i y, __m256 xd, __m256 yd) {
+	__m256i hash = hash8(seed, x, y);
+	hash = _mm256_xor_si256(hash, _mm256_srai_epi32(hash, 15));
+	hash = _mm256_and_si256(hash, _mm256_set1_epi32(127 << 1));
+	__m256 xg = _mm256_i32gather_ps(GRADIENTS.values, hash, 4);
+	__m256 yg = _mm256_i32gather_ps(GRADIENTS.values, _mm256_or_si256(hash, _mm256_set1_epi32(1)), 4);
+	return _mm256_add_ps(_mm256_mul_ps(xd, xg), _mm256_mul_ps(yd, yg));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 perlin8(__m256i seed, __m256 x, __m256 y) {
+	const __m256 one = _mm256_set1_ps(1);
+	__m256i x0 = floor8(x);
+	__m256i y0 = floor8(y);
+
+	__m256 xd0 = _mm256_sub_ps(x, _mm256_cvtepi32_ps(x0));
+	__m256 yd0 = _mm256_sub_ps(y, _mm256_cvtepi32_ps(y0));
+	__m256 xd1 = _mm256_sub_ps(xd0, one);
+	__m256 yd1 = _mm256_sub_ps(yd0, one);
+
+	//t * t * t * (t * (t * 6 - 15) + 10)
+	const __m256 six = _mm256_set1_ps(6);
+	const __m256 fifteen = _mm256_set1_ps(15);
+	const __m256 ten = _mm256_set1_ps(10);
+	__m256 xs = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(xd0, xd0), xd0),
+		_mm256_add_ps(_mm256_mul_ps(xd0, _mm256_sub_ps(_mm256_mul_ps(xd0, six), fifteen)), ten));
+	__m256 ys = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(yd0, yd0), yd0),
+		_mm256_add_ps(_mm256_mul_ps(yd0, _mm256_sub_ps(_mm256_mul_ps(yd0, six), fifteen)), ten));
+
+	x0 = _mm256_mullo_epi32(x0, _mm256_set1_epi32(NOISE_PRIME_X));
+	y0 = _mm256_mullo_epi32(y0, _mm256_set1_epi32(NOISE_PRIME_Y));
+	__m256i x1 = _mm256_add_epi32(x0, _mm256_set1_epi32(NOISE_PRIME_X));
+	__m256i y1 = _mm256_add_epi32(y0, _mm256_set1_epi32(NOISE_PRIME_Y));
+
+	__m256 xf0 = lerp8(grad8(seed, x0, y0, xd0, yd0), grad8(seed, x1, y0, xd1, yd0), xs);
+	__m256 xf1 = lerp8(grad8(seed, x0, y1, xd0, yd1), grad8(seed, x1, y1, xd1, yd1), xs);
+	return _mm256_mul_ps(lerp8(xf0, xf1, ys), _mm256_set1_ps(NOISE_PERLIN_SCALE));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 valCoord8(__m256i seed, __m256i x, __m256i y) {
+	__m256i hash = hash8(seed, x, y);
+	hash = _mm256_mullo_epi32(hash, hash);
+	hash = _mm256_xor_si256(hash, _mm256_slli_epi32(hash, 19));
+	return _mm256_mul_ps(_mm256_cvtepi32_ps(hash), _mm256_set1_ps(NOISE_VALUE_SCALE));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 value8(__m256i seed, __m256 x, __m256 y) {
+	__m256i x0 = floor8(x);
+	__m256i y0 = floor8(y);
+
+	//t * t * (3 - 2 * t)
+	const __m256 two = _mm256_set1_ps(2);
+	const __m256 three = _mm256_set1_ps(3);
+	__m256 xd = _mm256_sub_ps(x, _mm256_cvtepi32_ps(x0));
+	__m256 yd = _mm256_sub_ps(y, _mm256_cvtepi32_ps(y0));
+	__m256 xs = _mm256_mul_ps(_mm256_mul_ps(xd, xd), _mm256_sub_ps(three, _mm256_mul_ps(two, xd)));
+	__m256 ys = _mm256_mul_ps(_mm256_mul_ps(yd, yd), _mm256_sub_ps(three, _mm256_mul_ps(two, yd)));
+
+	x0 = _mm256_mullo_epi32(x0, _mm256_set1_epi32(NOISE_PRIME_X));
+	y0 = _mm256_mullo_epi32(y0, _mm256_set1_epi32(NOISE_PRIME_Y));
+	__m256i x1 = _mm256_add_epi32(x0, _mm256_set1_epi32(NOISE_PRIME_X));
+	__m256i y1 = _mm256_add_epi32(y0, _mm256_set1_epi32(NOISE_PRIME_Y));
+
+	__m256 xf0 = lerp8(valCoord8(seed, x0, y0), valCoord8(seed, x1, y0), xs);
+	__m256 xf1 = lerp8(valCoord8(seed, x0, y1), valCoord8(seed, x1, y1), xs);
+	return lerp8(xf0, xf1, ys);
+}
+
+__attribute__((target("avx2")))
+static int rowAVX2(const NoiseBlockSettings &settings, const float *xs, float y, int count, float *out) {
+	const bool perlin = settings.noiseType == NOISEPerlin;
+	const int octaves = std::max(settings.octaves, 1);
+	const float bounding = (octaves > 1) ? fractalBounding(settings) : 1;
+	const __m256 frequency = _mm256_set1_ps(settings.frequency);
+
+	int i = 0;
+	for(; i + 8 <= count; i += 8) {
+		__m256 x = _mm256_mul_ps(_mm256_loadu_ps(xs + i), frequency);
+		__m256 yo = _mm256_set1_ps(y * settings.frequency);
+		if(octaves == 1) {
+			__m256i seed = _mm256_set1_epi32(settings.seed);
+			_mm256_storeu_ps(out + i, perlin ? perlin8(seed, x, yo) : value8(seed, x, yo));
+			continue;
+		}
+
+		__m256 sum = _mm256_setzero_ps();
+		float amp = bounding;
+		for(int o = 0; o < octaves; o++) {
+			__m256i seed = _mm256_set1_epi32(settings.seed + o);
+			__m256 noise = perlin ? perlin8(seed, x, yo) : value8(seed, x, yo);
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(noise, _mm256_set1_ps(amp)));
+			x = _mm256_mul_ps(x, _mm256_set1_ps(2.0f));
+			yo = _mm256_mul_ps(yo, _mm256_set1_ps(2.0f));
+			amp *= settings.gain;
+		}
+		_mm256_storeu_ps(out + i, sum);
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i mix8(__m256i x) {
+	x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+	x = _mm256_mullo_epi32(x, _mm256_set1_epi32(0x7feb352d));
+	x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+	x = _mm256_mullo_epi32(x, _mm256_set1_epi32(0x846ca68b));
+	return _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+}
+
+__attribute__((target("avx2")))
+static int randomRowAVX2(uint32_t key, int x, int y, int count, uint32_t *out) {
+	const __m256i row = _mm256_set1_epi32(mixScalar((uint32_t)y * RANDOM_GOLDEN ^ key));
+	__m256i column = _mm256_add_epi32(_mm256_set1_epi32(x), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	int i = 0;
+	for(; i + 8 <= count; i += 8) {
+		_mm256_storeu_si256((__m256i*)(out + i), mix8(_mm256_add_epi32(row, column)));
+		column = _mm256_add_epi32(column, _mm256_set1_epi32(8));
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static int integerNoiseRowAVX2(int start, int count, int *out) {
+	__m256i n = _mm256_add_epi32(_mm256_set1_epi32(start), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	int i = 0;
+	for(; i + 8 <= count; i += 8) {
+		__m256i m = _mm256_xor_si256(_mm256_srai_epi32(n, 13), n);
+		__m256i inner = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_mullo_epi32(m, m), _mm256_set1_epi32(60493)),
+			_mm256_set1_epi32(19990303));
+		__m256i nn = _mm256_add_epi32(_mm256_mullo_epi32(m, inner), _mm256_set1_epi32(1376312589));
+		_mm256_storeu_si256((__m256i*)(out + i), _mm256_and_si256(nn, _mm256_set1_epi32(0x7fffffff)));
+		n = _mm256_add_epi32(n, _mm256_set1_epi32(8));
+	}
+	return i;
+}
+
+//4 lanes with SSE4.1, loading gradients one at a time
+__attribute__((target("sse4.1")))
+static inline __m128i floor4(__m128 f) {
+	__m128i t = _mm_cvttps_epi32(f);
+	__m128i negative = _mm_castps_si128(_mm_cmplt_ps(f, _mm_setzero_ps()));
+	return _mm_add_epi32(t, negative);
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128 lerp4(__m128 a, __m128 b, __m128 t) {
+	return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i hash4(__m128i seed, __m128i x, __m128i y) {
+	__m128i hash = _mm_xor_si128(_mm_xor_si128(seed, x), y);
+	return _mm_mullo_epi32(hash, _mm_set1_epi32(NOISE_HASH));
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128 grad4(__m128i seed, __m128i x, __m128i y, __m128 xd, __m128 yd) {
+	__m128i hash = hash4(seed, x, y);
+	hash = _mm_xor_si128(hash, _mm_srai_epi32(hash, 15));
+	hash = _mm_and_si128(hash, _mm_set1_epi32(127 << 1));
+
+	alignas(16) int index[4];
+	_mm_store_si128((__m128i*)index, hash);
+	__m128 xg = _mm_setr_ps(GRADIENTS.values[index[0]], GRADIENTS.values[index[1]],
+		GRADIENTS.values[index[2]], GRADIENTS.values[index[3]]);
+	__m128 yg = _mm_setr_ps(GRADIENTS.values[index[0] | 1], GRADIENTS.values[index[1] | 1],
+		GRADIENTS.values[index[2] | 1], GRADIENTS.values[index[3] | 1]);
+	return _mm_add_ps(_mm_mul_ps(xd, xg), _mm_mul_ps(yd, yg));
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128 perlin4(__m128i seed, __m128 x, __m128 y) {
+	const __m128 one = _mm_set1_ps(1);
+	__m128i x0 = floor4(x);
+	__m128i y0 = floor4(y);
+
+	__m128 xd0 = _mm_sub_ps(x, _mm_cvtepi32_ps(x0));
+	__m128 yd0 = _mm_sub_ps(y, _mm_cvtepi32_ps(y0));
+	__m128 xd1 = _mm_sub_ps(xd0, one);
+	__m128 yd1 = _mm_sub_ps(yd0, one);
+
+	const __m128 six = _mm_set1_ps(6);
+	const __m128 fifteen = _mm_set1_ps(15);
+	const __m128 ten = _mm_set1_ps(10);
+	__m128 xs = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(xd0, xd0), xd0),
+		_mm_add_ps(_mm_mul_ps(xd0, _mm_sub_ps(_mm_mul_ps(xd0, six), fifteen)), ten));
+	__m128 ys = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(yd0, yd0), yd0),
+		_mm_add_ps(_mm_mul_ps(yd0, _mm_sub_ps(_mm_mul_ps(yd0, six), fifteen)), ten));
+
+	x0 = _mm_mullo_epi32(x0, _mm_set1_epi32(NOISE_PRIME_X));
+	y0 = _mm_mullo_epi32(y0, _mm_set1_epi32(NOISE_PRIME_Y));
+	__m128i x1 = _mm_add_epi32(x0, _mm_set1_epi32(NOISE_PRIME_X));
+	__m128i y1 = _mm_add_epi32(y0, _mm_set1_epi32(NOISE_PRIME_Y));
+
+	__m128 xf0 = lerp4(grad4(seed, x0, y0, xd0, yd0), grad4(seed, x1, y0, xd1, yd0), xs);
+	__m128 xf1 = lerp4(grad4(seed, x0, y1, xd0, yd1), grad4(seed, x1, y1, xd1, yd1), xs);
+	return _mm_mul_ps(lerp4(xf0, xf1, ys), _mm_set1_ps(NOISE_PERLIN_SCALE));
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128 valCoord4(__m128i seed, __m128i x, __m128i y) {
+	__m128i hash = hash4(seed, x, y);
+	hash = _mm_mullo_epi32(hash, hash);
+	hash = _mm_xor_si128(hash, _mm_slli_epi32(hash, 19));
+	return _mm_mul_ps(_mm_cvtepi32_ps(hash), _mm_set1_ps(NOISE_VALUE_SCALE));
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128 value4(__m128i seed, __m128 x, __m128 y) {
+	__m128i x0 = floor4(x);
+	__m128i y0 = floor4(y);
+
+	const __m128 two = _mm_set1_ps(2);
+	const __m128 three = _mm_set1_ps(3);
+	__m128 xd = _mm_sub_ps(x, _mm_cvtepi32_ps(x0));
+	__m128 yd = _mm_sub_ps(y, _mm_cvtepi32_ps(y0));
+	__m128 xs = _mm_mul_ps(_mm_mul_ps(xd, xd), _mm_sub_ps(three, _mm_mul_ps(two, xd)));
+	__m128 ys = _mm_mul_ps(_mm_mul_ps(yd, yd), _mm_sub_ps(three, _mm_mul_ps(two, yd)));
+
+	x0 = _mm_mullo_epi32(x0, _mm_set1_epi32(NOISE_PRIME_X));
+	y0 = _mm_mullo_epi32(y0, _mm_set1_epi32(NOISE_PRIME_Y));
+	__m128i x1 = _mm_add_epi32(x0, _mm_set1_epi32(NOISE_PRIME_X));
+	__m128i y1 = _mm_add_epi32(y0, _mm_set1_epi32(NOISE_PRIME_Y));
+
+	__m128 xf0 = lerp4(valCoord4(seed, x0, y0), valCoord4(seed, x1, y0), xs);
+	__m128 xf1 = lerp4(valCoord4(seed, x0, y1), valCoord4(seed, x1, y1), xs);
+	return lerp4(xf0, xf1, ys);
+}
+
+__attribute__((target("sse4.1")))
+static int rowSSE41(const NoiseBlockSettings &settings, const float *xs, float y, int count, float *out) {
+	const bool perlin = settings.noiseType == NOISEPerlin;
+	const int octaves = std::max(settings.octaves, 1);
+	const float bounding = (octaves > 1) ? fractalBounding(settings) : 1;
+	const __m128 frequency = _mm_set1_ps(settings.frequency);
+
+	int i = 0;
+	for(; i + 4 <= count; i += 4) {
+		__m128 x = _mm_mul_ps(_mm_loadu_ps(xs + i), frequency);
+		__m128 yo = _mm_set1_ps(y * settings.frequency);
+		if(octaves == 1) {
+			__m128i seed = _mm_set1_epi32(settings.seed);
+			_mm_storeu_ps(out + i, perlin ? perlin4(seed, x, yo) : value4(seed, x, yo));
+			continue;
+		}
+
+		__m128 sum = _mm_setzero_ps();
+		float amp = bounding;
+		for(int o = 0; o < octaves; o++) {
+			__m128i seed = _mm_set1_epi32(settings.seed + o);
+			__m128 noise = perlin ? perlin4(seed, x, yo) : value4(seed, x, yo);
+			sum = _mm_add_ps(sum, _mm_mul_ps(noise, _mm_set1_ps(amp)));
+			x = _mm_mul_ps(x, _mm_set1_ps(2.0f));
+			yo = _mm_mul_ps(yo, _mm_set1_ps(2.0f));
+			amp *= settings.gain;
+		}
+		_mm_storeu_ps(out + i, sum);
+	}
+	return i;
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i mix4(__m128i x) {
+	x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+	x = _mm_mullo_epi32(x, _mm_set1_epi32(0x7feb352d));
+	x = _mm_xor_si128(x, _mm_srli_epi32(x, 15));
+	x = _mm_mullo_epi32(x, _mm_set1_epi32(0x846ca68b));
+	return _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+}
+
+__attribute__((target("sse4.1")))
+static int randomRowSSE41(uint32_t key, int x, int y, int count, uint32_t *out) {
+	const __m128i row = _mm_set1_epi32(mixScalar((uint32_t)y * RANDOM_GOLDEN ^ key));
+	__m128i column = _mm_add_epi32(_mm_set1_epi32(x), _mm_setr_epi32(0, 1, 2, 3));
+	int i = 0;
+	for(; i + 4 <= count; i += 4) {
+		_mm_storeu_si128((__m128i*)(out + i), mix4(_mm_add_epi32(row, column)));
+		column = _mm_add_epi32(column, _mm_set1_epi32(4));
+	}
+	return i;
+}
+
+__attribute__((target("sse4.1")))
+static int integerNoiseRowSSE41(int start, int count, int *out) {
+	__m128i n = _mm_add_epi32(_mm_set1_epi32(start), _mm_setr_epi32(0, 1, 2, 3));
+	int i = 0;
+	for(; i + 4 <= count; i += 4) {
+		__m128i m = _mm_xor_si128(_mm_srai_epi32(n, 13), n);
+		__m128i inner = _mm_add_epi32(_mm_mullo_epi32(_mm_mullo_epi32(m, m), _mm_set1_epi32(60493)),
+			_mm_set1_epi32(19990303));
+		__m128i nn = _mm_add_epi32(_mm_mullo_epi32(m, inner), _mm_set1_epi32(1376312589));
+		_mm_storeu_si128((__m128i*)(out + i), _mm_and_si128(nn, _mm_set1_epi32(0x7fffffff)));
+		n = _mm_add_epi32(n, _mm_set1_epi32(4));
+	}
+	return i;
+}
+
+//Pick widest instruction set once
+static int noiseBlockLevel() {
+	static int level = __builtin_cpu_supports("avx2") ? 2 : (__builtin_cpu_supports("sse4.1") ? 1 : 0);
+	return level;
+}
+
+#else
+
+static int noiseBlockLevel() {
+	return 0;
+}
+
+#endif
+
+bool noiseBlockSupported(int noiseType) {
+	return noiseType == NOISEPerlin || noiseType == NOISEValue;
+}
+
+void noiseBlockRow(const NoiseBlockSettings &settings, const float *xs, float y, int count, float *out) {
+	int done = 0;
+#ifdef NOISE_X86
+	if(noiseBlockLevel() == 2)
+		done = rowAVX2(settings, xs, y, count, out);
+	else if(noiseBlockLevel() == 1)
+		done = rowSSE41(settings, xs, y, count, out);
+#endif
+	rowScalar(settings, xs + done, y, count - done, out + done);
+}
+
+void randomBlockRow(uint32_t key, int x, int y, int count, uint32_t *out) {
+	int done = 0;
+#ifdef NOISE_X86
+	if(noiseBlockLevel() == 2)
+		done = randomRowAVX2(key, x, y, count, out);
+	else if(noiseBlockLevel() == 1)
+		done = randomRowSSE41(key, x, y, count, out);
+#endif
+	for(int i = done; i < count; i++)
+		out[i] = randomCounter(key, x + i, y);
+}
+
+void integerNoiseRow(int start, int count, int *out) {
+	int done = 0;
+#ifdef NOISE_X86
+	if(noiseBlockLevel() == 2)
+		done = integerNoiseRowAVX2(start, count, out);
+	else if(noiseBlockLevel() == 1)
+		done = integerNoiseRowSSE41(start, count, out);
+#endif
+	for(int i = done; i < count; i++)
+		out[i] = integerNoiseBits((unsigned int)start + i);
+}
+
+const char *noiseBlockPath() {
+	switch(noiseBlockLevel()) {
+	case 2:
+		return "avx2";
+	case 1:
+		return "sse4.1";
+	}
+	return "scalar";
+}
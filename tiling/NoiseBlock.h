@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Bulk 2D noise and random values, using SIMD when the cpu supports it
+ */
+
+//Noise settings as set through NoiseIndexer
+struct NoiseBlockSettings {
+	int noiseType;
+	int seed;
+	float frequency = 1;
+	int octaves = 1;
+	float gain = 0.5;
+};
+
+//Check if noise type (NOISE enum) has a bulk kernel
+bool noiseBlockSupported(int noiseType);
+
+//Fill out[i] with noise at (xs[i], y), identical to FastNoiseLite::GetNoise
+void noiseBlockRow(const NoiseBlockSettings &settings, const float *xs, float y, int count, float *out);
+
+//Name of instruction set in use
+const char *noiseBlockPath();
+
+//Counter based random bits keyed by seed, the same for any traversal order
+uint32_t randomKey(uint64_t seed);
+uint32_t randomCounter(uint32_t key, int x, int y);
+
+//Fill out[i] with randomCounter(key, x + i, y)
+void randomBlockRow(uint32_t key, int x, int y, int count, uint32_t *out);
+
+//Fill out[i] with the integer part of libnoise IntegerNoise(start + i)
+int integerNoiseBits(int n);
+void integerNoiseRow(int start, int count, int *out);
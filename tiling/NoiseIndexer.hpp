@@ -1,4 +1,11 @@
+#pragma once
+
+#include <algorithm>
+
+#include "../core/Event.h"
 #include "GridMaker.h"
+#include "NoiseBlock.h"
+#include "../util/Parallel.hpp"
 
 //#include "../include/libnoise/src/noise/noise.h"
 #include "../include/FastNoiseLite.h"
@@ -15,6 +22,10 @@
 
 NAMED_ENUM(NOISE);
 
+//Area above which getBlock splits rows across threads
+#define NOISE_PARALLEL_SIZE 65536
+#define RANDOM_LINEAR_KEY 0x5bd1e995u
+
 static const FastNoiseLite::NoiseType NOISE_TYPES[] = {
 	FastNoiseLite::NoiseType_OpenSimplex2,
 	FastNoiseLite::NoiseType_OpenSimplex2S,
@@ -28,6 +39,12 @@ static const FastNoiseLite::NoiseType NOISE_TYPES[] = {
  * Random noise tiling
  */
 
+//Counter hash by default, or libnoise IntegerNoise to match older seeds
+enum RandomMode {
+	RANDOM_COUNTER,
+	RANDOM_INTEGER_NOISE
+};
+
 //Add a pure random value to each tile, with a range of 0 to limit index
 class RandomIndexer : public Indexer {
 private:
@@ -38,35 +55,57 @@ private:
 	int rawLimit = 0;
 
 	sint seed = 0;
+	uint32_t key = 0;
+	int mode = RANDOM_COUNTER;
 
 public:
-	int noiseUpdateCount = 0;
+	uint noiseUpdateCount = 0;
 	int multiplier;
 
 	RandomIndexer(Indexer *previous, std::map<int, int> _limits, sint _seed, int _multiplier=1, Vector2i scale=Vector2i(1,1))
-		: Indexer(previous, previous->fallback, scale), limits(new MapIndexer(previous, _limits, 0)), seed(_seed), multiplier(_multiplier) {
+		: Indexer(previous, previous->fallback, scale), limits(new MapIndexer(previous, _limits, 0)), seed(_seed), key(randomKey(_seed)), multiplier(_multiplier) {
 
 	}
 
 	RandomIndexer(Indexer *previous, Indexer *_limits, sint _seed, int _multiplier=1, Vector2i scale=Vector2i(1,1))
-		: Indexer(previous, previous->fallback, scale), limits(_limits), seed(_seed), multiplier(_multiplier) {
+		: Indexer(previous, previous->fallback, scale), limits(_limits), seed(_seed), key(randomKey(_seed)), multiplier(_multiplier) {
 
+		limits->addDependent(this);
 	}
 
 	RandomIndexer(Vector2i _size, int _limit, sint _seed, int _multiplier=1, Vector2i scale=Vector2i(1,1))
-		: Indexer(NULL, 0, scale), size(_size), rawLimit(_limit), seed(_seed), multiplier(_multiplier) {
+		: Indexer(NULL, 0, scale), size(_size), rawLimit(_limit), seed(_seed), key(randomKey(_seed)), multiplier(_multiplier) {
 
 	}
 
+	//Fall back to the plain limit if the limits indexer is destroyed first
+	void sourceRemoved(Indexer *source) override {
+		if(limits == source)
+			limits = NULL;
+		Indexer::sourceRemoved(source);
+	}
+
 	void setSeed(sint _seed) {
 		seed = _seed;
-		noiseUpdateCount++;
+		key = randomKey(_seed);
+		noiseUpdateCount = nextVersion();
+		notifyChanged();
 	}
 
 	sint getSeed() {
 		return seed;
 	}
 
+	void setMode(int _mode) {
+		mode = _mode;
+		noiseUpdateCount = nextVersion();
+		notifyChanged();
+	}
+
+	int getMode() {
+		return mode;
+	}
+
 	//Function copied from https://libnoise.sourceforge.net/noisegen/index.html
 	//Modified for range 0.0 - 1.0
 	static double IntegerNoise(int n) {
@@ -75,24 +114,82 @@ public:
 		return ((double)nn / 1073741824.0) / 2.0;
 	}
 
-	//Consistant locational randomness
-	int getTileI(int x, int y) override {
-		if(inBounds(x, y)) {
-			int limit = rawLimit;
-			int previous = 0;
+	//Scale random bits to range 0 to limit
+	static int randomOffset(uint32_t bits, int limit) {
+		if(limit <= 0)
+			return 0;
+		return ((uint64_t)bits * (uint32_t)limit) >> 32;
+	}
+
+	static int integerNoiseOffset(int bits, int limit) {
+		double input = ((double)bits / 1073741824.0) / 2.0;
+		return limitRange((int)floor(input * limit), 0, limit);
+	}
+
+	//First IntegerNoise input of a row
+	int integerNoiseStart(int y) {
+		return (uint32_t)(y*getSize().x + seed*getSize().y*getSize().x);
+	}
+
+	//Random offset added to a tile at position
+	int randomTile(int x, int y, int limit, int previous) {
+		int rOffset;
+		if(mode == RANDOM_INTEGER_NOISE)
+			rOffset = integerNoiseOffset(integerNoiseBits((uint32_t)integerNoiseStart(y) + x), limit);
+		else
+			rOffset = randomOffset(randomCounter(key, x, y), limit);
+		return previous + rOffset * multiplier;
+	}
+
+	//Fill block row by row with vectorized random bits
+	void getBlock(IntRect area, int *values, int stride) override {
+		if(!inBounds(area.left, area.top) || !inBounds(area.left + area.width - 1, area.top + area.height - 1)) {
+			Indexer::getBlock(area, values, stride);
+			return;
+		}
+
+		std::vector<uint32_t> bits(area.width);
+		std::vector<int> limitRow(area.width, rawLimit);
+		std::vector<int> previousRow(area.width, 0);
+		for(int y = 0; y < area.height; y++) {
+			const int gridY = area.top + y;
+			if(mode == RANDOM_INTEGER_NOISE)
+				integerNoiseRow((uint32_t)integerNoiseStart(gridY) + area.left, area.width, (int*)bits.data());
+			else
+				randomBlockRow(key, area.left, gridY, area.width, bits.data());
+
 			if(limits != NULL) {
-				limit = limits->getTileI(x, y);
-				previous = getPrevious()->getTileI(x, y);
+				limits->getBlock(IntRect(area.left, gridY, area.width, 1), limitRow.data(), area.width);
+				getPrevious()->getBlock(IntRect(area.left, gridY, area.width, 1), previousRow.data(), area.width);
 			}
 
-			double input = IntegerNoise(x + y*getSize().x + seed*getSize().y*getSize().x);
-			int rOffset = (int)floor(input * limit);
-			rOffset = limitRange(rOffset, 0, limit);
-			return previous + rOffset * multiplier;
+			int *row = values + y * stride;
+			if(mode == RANDOM_INTEGER_NOISE)
+				for(int x = 0; x < area.width; x++)
+					row[x] = previousRow[x] + integerNoiseOffset(bits[x], limitRow[x]) * multiplier;
+			else
+				for(int x = 0; x < area.width; x++)
+					row[x] = previousRow[x] + randomOffset(bits[x], limitRow[x]) * multiplier;
+		}
+	}
+
+	//Consistant locational randomness
+	int getTileI(int x, int y) override {
+		if(inBounds(x, y)) {
+			if(limits != NULL)
+				return randomTile(x, y, limits->getTileI(x, y), getPrevious()->getTileI(x, y));
+			return randomTile(x, y, rawLimit, 0);
 		}
 		return fallback;
 	}
 
+	//Same randomness as getTileI when mapping an existing value
+	int mapTileI(int c, int x, int y) override {
+		if(limits != NULL)
+			return randomTile(x, y, limits->mapTileI(c, x, y), getPrevious()->mapTileI(c, x, y));
+		return randomTile(x, y, rawLimit, 0);
+	}
+
 	//Backup linear random function
 	int mapTile(int c) override {
 		int limit = rawLimit;
@@ -102,16 +199,35 @@ public:
 			previous = getPrevious()->mapTile(c);
 		}
 
-		double input = IntegerNoise(linearPosition++ + seed);
-		int rOffset = (int)floor(input * limit);
-		rOffset = limitRange(rOffset, 0, limit);
+		//Each value keeps the same offset, unless matching older seeds
+		int rOffset;
+		if(mode == RANDOM_INTEGER_NOISE)
+			rOffset = integerNoiseOffset(integerNoiseBits(linearPosition++ + seed), limit);
+		else
+			rOffset = randomOffset(randomCounter(key ^ RANDOM_LINEAR_KEY, c, 0), limit);
 		return previous + rOffset * multiplier;
 	}
 
 	uint getUpdateCount() override {
 		if(getPrevious() == NULL)
 			return noiseUpdateCount;
-		return getPrevious()->getUpdateCount() + noiseUpdateCount + limits->getUpdateCount();
+		uint count = std::max(getPrevious()->getUpdateCount(), noiseUpdateCount);
+		if(limits != NULL)
+			count = std::max(count, limits->getUpdateCount());
+		return count;
+	}
+
+	//Any setting change affects the full grid
+	std::vector<IntRect> getChanges(uint since, uint until=(uint)-1) override {
+		std::vector<IntRect> changes;
+		if(noiseUpdateCount > since)
+			changes.push_back(fullRect());
+		else if(getPrevious() != NULL) {
+			changes = getPrevious()->getChanges(since, until);
+			if(limits != NULL)
+				addChanges(changes, limits->getChanges(since, until));
+		}
+		return changes;
 	}
 
 	//Get size of grid
@@ -154,6 +270,7 @@ public:
 	NoiseIndexer(Indexer *previous, Indexer *_limits, sint _seed, int nType, int _multiplier=1, Vector2i scale=Vector2i(1,1))
 		: Indexer(previous, previous->fallback, scale), limits(_limits), seed(_seed), multiplier(_multiplier) {
 
+		limits->addDependent(this);
 		noise.SetNoiseType(NOISE_TYPES[nType]);
 		noise.SetSeed(seed);
 		noise.SetFrequency(1);
@@ -169,16 +286,25 @@ public:
 		noiseType = nType;
 	}
 
+	//Fall back to the plain limit if the limits indexer is destroyed first
+	void sourceRemoved(Indexer *source) override {
+		if(limits == source)
+			limits = NULL;
+		Indexer::sourceRemoved(source);
+	}
+
 	void setSeed(sint _seed) {
 		seed = _seed;
 		noise.SetSeed(_seed);
-		noiseUpdateCount++;
+		noiseUpdateCount = nextVersion();
+		notifyChanged();
 	}
 
 	void setFrequency(float _frequency) {
 		noise.SetFrequency(_frequency);
 		frequency = _frequency;
-		noiseUpdateCount++;
+		noiseUpdateCount = nextVersion();
+		notifyChanged();
 	}
 
 	void setOctaves(int _octaves, float _persistence) {
@@ -192,13 +318,15 @@ public:
 
 		octaves = _octaves;
 		persistence = _persistence;
-		noiseUpdateCount++;
+		noiseUpdateCount = nextVersion();
+		notifyChanged();
 	}
 
 	void setNoiseType(int nType) {
 		noise.SetNoiseType(NOISE_TYPES[nType]);
 		noiseType = nType;
-		noiseUpdateCount++;
+		noiseUpdateCount = nextVersion();
+		notifyChanged();
 	}
 
 	sint getSeed() {
@@ -217,26 +345,78 @@ public:
 		return noiseType;
 	}
 
+	//Noise offset added to a tile at position
+	int noiseTile(int x, int y, int limit, int previous) {
+		//double input = noise.octave2D_11((double)x/getSize().x*frequency, (double)y/getSize().y*frequency, octaves, persistence);
+		return noiseValue(noise.GetNoise((float)x/getSize().x, (float)y/getSize().y), limit, previous);
+	}
+
+	int noiseValue(float input, int limit, int previous) {
+		int rOffset = (int)floor(fmod(input+1, 1.0) * limit);
+		rOffset = limitRange(rOffset, 0, limit);
+
+		return previous + rOffset * multiplier;
+	}
+
+	//Fill block row by row, sharing normalization and splitting large areas across threads
+	void getBlock(IntRect area, int *values, int stride) override {
+		if(!inBounds(area.left, area.top) || !inBounds(area.left + area.width - 1, area.top + area.height - 1)) {
+			Indexer::getBlock(area, values, stride);
+			return;
+		}
+
+		const Vector2i size = getSize();
+		std::vector<float> xs(area.width);
+		for(int x = 0; x < area.width; x++)
+			xs[x] = (float)(area.left + x)/size.x;
+
+		NoiseBlockSettings settings = {noiseType, (int)seed, frequency, octaves, persistence};
+		const bool bulk = noiseBlockSupported(noiseType);
+		int threads = (area.width * area.height >= NOISE_PARALLEL_SIZE) ? 0 : 1;
+
+		parallelRange(area.height, threads, [&](int start, int end) {
+			std::vector<float> inputs(area.width);
+			std::vector<int> limitRow(area.width, rawLimit);
+			std::vector<int> previousRow(area.width, 0);
+
+			for(int y = start; y < end; y++) {
+				const int gridY = area.top + y;
+				const float ys = (float)gridY/size.y;
+				if(bulk)
+					noiseBlockRow(settings, xs.data(), ys, area.width, inputs.data());
+				else
+					for(int x = 0; x < area.width; x++)
+						inputs[x] = noise.GetNoise(xs[x], ys);
+
+				if(limits != NULL) {
+					limits->getBlock(IntRect(area.left, gridY, area.width, 1), limitRow.data(), area.width);
+					getPrevious()->getBlock(IntRect(area.left, gridY, area.width, 1), previousRow.data(), area.width);
+				}
+
+				int *row = values + y * stride;
+				for(int x = 0; x < area.width; x++)
+					row[x] = noiseValue(inputs[x], limitRow[x], previousRow[x]);
+			}
+		});
+	}
+
 	//Correct locational randomness
 	int getTileI(int x, int y) override {
 		if(inBounds(x, y)) {
-			int limit = rawLimit;
-			int previous = 0;
-			if(limits != NULL) {
-				limit = limits->getTileI(x, y);
-				previous = getPrevious()->getTileI(x, y);
-			}
-
-			//double input = noise.octave2D_11((double)x/getSize().x*frequency, (double)y/getSize().y*frequency, octaves, persistence);
-			float input = noise.GetNoise((float)x/getSize().x, (float)y/getSize().y);
-			int rOffset = (int)floor(fmod(input+1, 1.0) * limit);
-			rOffset = limitRange(rOffset, 0, limit);
-
-			return previous + rOffset * multiplier;
+			if(limits != NULL)
+				return noiseTile(x, y, limits->getTileI(x, y), getPrevious()->getTileI(x, y));
+			return noiseTile(x, y, rawLimit, 0);
 		}
 		return fallback;
 	}
 
+	//Same noise as getTileI when mapping an existing value
+	int mapTileI(int c, int x, int y) override {
+		if(limits != NULL)
+			return noiseTile(x, y, limits->mapTileI(c, x, y), getPrevious()->mapTileI(c, x, y));
+		return noiseTile(x, y, rawLimit, 0);
+	}
+
 	//Backup linear random function
 	int mapTile(int c) override {
 		int limit = rawLimit;
@@ -257,7 +437,23 @@ public:
 	uint getUpdateCount() override {
 		if(getPrevious() == NULL)
 			return noiseUpdateCount;
-		return getPrevious()->getUpdateCount() + noiseUpdateCount + limits->getUpdateCount();
+		uint count = std::max(getPrevious()->getUpdateCount(), noiseUpdateCount);
+		if(limits != NULL)
+			count = std::max(count, limits->getUpdateCount());
+		return count;
+	}
+
+	//Any setting change affects the full grid
+	std::vector<IntRect> getChanges(uint since, uint until=(uint)-1) override {
+		std::vector<IntRect> changes;
+		if(noiseUpdateCount > since)
+			changes.push_back(fullRect());
+		else if(getPrevious() != NULL) {
+			changes = getPrevious()->getChanges(since, until);
+			if(limits != NULL)
+				addChanges(changes, limits->getChanges(since, until));
+		}
+		return changes;
 	}
 
 	//Get size of grid
@@ -271,20 +467,19 @@ public:
 		if(file == "")
 			return;
 
-		const int width = getSize().x+1;
+		const int width = getSize().x;
 		const int height = getSize().y;
-		std::cout << getSize() << "\n";
 
-		char text[height*width+height];
+		std::string text;
+		text.reserve((width + 1) * height);
 
 		//Loop through tiles
 		for(int y = 0; y < height; y++) {
-			for(int x = 0; x < width; x++) {
-				text[y*width+x] = getTileI(x, y)+min;
-			}
-			text[y*width+width-1] = '\n';
+			if(y > 0)
+				text += '\n';
+			for(int x = 0; x < width; x++)
+				text += (char)(getTileI(x, y)+min);
 		}
-		text[(height-1)*width+width-1] = '\0';
 
 		IO::writeFile(file, text);
 	}
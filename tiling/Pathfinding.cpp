@@ -0,0 +1,630 @@
+#include "Pathfinding.h"
+#include "MathIndexers.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#define PATH_DIAGONAL_COST 1.41421356f
+#define PATH_INFINITY std::numeric_limits<float>::infinity()
+
+static const int SQUARE_OFFSETS[8][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {-1, 1}, {1, -1}, {-1, -1}};
+
+//Even rows sit half a tile right, matching HexIndexer
+static const int HEX_EVEN_OFFSETS[6][2] = {{1, 0}, {-1, 0}, {0, -1}, {1, -1}, {0, 1}, {1, 1}};
+static const int HEX_ODD_OFFSETS[6][2] = {{1, 0}, {-1, 0}, {-1, -1}, {0, -1}, {-1, 1}, {0, 1}};
+
+static int sign(int v) {
+	return (v > 0) - (v < 0);
+}
+
+static bool inArea(const IntRect &area, int x, int y) {
+	return x >= area.left && y >= area.top && x < area.left + area.width && y < area.top + area.height;
+}
+
+Pathfinder::Pathfinder(Indexer *_collision, std::function<bool(int)> _passable, int _layout, int _clusterSize)
+	: collision(_collision), passable(_passable), layout(_layout), clusterSize(_clusterSize) {
+
+	if(clusterSize < 2)
+		throw new std::invalid_argument("Path cluster size must be at least 2");
+
+	//Check whole stack for hex tiles
+	if(layout == PATH_AUTO) {
+		layout = PATH_DIAGONAL;
+		for(Indexer *indexer = collision; indexer != NULL; indexer = indexer->getPrevious())
+			if(dynamic_cast<HexIndexer *>(indexer) != NULL)
+				layout = PATH_HEX;
+	}
+
+	size = collision->getSize();
+	int count = size.x * size.y;
+	std::vector<int> tiles(count);
+	collision->getBlock(IntRect(0, 0, size.x, size.y), tiles.data(), size.x);
+	open.resize(count);
+	for(int i = 0; i < count; i++)
+		open[i] = passable(tiles[i]);
+	gridVersion = collision->getUpdateCount();
+
+	cost.resize(count);
+	parent.resize(count);
+	visited.assign(count, 0);
+	closed.assign(count, 0);
+	heap.reserve(1024);
+
+	clusterCount = Vector2i((size.x + clusterSize - 1) / clusterSize, (size.y + clusterSize - 1) / clusterSize);
+}
+
+//Reread changed tiles, marking clusters that touch them
+void Pathfinder::refresh() {
+	uint version = collision->getUpdateCount();
+	if(version == gridVersion)
+		return;
+
+	std::vector<int> tiles;
+	for(IntRect area : collision->getChanges(gridVersion, version)) {
+		int left = std::max(area.left, 0);
+		int top = std::max(area.top, 0);
+		int right = std::min(area.left + area.width, size.x);
+		int bottom = std::min(area.top + area.height, size.y);
+		if(left >= right || top >= bottom)
+			continue;
+
+		tiles.resize((right - left) * (bottom - top));
+		collision->getBlock(IntRect(left, top, right - left, bottom - top), tiles.data(), right - left);
+		for(int y = top; y < bottom; y++)
+			for(int x = left; x < right; x++)
+				open[x + y * size.x] = passable(tiles[(x - left) + (y - top) * (right - left)]);
+
+		if(hierarchyBuilt) {
+			IntRect changed(left, top, right - left, bottom - top);
+			for(int c = 0; c < (int)clusters.size(); c++)
+				if(changed.overlaps(clusterArea(c)))
+					clusters[c].dirty = true;
+		}
+	}
+	gridVersion = version;
+}
+
+//Walkable neighbors, with diagonals only when both sides are open
+int Pathfinder::neighbors(int x, int y, int *cells, float *costs) const {
+	int count = 0;
+	if(layout == PATH_HEX) {
+		const int (*offsets)[2] = (y % 2 == 0) ? HEX_EVEN_OFFSETS : HEX_ODD_OFFSETS;
+		for(int i = 0; i < 6; i++) {
+			int nx = x + offsets[i][0];
+			int ny = y + offsets[i][1];
+			if(isOpen(nx, ny)) {
+				cells[count] = nx + ny * size.x;
+				costs[count++] = 1;
+			}
+		}
+		return count;
+	}
+
+	int directions = (layout == PATH_DIAGONAL) ? 8 : 4;
+	for(int i = 0; i < directions; i++) {
+		int dx = SQUARE_OFFSETS[i][0];
+		int dy = SQUARE_OFFSETS[i][1];
+		if(!isOpen(x + dx, y + dy))
+			continue;
+		if(dx != 0 && dy != 0 && !(isOpen(x + dx, y) && isOpen(x, y + dy)))
+			continue;
+		cells[count] = (x + dx) + (y + dy) * size.x;
+		costs[count++] = (dx != 0 && dy != 0) ? PATH_DIAGONAL_COST : 1;
+	}
+	return count;
+}
+
+float Pathfinder::heuristic(int from, int to) const {
+	int x1 = from % size.x, y1 = from / size.x;
+	int x2 = to % size.x, y2 = to / size.x;
+	if(layout == PATH_HEX) {
+		int q1 = x1 - (y1 + (y1 & 1)) / 2;
+		int q2 = x2 - (y2 + (y2 & 1)) / 2;
+		int dq = q2 - q1, dr = y2 - y1;
+		return (std::abs(dq) + std::abs(dr) + std::abs(dq + dr)) / 2;
+	}
+
+	int dx = std::abs(x2 - x1), dy = std::abs(y2 - y1);
+	if(layout == PATH_SQUARE)
+		return dx + dy;
+	return std::max(dx, dy) + (PATH_DIAGONAL_COST - 1) * std::min(dx, dy);
+}
+
+//New stamp instead of clearing every array
+void Pathfinder::beginSearch() {
+	if(++searchId == 0) {
+		std::fill(visited.begin(), visited.end(), 0);
+		std::fill(closed.begin(), closed.end(), 0);
+		searchId = 1;
+	}
+	heap.clear();
+}
+
+bool Pathfinder::relax(int cell, int from, float value, float estimate) {
+	if(closed[cell] == searchId || (visited[cell] == searchId && cost[cell] <= value))
+		return false;
+	visited[cell] = searchId;
+	cost[cell] = value;
+	parent[cell] = from;
+	heap.emplace_back(-(value + estimate), cell);
+	std::push_heap(heap.begin(), heap.end());
+	return true;
+}
+
+//Next unclosed cell, skipping outdated heap entries
+int Pathfinder::popOpen() {
+	while(!heap.empty()) {
+		std::pop_heap(heap.begin(), heap.end());
+		int cell = heap.back().second;
+		heap.pop_back();
+		if(closed[cell] != searchId) {
+			closed[cell] = searchId;
+			expanded++;
+			return cell;
+		}
+	}
+	return -1;
+}
+
+bool Pathfinder::search(int start, int goal, IntRect bounds) {
+	beginSearch();
+	relax(start, -1, 0, (goal == -1) ? 0 : heuristic(start, goal));
+
+	int cells[8];
+	float costs[8];
+	int cell;
+	while((cell = popOpen()) != -1) {
+		if(cell == goal)
+			return true;
+
+		int count = neighbors(cell % size.x, cell / size.x, cells, costs);
+		for(int i = 0; i < count; i++)
+			if(inArea(bounds, cells[i] % size.x, cells[i] / size.x))
+				relax(cells[i], cell, cost[cell] + costs[i], (goal == -1) ? 0 : heuristic(cells[i], goal));
+	}
+	return goal == -1;
+}
+
+//Follow parents back from goal, filling in straight runs between jump points
+void Pathfinder::readPath(int start, int goal, std::vector<Vector2i> &path, bool append) {
+	size_t first = path.size();
+	for(int cell = goal; cell != -1 && cell != start; cell = parent[cell]) {
+		int x = cell % size.x, y = cell / size.x;
+		int px = parent[cell] % size.x, py = parent[cell] / size.x;
+		int dx = sign(px - x), dy = sign(py - y);
+		while(x != px || y != py) {
+			path.emplace_back(x, y);
+			if(layout == PATH_HEX)
+				break;
+			x += (x != px) ? dx : 0;
+			y += (y != py) ? dy : 0;
+		}
+	}
+	if(!append)
+		path.emplace_back(start % size.x, start / size.x);
+	std::reverse(path.begin() + first, path.end());
+}
+
+bool Pathfinder::findPath(Vector2i start, Vector2i goal, std::vector<Vector2i> &path) {
+	refresh();
+	path.clear();
+	expanded = 0;
+	if(!isOpen(start.x, start.y) || !isOpen(goal.x, goal.y))
+		return false;
+
+	int from = start.x + start.y * size.x;
+	int to = goal.x + goal.y * size.x;
+	if(!search(from, to, IntRect(0, 0, size.x, size.y)))
+		return false;
+	readPath(from, to, path, false);
+	return true;
+}
+
+//Move straight until blocked, or a wall opens up beside the line
+int Pathfinder::jumpStraight(int x, int y, int dx, int dy, int goal) const {
+	while(true) {
+		x += dx;
+		y += dy;
+		if(!isOpen(x, y))
+			return -1;
+		int cell = x + y * size.x;
+		if(cell == goal)
+			return cell;
+
+		if(dx != 0) {
+			if((isOpen(x, y - 1) && !isOpen(x - dx, y - 1)) || (isOpen(x, y + 1) && !isOpen(x - dx, y + 1)))
+				return cell;
+		} else {
+			if((isOpen(x - 1, y) && !isOpen(x - 1, y - dy)) || (isOpen(x + 1, y) && !isOpen(x + 1, y - dy)))
+				return cell;
+		}
+	}
+}
+
+//Move diagonally, stopping where either straight component finds a jump point
+int Pathfinder::jumpDiagonal(int x, int y, int dx, int dy, int goal) const {
+	while(true) {
+		if(!isOpen(x + dx, y) || !isOpen(x, y + dy))
+			return -1;
+		x += dx;
+		y += dy;
+		if(!isOpen(x, y))
+			return -1;
+		int cell = x + y * size.x;
+		if(cell == goal || jumpStraight(x, y, dx, 0, goal) != -1 || jumpStraight(x, y, 0, dy, goal) != -1)
+			return cell;
+	}
+}
+
+//Pruned directions from a jump point, given as neighboring cells
+int Pathfinder::jumpSuccessors(int cell, int *cells) const {
+	int x = cell % size.x, y = cell / size.x;
+	int count = 0;
+	if(parent[cell] == -1) {
+		float costs[8];
+		return neighbors(x, y, cells, costs);
+	}
+
+	int dx = sign(x - parent[cell] % size.x);
+	int dy = sign(y - parent[cell] / size.x);
+	if(dx != 0 && dy != 0) {
+		if(isOpen(x, y + dy))
+			cells[count++] = x + (y + dy) * size.x;
+		if(isOpen(x + dx, y))
+			cells[count++] = (x + dx) + y * size.x;
+		if(isOpen(x, y + dy) && isOpen(x + dx, y) && isOpen(x + dx, y + dy))
+			cells[count++] = (x + dx) + (y + dy) * size.x;
+	} else if(dx != 0) {
+		bool up = isOpen(x, y - 1), down = isOpen(x, y + 1);
+		if(isOpen(x + dx, y)) {
+			cells[count++] = (x + dx) + y * size.x;
+			if(up && isOpen(x + dx, y - 1))
+				cells[count++] = (x + dx) + (y - 1) * size.x;
+			if(down && isOpen(x + dx, y + 1))
+				cells[count++] = (x + dx) + (y + 1) * size.x;
+		}
+		if(up)
+			cells[count++] = x + (y - 1) * size.x;
+		if(down)
+			cells[count++] = x + (y + 1) * size.x;
+	} else {
+		bool left = isOpen(x - 1, y), right = isOpen(x + 1, y);
+		if(isOpen(x, y + dy)) {
+			cells[count++] = x + (y + dy) * size.x;
+			if(left && isOpen(x - 1, y + dy))
+				cells[count++] = (x - 1) + (y + dy) * size.x;
+			if(right && isOpen(x + 1, y + dy))
+				cells[count++] = (x + 1) + (y + dy) * size.x;
+		}
+		if(left)
+			cells[count++] = (x - 1) + y * size.x;
+		if(right)
+			cells[count++] = (x + 1) + y * size.x;
+	}
+	return count;
+}
+
+bool Pathfinder::findJumpPath(Vector2i start, Vector2i goal, std::vector<Vector2i> &path) {
+	if(layout != PATH_DIAGONAL)
+		return findPath(start, goal, path);
+
+	refresh();
+	path.clear();
+	expanded = 0;
+	if(!isOpen(start.x, start.y) || !isOpen(goal.x, goal.y))
+		return false;
+
+	int from = start.x + start.y * size.x;
+	int to = goal.x + goal.y * size.x;
+	beginSearch();
+	relax(from, -1, 0, heuristic(from, to));
+
+	int cells[8];
+	int cell;
+	while((cell = popOpen()) != -1) {
+		if(cell == to) {
+			readPath(from, to, path, false);
+			return true;
+		}
+
+		int x = cell % size.x, y = cell / size.x;
+		int count = jumpSuccessors(cell, cells);
+		for(int i = 0; i < count; i++) {
+			int dx = cells[i] % size.x - x;
+			int dy = cells[i] / size.x - y;
+			int jump = (dx != 0 && dy != 0) ? jumpDiagonal(x, y, dx, dy, to) : jumpStraight(x, y, dx, dy, to);
+			if(jump != -1)
+				relax(jump, cell, cost[cell] + heuristic(cell, jump), heuristic(jump, to));
+		}
+	}
+	return false;
+}
+
+IntRect Pathfinder::clusterArea(int cluster) const {
+	int cx = cluster % clusterCount.x, cy = cluster / clusterCount.x;
+	int left = cx * clusterSize, top = cy * clusterSize;
+	return IntRect(left, top, std::min(clusterSize, size.x - left), std::min(clusterSize, size.y - top));
+}
+
+int Pathfinder::clusterOf(int cell) const {
+	return (cell % size.x) / clusterSize + (cell / size.x) / clusterSize * clusterCount.x;
+}
+
+int Pathfinder::findNode(int cluster, int cell) const {
+	const std::vector<int> &nodes = clusters[cluster].nodes;
+	for(int i = 0; i < (int)nodes.size(); i++)
+		if(nodes[i] == cell)
+			return i;
+	return -1;
+}
+
+bool Pathfinder::isNeighbor(int a, int b) const {
+	int cells[8];
+	float costs[8];
+	int count = neighbors(a % size.x, a / size.x, cells, costs);
+	return std::find(cells, cells + count, b) != cells + count;
+}
+
+//Entrances from a cluster into each later cluster, one per short run of links or one at each end of long runs
+//Links come from the same neighbors as searches, so diagonal and hex steps across an edge or corner count too
+void Pathfinder::buildBorder(int cluster) {
+	std::vector<std::pair<int, int>> &border = borders[cluster];
+	border.clear();
+
+	IntRect area = clusterArea(cluster);
+	int right = area.left + area.width - 1, bottom = area.top + area.height - 1;
+	int cx = cluster % clusterCount.x, cy = cluster / clusterCount.x;
+	int targets[4] = {cluster + 1, cluster + clusterCount.x - 1, cluster + clusterCount.x, cluster + clusterCount.x + 1};
+	bool valid[4] = {cx + 1 < clusterCount.x, cx > 0 && cy + 1 < clusterCount.y,
+		cy + 1 < clusterCount.y, cx + 1 < clusterCount.x && cy + 1 < clusterCount.y};
+
+	int cells[8];
+	float costs[8];
+	std::vector<std::pair<int, int>> links;
+	for(int t = 0; t < 4; t++) {
+		if(!valid[t])
+			continue;
+
+		//East column, bottom row or a single corner, with links kept in order along the edge
+		IntRect edge = (t == 0) ? IntRect(right, area.top, 1, area.height) :
+			(t == 1) ? IntRect(area.left, bottom, 1, 1) :
+			(t == 2) ? IntRect(area.left, bottom, area.width, 1) : IntRect(right, bottom, 1, 1);
+		links.clear();
+		for(int y = edge.top; y < edge.top + edge.height; y++) {
+			for(int x = edge.left; x < edge.left + edge.width; x++) {
+				if(!isOpen(x, y))
+					continue;
+				size_t start = links.size();
+				int count = neighbors(x, y, cells, costs);
+				for(int i = 0; i < count; i++)
+					if(clusterOf(cells[i]) == targets[t])
+						links.emplace_back(x + y * size.x, cells[i]);
+				std::sort(links.begin() + start, links.end());
+			}
+		}
+
+		//Runs of links connected on both sides can share one entrance, measured in edge cells
+		int first = 0, run = 0;
+		for(int i = 0; i <= (int)links.size(); i++) {
+			if(i > 0 && i < (int)links.size()) {
+				auto &prev = links[i - 1], &next = links[i];
+				if((prev.first == next.first || isNeighbor(prev.first, next.first)) &&
+					(prev.second == next.second || isNeighbor(prev.second, next.second))) {
+					run += prev.first != next.first;
+					continue;
+				}
+			}
+			if(i > 0) {
+				if(run < 6)
+					border.push_back(links[(first + i - 1) / 2]);
+				else {
+					border.push_back(links[first]);
+					border.push_back(links[i - 1]);
+				}
+			}
+			first = i;
+			run = 1;
+		}
+	}
+}
+
+//Collect nodes from the links of this cluster and the earlier clusters around it, then costs between each pair inside the cluster
+void Pathfinder::buildCluster(int cluster) {
+	PathCluster &target = clusters[cluster];
+	target.nodes.clear();
+	target.partners.clear();
+
+	int cx = cluster % clusterCount.x, cy = cluster / clusterCount.x;
+	auto addNode = [&](int cell, int partner) {
+		int i = findNode(cluster, cell);
+		if(i == -1) {
+			i = target.nodes.size();
+			target.nodes.push_back(cell);
+			target.partners.emplace_back();
+		}
+		target.partners[i].push_back(partner);
+	};
+	for(auto &entrance : borders[cluster])
+		addNode(entrance.first, entrance.second);
+	for(int dy = -1; dy <= 0; dy++) {
+		for(int dx = -1; dx <= 1; dx++) {
+			if((dy == 0 && dx >= 0) || cx + dx < 0 || cx + dx >= clusterCount.x || cy + dy < 0)
+				continue;
+			for(auto &entrance : borders[cluster + dx + dy * clusterCount.x])
+				if(clusterOf(entrance.second) == cluster)
+					addNode(entrance.second, entrance.first);
+		}
+	}
+
+	int count = target.nodes.size();
+	target.distances.assign(count * count, PATH_INFINITY);
+	IntRect area = clusterArea(cluster);
+	for(int i = 0; i < count; i++) {
+		search(target.nodes[i], -1, area);
+		for(int j = 0; j < count; j++)
+			if(visited[target.nodes[j]] == searchId)
+				target.distances[i * count + j] = cost[target.nodes[j]];
+	}
+	target.dirty = false;
+}
+
+//Rebuild borders and nodes of changed clusters and every cluster around them
+void Pathfinder::repairHierarchy() {
+	if(!hierarchyBuilt) {
+		int count = clusterCount.x * clusterCount.y;
+		clusters.assign(count, PathCluster());
+		borders.assign(count, {});
+		hierarchyBuilt = true;
+	}
+
+	//A link through a changed cell, as an end or a diagonal corner, joins two clusters around it
+	std::vector<bool> rebuild(clusters.size(), false);
+	for(int c = 0; c < (int)clusters.size(); c++) {
+		if(!clusters[c].dirty)
+			continue;
+		int cx = c % clusterCount.x, cy = c / clusterCount.x;
+		for(int dy = -1; dy <= 1; dy++)
+			for(int dx = -1; dx <= 1; dx++)
+				if(cx + dx >= 0 && cy + dy >= 0 && cx + dx < clusterCount.x && cy + dy < clusterCount.y)
+					rebuild[c + dx + dy * clusterCount.x] = true;
+	}
+	for(int c = 0; c < (int)clusters.size(); c++)
+		if(rebuild[c])
+			buildBorder(c);
+	for(int c = 0; c < (int)clusters.size(); c++)
+		if(rebuild[c])
+			buildCluster(c);
+}
+
+bool Pathfinder::findHierarchicalPath(Vector2i start, Vector2i goal, std::vector<Vector2i> &path) {
+	refresh();
+	path.clear();
+	expanded = 0;
+	repairHierarchy();
+	if(!isOpen(start.x, start.y) || !isOpen(goal.x, goal.y))
+		return false;
+
+	int from = start.x + start.y * size.x;
+	int to = goal.x + goal.y * size.x;
+	int startCluster = clusterOf(from);
+	int goalCluster = clusterOf(to);
+	PathCluster &first = clusters[startCluster];
+	PathCluster &last = clusters[goalCluster];
+
+	//Connect start and goal to the nodes of their clusters
+	float direct = PATH_INFINITY;
+	search(from, -1, clusterArea(startCluster));
+	startDistances.assign(first.nodes.size(), PATH_INFINITY);
+	for(int i = 0; i < (int)first.nodes.size(); i++)
+		if(visited[first.nodes[i]] == searchId)
+			startDistances[i] = cost[first.nodes[i]];
+	if(startCluster == goalCluster && visited[to] == searchId)
+		direct = cost[to];
+
+	search(to, -1, clusterArea(goalCluster));
+	goalDistances.assign(last.nodes.size(), PATH_INFINITY);
+	for(int i = 0; i < (int)last.nodes.size(); i++)
+		if(visited[last.nodes[i]] == searchId)
+			goalDistances[i] = cost[last.nodes[i]];
+
+	//Search abstract graph of cluster nodes
+	beginSearch();
+	relax(from, -1, 0, heuristic(from, to));
+	if(direct != PATH_INFINITY)
+		relax(to, from, direct, 0);
+
+	bool found = false;
+	int cell;
+	while((cell = popOpen()) != -1) {
+		if(cell == to) {
+			found = true;
+			break;
+		}
+
+		if(cell == from)
+			for(int i = 0; i < (int)first.nodes.size(); i++)
+				if(startDistances[i] != PATH_INFINITY)
+					relax(first.nodes[i], cell, startDistances[i], heuristic(first.nodes[i], to));
+
+		int c = clusterOf(cell);
+		int node = findNode(c, cell);
+		if(node == -1)
+			continue;
+
+		PathCluster &current = clusters[c];
+		int count = current.nodes.size();
+		for(int j = 0; j < count; j++) {
+			float distance = current.distances[node * count + j];
+			if(j != node && distance != PATH_INFINITY)
+				relax(current.nodes[j], cell, cost[cell] + distance, heuristic(current.nodes[j], to));
+		}
+		for(int partner : current.partners[node])
+			relax(partner, cell, cost[cell] + heuristic(cell, partner), heuristic(partner, to));
+		if(c == goalCluster) {
+			int i = findNode(goalCluster, cell);
+			if(goalDistances[i] != PATH_INFINITY)
+				relax(to, cell, cost[cell] + goalDistances[i], 0);
+		}
+	}
+	if(!found)
+		return false;
+
+	abstractPath.clear();
+	for(int step = to; step != -1; step = parent[step])
+		abstractPath.push_back(step);
+	std::reverse(abstractPath.begin(), abstractPath.end());
+
+	//Refine each abstract step inside its cluster
+	path.emplace_back(start);
+	for(int i = 1; i < (int)abstractPath.size(); i++) {
+		int a = abstractPath[i - 1], b = abstractPath[i];
+		if(clusterOf(a) != clusterOf(b)) {
+			path.emplace_back(b % size.x, b / size.x);
+			continue;
+		}
+		search(a, b, clusterArea(clusterOf(a)));
+		readPath(a, b, path, true);
+	}
+	smooth(path, 0);
+	smooth(path, clusterSize);
+	return true;
+}
+
+//Search again between points two clusters apart along the path, inside the area around that stretch
+void Pathfinder::smooth(std::vector<Vector2i> &path, int offset) {
+	int window = clusterSize * 2;
+	smoothPath.clear();
+	smoothPath.insert(smoothPath.end(), path.begin(), path.begin() + std::min(offset + 1, (int)path.size()));
+	for(int s = offset; s < (int)path.size() - 1; s += window) {
+		int e = std::min(s + window, (int)path.size() - 1);
+		int left = path[s].x, top = path[s].y, right = left, bottom = top;
+		float length = 0;
+		for(int i = s + 1; i <= e; i++) {
+			left = std::min(left, path[i].x);
+			top = std::min(top, path[i].y);
+			right = std::max(right, path[i].x);
+			bottom = std::max(bottom, path[i].y);
+			length += heuristic(path[i - 1].x + path[i - 1].y * size.x, path[i].x + path[i].y * size.x);
+		}
+
+		int margin = clusterSize / 2;
+		left = std::max(left - margin, 0);
+		top = std::max(top - margin, 0);
+		right = std::min(right + margin, size.x - 1);
+		bottom = std::min(bottom + margin, size.y - 1);
+		int a = path[s].x + path[s].y * size.x, b = path[e].x + path[e].y * size.x;
+		if(search(a, b, IntRect(left, top, right - left + 1, bottom - top + 1)) && cost[b] + 0.001f < length)
+			readPath(a, b, smoothPath, true);
+		else
+			smoothPath.insert(smoothPath.end(), path.begin() + s + 1, path.begin() + e + 1);
+	}
+	path.swap(smoothPath);
+}
+
+int Pathfinder::countClusterNodes() {
+	int count = 0;
+	for(PathCluster &cluster : clusters)
+		count += cluster.nodes.size();
+	return count;
+}
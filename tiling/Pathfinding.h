@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "GridMaker.h"
+
+/*
+ * Grid pathfinding over a collision indexer, with search state reused between queries
+ */
+
+enum PathLayout {
+	PATH_AUTO,
+	PATH_SQUARE,
+	PATH_DIAGONAL,
+	PATH_HEX
+};
+
+//Abstract nodes of one cluster for hierarchical search
+struct PathCluster {
+	std::vector<int> nodes;
+	std::vector<std::vector<int>> partners;
+	std::vector<float> distances;
+	bool dirty = true;
+};
+
+class Pathfinder {
+private:
+	Indexer *collision;
+	std::function<bool(int)> passable;
+	int layout;
+
+	Vector2i size;
+	std::vector<uint8_t> open;
+	uint gridVersion = 0;
+
+	//Search state, only valid for cells stamped with the current search
+	std::vector<float> cost;
+	std::vector<int> parent;
+	std::vector<uint> visited;
+	std::vector<uint> closed;
+	std::vector<std::pair<float, int>> heap;
+	uint searchId = 0;
+	int expanded = 0;
+
+	//Hierarchy, built on first hierarchical query
+	int clusterSize;
+	Vector2i clusterCount;
+	std::vector<PathCluster> clusters;
+	//Links from each cluster into the east, south and lower corner clusters
+	std::vector<std::vector<std::pair<int, int>>> borders;
+	bool hierarchyBuilt = false;
+	std::vector<float> startDistances;
+	std::vector<float> goalDistances;
+	std::vector<int> abstractPath;
+	std::vector<Vector2i> smoothPath;
+
+	bool isOpen(int x, int y) const {
+		return x >= 0 && y >= 0 && x < size.x && y < size.y && open[x + y * size.x];
+	}
+
+	int neighbors(int x, int y, int *cells, float *costs) const;
+	float heuristic(int from, int to) const;
+	void beginSearch();
+	bool relax(int cell, int from, float value, float estimate);
+	int popOpen();
+	void readPath(int start, int goal, std::vector<Vector2i> &path, bool append);
+
+	//A* inside bounds, or costs to every reachable cell when goal is -1
+	bool search(int start, int goal, IntRect bounds);
+
+	//Jump point search helpers
+	int jumpStraight(int x, int y, int dx, int dy, int goal) const;
+	int jumpDiagonal(int x, int y, int dx, int dy, int goal) const;
+	int jumpSuccessors(int cell, int *cells) const;
+
+	//Hierarchy helpers
+	IntRect clusterArea(int cluster) const;
+	int clusterOf(int cell) const;
+	int findNode(int cluster, int cell) const;
+	bool isNeighbor(int a, int b) const;
+	void buildBorder(int cluster);
+	void buildCluster(int cluster);
+	void repairHierarchy();
+	void smooth(std::vector<Vector2i> &path, int offset);
+
+public:
+	//Tiles passing the predicate can be walked through, by default EMPTY collision tiles
+	Pathfinder(Indexer *_collision, std::function<bool(int)> _passable=[](int c) { return c == 0; },
+		int _layout=PATH_AUTO, int _clusterSize=16);
+
+	//Apply collision changes, called automatically by each query
+	void refresh();
+
+	//Paths include both start and goal, and are empty when no path exists
+	bool findPath(Vector2i start, Vector2i goal, std::vector<Vector2i> &path);
+
+	//Jump point search, for square grids with diagonals and uniform costs, otherwise A*
+	bool findJumpPath(Vector2i start, Vector2i goal, std::vector<Vector2i> &path);
+
+	//Search across clusters first, then refine each step and shortcut detours through cluster entrances
+	//Not guaranteed shortest, about 1% longer than findPath on average but a third longer or worse around clutter
+	bool findHierarchicalPath(Vector2i start, Vector2i goal, std::vector<Vector2i> &path);
+
+	bool isPassable(Vector2i cell) {
+		refresh();
+		return isOpen(cell.x, cell.y);
+	}
+
+	int getLayout() {
+		return layout;
+	}
+
+	//Cells expanded by the last query
+	int getExpanded() {
+		return expanded;
+	}
+
+	int countClusterNodes();
+};
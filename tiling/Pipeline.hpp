@@ -0,0 +1,208 @@
+#pragma once
+
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include "GridMaker.h"
+
+/*
+ * Indexer stacks composed at compile time, so a whole chain inlines into one loop
+ */
+
+//Read tiles straight from the rows of a grid
+class GridSource {
+private:
+	GridMaker *grid;
+
+public:
+	GridSource(GridMaker *_grid) : grid(_grid) {
+
+	}
+
+	Indexer *getIndexer() const {
+		return grid;
+	}
+
+	//Fill one row of an in bounds area
+	void readRow(int x, int y, int width, int *values) const {
+		const int *row = grid->getRow(y) + x;
+		std::copy(row, row + width, values);
+	}
+};
+
+//Read tiles through any indexer stack
+class IndexerSource {
+private:
+	Indexer *indexer;
+
+public:
+	IndexerSource(Indexer *_indexer) : indexer(_indexer) {
+
+	}
+
+	Indexer *getIndexer() const {
+		return indexer;
+	}
+
+	void readRow(int x, int y, int width, int *values) const {
+		indexer->getBlock(IntRect(x, y, width, 1), values, width);
+	}
+};
+
+//Same as MapIndexer
+class MapStage {
+private:
+	std::map<int, int> indexes;
+	MapTable table;
+	int fallback;
+	bool keepOthers;
+
+public:
+	MapStage(std::map<int, int> _indexes, int _fallback, bool _keepOthers=false)
+		: indexes(_indexes), table(indexes), fallback(_fallback), keepOthers(_keepOthers) {
+
+	}
+
+	int map(int c, int x, int y) const {
+		if(!table.empty()) {
+			int value = table.find(c);
+			if(value != MAP_TABLE_MISSING)
+				return value;
+			return keepOthers ? c : fallback;
+		}
+
+		auto tile = indexes.find(c);
+		if(tile != indexes.end())
+			return tile->second;
+		return keepOthers ? c : fallback;
+	}
+};
+
+//Same as LinearIndexer
+class LinearStage {
+private:
+	float multiplier;
+	int adder;
+
+public:
+	LinearStage(float _multiplier, int _adder) : multiplier(_multiplier), adder(_adder) {
+
+	}
+
+	int map(int c, int x, int y) const {
+		return c * multiplier + adder;
+	}
+};
+
+//Same as FuncIndexer, keeping the function type so it can be inlined
+template <typename F>
+class FuncStage {
+private:
+	F func;
+
+public:
+	FuncStage(F _func) : func(_func) {
+
+	}
+
+	int map(int c, int x, int y) const {
+		return func(c);
+	}
+};
+
+//Function with tile position
+template <typename F>
+class PositionStage {
+private:
+	F func;
+
+public:
+	PositionStage(F _func) : func(_func) {
+
+	}
+
+	int map(int c, int x, int y) const {
+		return func(c, x, y);
+	}
+};
+
+//Source followed by each stage in order, at 1x1 scale
+template <typename Source, typename... Stages>
+class Pipeline {
+private:
+	Source source;
+	std::tuple<Stages...> stages;
+
+	template <std::size_t I = 0>
+	int apply(int c, int x, int y) const {
+		if constexpr(I == sizeof...(Stages))
+			return c;
+		else
+			return apply<I + 1>(std::get<I>(stages).map(c, x, y), x, y);
+	}
+
+public:
+	Pipeline(Source _source, Stages... _stages) : source(_source), stages(_stages...) {
+
+	}
+
+	Indexer *getSource() const {
+		return source.getIndexer();
+	}
+
+	//Run stages on a source tile
+	int mapTile(int c, int x, int y) const {
+		return apply(c, x, y);
+	}
+
+	//Evaluate area that is inside the source grid
+	void getBlock(IntRect area, int *values, int stride) const {
+		for(int y = 0; y < area.height; y++) {
+			int *row = values + y * stride;
+			source.readRow(area.left, area.top + y, area.width, row);
+			for(int x = 0; x < area.width; x++)
+				row[x] = apply(row[x], area.left + x, area.top + y);
+		}
+	}
+
+	int getTileI(int x, int y) const {
+		int c;
+		source.readRow(x, y, 1, &c);
+		return apply(c, x, y);
+	}
+};
+
+//Wraps a pipeline for use anywhere an indexer is expected
+template <typename P>
+class PipelineIndexer : public Indexer {
+private:
+	P pipeline;
+
+public:
+	PipelineIndexer(P _pipeline, int fallback)
+		: Indexer(_pipeline.getSource(), fallback, Vector2i(1, 1)), pipeline(_pipeline) {
+
+	}
+
+	int getTileI(int x, int y) override {
+		if(inBounds(x, y))
+			return pipeline.getTileI(x, y);
+		return fallback;
+	}
+
+	int mapTileI(int c, int x, int y) override {
+		return pipeline.mapTile(c, x, y);
+	}
+
+	void getBlock(IntRect area, int *values, int stride) override {
+		if(area.left < 0 || area.top < 0 || area.left + area.width > getSize().x || area.top + area.height > getSize().y)
+			Indexer::getBlock(area, values, stride);
+		else
+			pipeline.getBlock(area, values, stride);
+	}
+
+	P &getPipeline() {
+		return pipeline;
+	}
+};
@@ -0,0 +1,396 @@
+#include "Raycast.h"
+#include "../core/UpdateList.h"
+#include "../util/Parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RAYCAST_X86
+#include <immintrin.h>
+#endif
+
+#define RAY_INFINITY std::numeric_limits<float>::infinity()
+#define RAY_BATCH 256
+
+//Stepping state of one ray, in tile space with distances in world units
+struct RayState {
+	int cellX, cellY;
+	int stepX, stepY;
+	float maxX, maxY;
+	float deltaX, deltaY;
+	float maxDistance;
+
+	//Filled in once the ray stops
+	bool done;
+	bool hit;
+	float distance;
+	int hitX, hitY;
+	int normalX, normalY;
+};
+
+static void finishRay(RayState &state, bool hit, float distance, int x, int y, int normalX, int normalY) {
+	state.done = true;
+	state.hit = hit;
+	state.distance = distance;
+	state.hitX = x;
+	state.hitY = y;
+	state.normalX = normalX;
+	state.normalY = normalY;
+}
+
+//Start a ray at its first tile inside the grid, finishing early if it never needs to step
+static void setupRay(const Ray &ray, Vector2i size, Vector2i scale, bool fallbackBlocks,
+	const uint8_t *solid, Vector2f &direction, RayState &state) {
+
+	state.done = false;
+	state.maxDistance = ray.maxDistance;
+	float length = std::sqrt(ray.direction.x * ray.direction.x + ray.direction.y * ray.direction.y);
+	if(length == 0) {
+		direction = Vector2f(0, 0);
+		finishRay(state, false, 0, -1, -1, 0, 0);
+		return;
+	}
+	direction = Vector2f(ray.direction.x / length, ray.direction.y / length);
+
+	float ox = ray.origin.x / scale.x, oy = ray.origin.y / scale.y;
+	float dx = direction.x / scale.x, dy = direction.y / scale.y;
+	state.stepX = (dx > 0) - (dx < 0);
+	state.stepY = (dy > 0) - (dy < 0);
+	state.deltaX = (dx != 0) ? std::abs(1 / dx) : RAY_INFINITY;
+	state.deltaY = (dy != 0) ? std::abs(1 / dy) : RAY_INFINITY;
+
+	//Clip to grid bounds for rays starting outside
+	float start = 0;
+	int normalX = 0, normalY = 0;
+	bool inside = ox >= 0 && oy >= 0 && ox < size.x && oy < size.y;
+	if(!inside) {
+		if(fallbackBlocks) {
+			finishRay(state, true, 0, std::floor(ox), std::floor(oy), 0, 0);
+			return;
+		}
+
+		float enterX = -RAY_INFINITY, exitX = RAY_INFINITY;
+		float enterY = -RAY_INFINITY, exitY = RAY_INFINITY;
+		if(dx != 0) {
+			enterX = std::min(-ox / dx, (size.x - ox) / dx);
+			exitX = std::max(-ox / dx, (size.x - ox) / dx);
+		} else if(ox < 0 || ox >= size.x)
+			exitX = -RAY_INFINITY;
+		if(dy != 0) {
+			enterY = std::min(-oy / dy, (size.y - oy) / dy);
+			exitY = std::max(-oy / dy, (size.y - oy) / dy);
+		} else if(oy < 0 || oy >= size.y)
+			exitY = -RAY_INFINITY;
+
+		start = std::max(enterX, enterY);
+		if(start > std::min(exitX, exitY) || start < 0 || start > ray.maxDistance) {
+			finishRay(state, false, ray.maxDistance, -1, -1, 0, 0);
+			return;
+		}
+		if(enterX > enterY)
+			normalX = -state.stepX;
+		else
+			normalY = -state.stepY;
+	}
+
+	float px = ox + dx * start, py = oy + dy * start;
+	state.cellX = std::clamp((int)std::floor(px), 0, size.x - 1);
+	state.cellY = std::clamp((int)std::floor(py), 0, size.y - 1);
+	if(solid[state.cellX + state.cellY * size.x]) {
+		finishRay(state, true, start, state.cellX, state.cellY, normalX, normalY);
+		return;
+	}
+
+	state.maxX = (dx > 0) ? start + (state.cellX + 1 - px) * state.deltaX :
+		(dx < 0) ? start + (px - state.cellX) * state.deltaX : RAY_INFINITY;
+	state.maxY = (dy > 0) ? start + (state.cellY + 1 - py) * state.deltaY :
+		(dy < 0) ? start + (py - state.cellY) * state.deltaY : RAY_INFINITY;
+}
+
+//Amanatides and Woo stepping, always crossing whichever tile edge is closer
+static void stepRay(RayState &state, Vector2i size, bool fallbackBlocks, const uint8_t *solid) {
+	while(!state.done) {
+		float distance;
+		int normalX = 0, normalY = 0;
+		if(state.maxX < state.maxY) {
+			distance = state.maxX;
+			state.maxX += state.deltaX;
+			state.cellX += state.stepX;
+			normalX = -state.stepX;
+		} else {
+			distance = state.maxY;
+			state.maxY += state.deltaY;
+			state.cellY += state.stepY;
+			normalY = -state.stepY;
+		}
+
+		if(distance > state.maxDistance)
+			finishRay(state, false, state.maxDistance, -1, -1, 0, 0);
+		else if(state.cellX < 0 || state.cellY < 0 || state.cellX >= size.x || state.cellY >= size.y) {
+			if(fallbackBlocks)
+				finishRay(state, true, distance, state.cellX, state.cellY, normalX, normalY);
+			else
+				finishRay(state, false, state.maxDistance, -1, -1, 0, 0);
+		} else if(solid[state.cellX + state.cellY * size.x])
+			finishRay(state, true, distance, state.cellX, state.cellY, normalX, normalY);
+	}
+}
+
+#ifdef RAYCAST_X86
+
+//Step rays 8 lanes at a time, with each lane taking the next waiting ray as soon as its current one stops
+__attribute__((target("avx2")))
+static void stepRays8(RayState *states, int count, Vector2i size, bool fallbackBlocks, const uint8_t *solid) {
+	__m256i vCellX = _mm256_setzero_si256(), vCellY = vCellX, vStepX = vCellX, vStepY = vCellX, vActive = vCellX;
+	__m256 vMaxX = _mm256_setzero_ps(), vMaxY = vMaxX, vDeltaX = vMaxX, vDeltaY = vMaxX, vLimit = vMaxX;
+	__m256i vWidth = _mm256_set1_epi32(size.x), vHeight = _mm256_set1_epi32(size.y);
+	__m256i zero = _mm256_setzero_si256();
+	__m256i ones = _mm256_set1_epi32(-1);
+	__m256i laneIds = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	int lanes[8];
+	int next = 0;
+
+	int refill = 0xFF;
+	while(true) {
+		//Swap the next unfinished ray into each stopped lane, or leave it idle
+		for(int i = 0; refill != 0; i++, refill >>= 1) {
+			if(!(refill & 1))
+				continue;
+			while(next < count && states[next].done)
+				next++;
+			__m256i lane = _mm256_cmpeq_epi32(laneIds, _mm256_set1_epi32(i));
+			if(next >= count) {
+				lanes[i] = -1;
+				vActive = _mm256_andnot_si256(lane, vActive);
+				continue;
+			}
+
+			RayState &state = states[next];
+			lanes[i] = next++;
+			__m256 lanef = _mm256_castsi256_ps(lane);
+			vCellX = _mm256_blendv_epi8(vCellX, _mm256_set1_epi32(state.cellX), lane);
+			vCellY = _mm256_blendv_epi8(vCellY, _mm256_set1_epi32(state.cellY), lane);
+			vStepX = _mm256_blendv_epi8(vStepX, _mm256_set1_epi32(state.stepX), lane);
+			vStepY = _mm256_blendv_epi8(vStepY, _mm256_set1_epi32(state.stepY), lane);
+			vActive = _mm256_or_si256(vActive, lane);
+			vMaxX = _mm256_blendv_ps(vMaxX, _mm256_set1_ps(state.maxX), lanef);
+			vMaxY = _mm256_blendv_ps(vMaxY, _mm256_set1_ps(state.maxY), lanef);
+			vDeltaX = _mm256_blendv_ps(vDeltaX, _mm256_set1_ps(state.deltaX), lanef);
+			vDeltaY = _mm256_blendv_ps(vDeltaY, _mm256_set1_ps(state.deltaY), lanef);
+			vLimit = _mm256_blendv_ps(vLimit, _mm256_set1_ps(state.maxDistance), lanef);
+		}
+		if(_mm256_testz_si256(vActive, vActive))
+			break;
+
+		__m256 useX = _mm256_cmp_ps(vMaxX, vMaxY, _CMP_LT_OQ);
+		__m256i useXi = _mm256_castps_si256(useX);
+		__m256 distance = _mm256_blendv_ps(vMaxY, vMaxX, useX);
+		vMaxX = _mm256_blendv_ps(vMaxX, _mm256_add_ps(vMaxX, vDeltaX), useX);
+		vMaxY = _mm256_blendv_ps(_mm256_add_ps(vMaxY, vDeltaY), vMaxY, useX);
+		vCellX = _mm256_add_epi32(vCellX, _mm256_and_si256(useXi, vStepX));
+		vCellY = _mm256_add_epi32(vCellY, _mm256_andnot_si256(useXi, vStepY));
+
+		__m256i beyond = _mm256_castps_si256(_mm256_cmp_ps(distance, vLimit, _CMP_GT_OQ));
+		__m256i inside = _mm256_and_si256(
+			_mm256_and_si256(_mm256_cmpgt_epi32(vCellX, ones), _mm256_cmpgt_epi32(vWidth, vCellX)),
+			_mm256_and_si256(_mm256_cmpgt_epi32(vCellY, ones), _mm256_cmpgt_epi32(vHeight, vCellY)));
+		__m256i reading = _mm256_andnot_si256(beyond, _mm256_and_si256(vActive, inside));
+		__m256i index = _mm256_and_si256(_mm256_add_epi32(vCellX, _mm256_mullo_epi32(vCellY, vWidth)), reading);
+		__m256i tiles = _mm256_mask_i32gather_epi32(zero, (const int*)solid, index, reading, 1);
+		__m256i blocked = _mm256_andnot_si256(_mm256_cmpeq_epi32(_mm256_and_si256(tiles, _mm256_set1_epi32(0xFF)), zero), reading);
+		__m256i stopped = _mm256_and_si256(vActive, _mm256_or_si256(_mm256_or_si256(beyond, blocked), _mm256_xor_si256(inside, ones)));
+
+		//Copy out lanes that stopped this step
+		int mask = _mm256_movemask_ps(_mm256_castsi256_ps(stopped));
+		if(mask != 0) {
+			alignas(32) int cellX[8], cellY[8], isBeyond[8], isInside[8], isUseX[8];
+			alignas(32) float at[8];
+			_mm256_store_si256((__m256i*)cellX, vCellX);
+			_mm256_store_si256((__m256i*)cellY, vCellY);
+			_mm256_store_si256((__m256i*)isBeyond, beyond);
+			_mm256_store_si256((__m256i*)isInside, inside);
+			_mm256_store_si256((__m256i*)isUseX, useXi);
+			_mm256_store_ps(at, distance);
+
+			for(int i = 0; i < 8; i++) {
+				if(!(mask & (1 << i)))
+					continue;
+				RayState &state = states[lanes[i]];
+				int normalX = isUseX[i] ? -state.stepX : 0;
+				int normalY = isUseX[i] ? 0 : -state.stepY;
+				if(isBeyond[i] || (!isInside[i] && !fallbackBlocks))
+					finishRay(state, false, state.maxDistance, -1, -1, 0, 0);
+				else
+					finishRay(state, true, at[i], cellX[i], cellY[i], normalX, normalY);
+			}
+			refill = mask;
+		}
+	}
+}
+
+static bool raycastWide() {
+	static bool wide = __builtin_cpu_supports("avx2");
+	return wide;
+}
+
+#else
+
+static bool raycastWide() {
+	return false;
+}
+
+#endif
+
+Raycaster::Raycaster(Indexer *_grid, std::function<bool(int)> _blocking) : grid(_grid), blocking(_blocking) {
+	size = grid->getSize();
+	scale = grid->getScale();
+	fallbackBlocks = blocking(grid->fallback);
+
+	std::vector<int> tiles(size.x * size.y);
+	grid->getBlock(IntRect(0, 0, size.x, size.y), tiles.data(), size.x);
+	solid.assign(size.x * size.y + 4, 0);
+	for(int i = 0; i < size.x * size.y; i++)
+		solid[i] = blocking(tiles[i]);
+	gridVersion = grid->getUpdateCount();
+}
+
+void Raycaster::refresh() {
+	uint version = grid->getUpdateCount();
+	if(version == gridVersion)
+		return;
+
+	std::vector<int> tiles;
+	for(IntRect area : grid->getChanges(gridVersion, version)) {
+		int left = std::max(area.left, 0);
+		int top = std::max(area.top, 0);
+		int right = std::min(area.left + area.width, size.x);
+		int bottom = std::min(area.top + area.height, size.y);
+		if(left >= right || top >= bottom)
+			continue;
+
+		tiles.resize((right - left) * (bottom - top));
+		grid->getBlock(IntRect(left, top, right - left, bottom - top), tiles.data(), right - left);
+		for(int y = top; y < bottom; y++)
+			for(int x = left; x < right; x++)
+				solid[x + y * size.x] = blocking(tiles[(x - left) + (y - top) * (right - left)]);
+	}
+	gridVersion = version;
+}
+
+static RayHit makeHit(const Ray &ray, Vector2f direction, const RayState &state) {
+	RayHit result;
+	result.hit = state.hit;
+	result.distance = state.distance;
+	result.position = ray.origin + direction * state.distance;
+	if(state.hit) {
+		result.cell = Vector2i(state.hitX, state.hitY);
+		result.normal = Vector2i(state.normalX, state.normalY);
+	}
+	return result;
+}
+
+RayHit Raycaster::cast(const Ray &ray) {
+	refresh();
+	RayState state;
+	Vector2f direction;
+	setupRay(ray, size, scale, fallbackBlocks, solid.data(), direction, state);
+	stepRay(state, size, fallbackBlocks, solid.data());
+	return makeHit(ray, direction, state);
+}
+
+void Raycaster::cast(const std::vector<Ray> &rays, std::vector<RayHit> &hits, int threads) {
+	refresh();
+	hits.resize(rays.size());
+	bool wide = raycastWide();
+
+	parallelRange(rays.size(), threads, [&](int start, int end) {
+		std::vector<RayState> states(std::min(end - start, RAY_BATCH));
+		std::vector<Vector2f> directions(states.size());
+		for(int group = start; group < end; group += RAY_BATCH) {
+			int count = std::min(RAY_BATCH, end - group);
+			for(int i = 0; i < count; i++)
+				setupRay(rays[group + i], size, scale, fallbackBlocks, solid.data(), directions[i], states[i]);
+
+#ifdef RAYCAST_X86
+			if(wide)
+				stepRays8(states.data(), count, size, fallbackBlocks, solid.data());
+#endif
+			for(int i = 0; i < count; i++) {
+				stepRay(states[i], size, fallbackBlocks, solid.data());
+				hits[group + i] = makeHit(rays[group + i], directions[i], states[i]);
+			}
+		}
+	});
+}
+
+bool Raycaster::hasLineOfSight(Vector2f from, Vector2f to) {
+	Vector2f offset = to - from;
+	float length = std::sqrt(offset.x * offset.x + offset.y * offset.y);
+	return !cast(Ray(from, offset, length)).hit;
+}
+
+//Slab test against each rect, keeping the closest
+void raycastRects(const std::vector<Ray> &rays, const std::vector<FloatRect> &rects,
+	const std::vector<Node *> &nodes, std::vector<RayHit> &hits, int threads) {
+
+	hits.resize(rays.size());
+	parallelRange(rays.size(), threads, [&](int start, int end) {
+		for(int r = start; r < end; r++) {
+			const Ray &ray = rays[r];
+			float length = std::sqrt(ray.direction.x * ray.direction.x + ray.direction.y * ray.direction.y);
+			if(length == 0)
+				continue;
+			Vector2f direction = Vector2f(ray.direction.x / length, ray.direction.y / length);
+			float inverseX = 1 / direction.x, inverseY = 1 / direction.y;
+			float best = hits[r].hit ? hits[r].distance : ray.maxDistance;
+
+			int found = -1;
+			Vector2i normal;
+			for(int i = 0; i < (int)rects.size(); i++) {
+				const FloatRect &rect = rects[i];
+				float x1 = (rect.left - ray.origin.x) * inverseX;
+				float x2 = (rect.left + rect.width - ray.origin.x) * inverseX;
+				float y1 = (rect.top - ray.origin.y) * inverseY;
+				float y2 = (rect.top + rect.height - ray.origin.y) * inverseY;
+				float enterX = std::min(x1, x2), enterY = std::min(y1, y2);
+				float enter = std::max(enterX, enterY);
+				float exit = std::min(std::max(x1, x2), std::max(y1, y2));
+				if(exit < 0 || enter > exit || std::isnan(enter) || enter >= best)
+					continue;
+
+				if(enter <= 0) {
+					best = 0;
+					normal = Vector2i(0, 0);
+				} else {
+					best = enter;
+					normal = (enterX > enterY) ? Vector2i((direction.x > 0) ? -1 : 1, 0) : Vector2i(0, (direction.y > 0) ? -1 : 1);
+				}
+				found = i;
+			}
+
+			if(found != -1) {
+				RayHit &hit = hits[r];
+				hit.hit = true;
+				hit.distance = best;
+				hit.position = ray.origin + direction * best;
+				hit.cell = Vector2i(-1, -1);
+				hit.normal = normal;
+				hit.node = (found < (int)nodes.size()) ? nodes[found] : NULL;
+			}
+		}
+	});
+}
+
+void raycastNodes(const std::vector<Ray> &rays, int layer, std::vector<RayHit> &hits, int threads) {
+	std::vector<FloatRect> rects;
+	std::vector<Node *> nodes;
+	for(Node *node = UpdateList::getNode(layer); node != NULL; node = (Node *)node->getNext()) {
+		if(node->isDeleted())
+			continue;
+		rects.push_back(node->getRect());
+		nodes.push_back(node);
+	}
+	raycastRects(rays, rects, nodes, hits, threads);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "GridMaker.h"
+#include "../core/Node.h"
+
+/*
+ * Rays stepped through grid tiles one crossing at a time, for projectiles, lasers and sight checks
+ */
+
+//World space ray, direction doesn't need to be normalized
+struct Ray {
+	Vector2f origin;
+	Vector2f direction;
+	float maxDistance = 1e9;
+
+	Ray() {}
+	Ray(Vector2f _origin, Vector2f _direction, float _maxDistance=1e9)
+		: origin(_origin), direction(_direction), maxDistance(_maxDistance) {}
+};
+
+struct RayHit {
+	bool hit = false;
+	float distance = 0;
+	Vector2f position;
+
+	//Tile hit, and the side it was entered from, which is 0,0 if the ray started inside
+	Vector2i cell = Vector2i(-1, -1);
+	Vector2i normal;
+
+	//Set when a node was closer than any tile
+	Node *node = NULL;
+};
+
+class Raycaster {
+private:
+	Indexer *grid;
+	std::function<bool(int)> blocking;
+	Vector2i size;
+	Vector2i scale;
+	bool fallbackBlocks;
+	uint gridVersion = 0;
+
+	//One byte per tile, padded so 4 byte reads never pass the end
+	std::vector<uint8_t> solid;
+
+public:
+	//Tiles passing the predicate stop rays, by default any nonzero tile
+	Raycaster(Indexer *_grid, std::function<bool(int)> _blocking=[](int c) { return c != 0; });
+
+	//Apply grid changes, called automatically by each cast
+	void refresh();
+
+	RayHit cast(const Ray &ray);
+
+	//Cast many rays, 8 at a time with AVX2 when available, giving the same results as cast
+	void cast(const std::vector<Ray> &rays, std::vector<RayHit> &hits, int threads=1);
+
+	bool hasLineOfSight(Vector2f from, Vector2f to);
+};
+
+//Replace hits with any closer intersection against rects, with nodes matching rects by index
+void raycastRects(const std::vector<Ray> &rays, const std::vector<FloatRect> &rects,
+	const std::vector<Node *> &nodes, std::vector<RayHit> &hits, int threads=1);
+
+//Same against the collision boxes of every node in a layer, gathered once for all rays
+void raycastNodes(const std::vector<Ray> &rays, int layer, std::vector<RayHit> &hits, int threads=1);
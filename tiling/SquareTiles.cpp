@@ -1,5 +1,7 @@
 #include "SquareTiles.h"
 
+#include <fstream>
+
 //Concat 2 quad maps
 QuadMap operator+(const QuadMap &first, const QuadMap &second) {
 	QuadMap third;
@@ -146,11 +148,11 @@ SquareMap genSquareRotations(SquareMap squares, int size) {
 	return out;
 }
 
-//Read file into list of squares
+//Read file into list of squares, each resulting in its order in the file
 SquareMap readSquareFile(std::string filename) {
 	SquareMap out;
 
-	/*std::string line;
+	std::string line;
 	std::ifstream listFile(filename);
 	std::array<int,10> square = {0};
 
@@ -171,12 +173,13 @@ SquareMap readSquareFile(std::string filename) {
 				//std::cout << square << "\n";
 
 				SquareMap rotations = genSquareRotations(square, 0);
-				out.insert(out.begin(), rotations.begin(), rotations.end());
+				out.insert(out.end(), rotations.begin(), rotations.end());
+				square[9]++;
 				std::getline(listFile, line);
 			}
 		}
 	}
-	listFile.close();*/
+	listFile.close();
 	return out;
 }
 
@@ -1,5 +1,7 @@
 #include <algorithm>
 #include <array>
+#include <climits>
+#include <cstdint>
 #include <iostream>
 #include <unordered_map>
 #include <vector>
@@ -20,18 +22,26 @@ std::ostream& operator<<(std::ostream& os, const std::array<int,5> quad);
 QuadMap genQuadRotations(std::array<int,5> quads, int size);
 QuadMap genQuadRotations(QuadMap quads, int size);
 
+#define RULE_TABLE_SIZE (1 << 20)
+
+//Lexicographic ordering for use in std::map
 struct QuadCmp {
 	bool operator()(const std::array<int,4> &lhs, const std::array<int,4> &rhs) const {
-		return lhs[0] < rhs[0] || lhs[1] < rhs[1] || lhs[2] < rhs[2] || lhs[3] < rhs[3];
+		return std::lexicographical_compare(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
 	}
 };
 
-struct QuadHash {
-	std::size_t operator()(const std::array<int,4> &k) const {
-		return std::hash<int>()(k[0]) + std::hash<int>()(k[1]) * 31 +
-		std::hash<int>()(k[2]) * 37 + std::hash<int>()(k[3]) * 41;
+//Mix each tile so that rotations and swaps hash differently
+template <std::size_t N>
+struct TileArrayHash {
+	std::size_t operator()(const std::array<int,N> &k) const {
+		std::size_t h = 0;
+		for(int v : k)
+			h ^= std::hash<int>()(v) + 0x9e3779b97f4a7c15 + (h << 6) + (h >> 2);
+		return h;
 	}
 };
+typedef TileArrayHash<4> QuadHash;
 
 struct QuadEqual {
 	bool operator()(const std::array<int,4> &lhs, const std::array<int,4> &rhs) const {
@@ -39,24 +49,137 @@ struct QuadEqual {
 	}
 };
 
+enum RuleTableMode {
+	RULE_DENSE,
+	RULE_PACKED,
+	RULE_SPARSE
+};
+
+//Rules matching N tiles, compiled to a flat table over a palette of used tiles
+template <std::size_t N>
+class TileRuleTable {
+private:
+	//Tile value to palette index, 0 for tiles not in any rule
+	std::vector<int> paletteTable;
+	int paletteStart = 0;
+	std::unordered_map<int, int> palette;
+	uint64_t base = 1;
+
+	//Packed palette key to result
+	int mode = RULE_SPARSE;
+	std::vector<int> results;
+	std::vector<uint32_t> dense;
+	std::unordered_map<uint64_t, int> packed;
+	std::unordered_map<std::array<int,N>, int, TileArrayHash<N>> sparse;
+
+	int paletteIndex(int c) const {
+		if(!paletteTable.empty()) {
+			unsigned int i = c - paletteStart;
+			return i < paletteTable.size() ? paletteTable[i] : 0;
+		}
+		auto index = palette.find(c);
+		return index != palette.end() ? index->second : 0;
+	}
+
+public:
+	//Later rules replace earlier ones with the same tiles
+	void build(const std::vector<std::array<int,N+1>> &rules) {
+		int minTile = INT_MAX;
+		int maxTile = INT_MIN;
+		for(const std::array<int,N+1> &rule : rules)
+			for(std::size_t i = 0; i < N; i++) {
+				if(palette.find(rule[i]) == palette.end()) {
+					int index = palette.size() + 1;
+					palette[rule[i]] = index;
+				}
+				minTile = std::min(minTile, rule[i]);
+				maxTile = std::max(maxTile, rule[i]);
+			}
+
+		//Dense palette for small tile ranges such as ascii
+		if(!palette.empty() && (int64_t)maxTile - (int64_t)minTile < MAP_TABLE_SIZE) {
+			paletteStart = minTile;
+			paletteTable.assign(maxTile - minTile + 1, 0);
+			for(auto &index : palette)
+				paletteTable[index.first - minTile] = index.second;
+		}
+
+		//Pick smallest table the key space fits in
+		base = palette.size() + 1;
+		uint64_t keys = 1;
+		mode = RULE_DENSE;
+		for(std::size_t i = 0; i < N; i++) {
+			if(keys > UINT64_MAX / base) {
+				mode = RULE_SPARSE;
+				break;
+			}
+			keys *= base;
+		}
+		if(mode == RULE_DENSE && keys > RULE_TABLE_SIZE)
+			mode = RULE_PACKED;
+		if(mode == RULE_DENSE)
+			dense.assign(keys, 0);
+
+		for(const std::array<int,N+1> &rule : rules) {
+			if(mode == RULE_SPARSE) {
+				std::array<int,N> key;
+				std::copy(rule.begin(), rule.begin() + N, key.begin());
+				sparse.insert_or_assign(key, rule[N]);
+				continue;
+			}
+
+			uint64_t key = 0;
+			for(int i = N - 1; i >= 0; i--)
+				key = key * base + paletteIndex(rule[i]);
+			if(mode == RULE_DENSE) {
+				results.push_back(rule[N]);
+				dense[key] = results.size();
+			} else
+				packed.insert_or_assign(key, rule[N]);
+		}
+	}
+
+	//Find result for tiles, or missing if no rule matches
+	int find(const std::array<int,N> &tiles, int missing) const {
+		if(mode == RULE_SPARSE) {
+			auto result = sparse.find(tiles);
+			return result != sparse.end() ? result->second : missing;
+		}
+
+		uint64_t key = 0;
+		for(int i = N - 1; i >= 0; i--) {
+			int index = paletteIndex(tiles[i]);
+			if(index == 0)
+				return missing;
+			key = key * base + index;
+		}
+
+		if(mode == RULE_DENSE) {
+			uint32_t result = dense[key];
+			return result != 0 ? results[result - 1] : missing;
+		}
+		auto result = packed.find(key);
+		return result != packed.end() ? result->second : missing;
+	}
+
+	int getMode() {
+		return mode;
+	}
+};
+
 //Map 4 tiles into 1 in a square
 class QuadIndexer : public Indexer {
 private:
-	//std::map<std::array<int,4>, int, QuadCmp> quads;
-	std::unordered_map<std::array<int,4>, int, QuadHash, QuadEqual> quads;
+	TileRuleTable<4> quads;
 
 public:
 	QuadIndexer(Indexer *previous, QuadMap _quads, int fallback, Vector2i scale=Vector2i(1,1), int _seed=0)
 		: Indexer(previous, fallback, scale) {
 
-		for(std::array<int,5> _quad : _quads){
-			quads.insert_or_assign({
-				_quad[0], _quad[1], _quad[2], _quad[3]
-			}, _quad[4]);
-		}
+		quads.build(_quads);
 	}
 
-	int getTileI(int x, int y) {
+	int getTileI(int x, int y) override {
 		if(inBounds(x, y) && inBounds(x+1,y+1))
 			return mapQuad(
 				getPrevious()->getTileI(x, y), getPrevious()->getTileI(x+1, y),
@@ -64,12 +187,51 @@ public:
 		return fallback;
 	}
 
+	//Each tile reads the one below and to the right
+	IntRect getFootprint() override {
+		return IntRect(-1, -1, 1, 1);
+	}
+
 	int mapQuad(int ul, int ur, int bl, int br) {
-		auto tile = quads.find({ul, ur, bl, br});
-		if(tile != quads.end())
-			return tile->second;
-		//std::cout << (char)ul << (char)ur << "\n" << (char)bl << (char)br << "\n\n";
-		return fallback;
+		return quads.find({ul, ur, bl, br}, fallback);
+	}
+
+	int getTableMode() {
+		return quads.getMode();
+	}
+};
+
+//Map the 3x3 square around each tile into 1
+class SquareIndexer : public Indexer {
+private:
+	TileRuleTable<9> squares;
+
+public:
+	SquareIndexer(Indexer *previous, SquareMap _squares, int fallback, Vector2i scale=Vector2i(1,1))
+		: Indexer(previous, fallback, scale) {
+
+		squares.build(_squares);
+	}
+
+	int getTileI(int x, int y) override {
+		if(!inBounds(x-1, y-1) || !inBounds(x+1, y+1))
+			return fallback;
+
+		Indexer *previous = getPrevious();
+		return squares.find({
+			previous->getTileI(x-1, y-1), previous->getTileI(x, y-1), previous->getTileI(x+1, y-1),
+			previous->getTileI(x-1, y),   previous->getTileI(x, y),   previous->getTileI(x+1, y),
+			previous->getTileI(x-1, y+1), previous->getTileI(x, y+1), previous->getTileI(x+1, y+1)
+		}, fallback);
+	}
+
+	//Each tile reads all of its neighbors
+	IntRect getFootprint() override {
+		return IntRect(-1, -1, 2, 2);
+	}
+
+	int getTableMode() {
+		return squares.getMode();
 	}
 };
 
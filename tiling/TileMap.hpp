@@ -1,8 +1,11 @@
 #pragma once
 
 #include "../core/Node.h"
+#include "../core/UpdateList.h"
 #include "../tiling/GridMaker.h"
 
+#include <algorithm>
+#include <map>
 #include <vector>
 #include <stdexcept>
 
@@ -11,12 +14,57 @@
  * Originally based off of sfml tutorial
  */
 
+//Downsampled chunk buffers at 1/2, 1/4 and 1/8 scale
+#define TILEMAP_LODS 3
+
+//Texture offset stepped over time for every tile using it
+struct TileAnimation {
+    int frames;
+    double delay;
+    int stride;
+    int frame = 0;
+    double timer = 0;
+};
+
+//Animated rect within a chunk, by texture number at frame 0
+struct AnimatedTile {
+    int tile;
+    int animation;
+};
+
+//Section of a TileMap with its own texture rects and buffer
+class TileChunk : public Node {
+public:
+    //Covered cells, relative to the TileMap border
+    IntRect cells;
+
+    //Texture rect index for each cell, -1 when empty
+    std::vector<int> rectSlots;
+    int usedRects = 0;
+
+    //Animated cells are drawn by an unbuffered node, so frame changes leave the buffer alone
+    Node *animatedNode = NULL;
+    std::vector<int> animatedSlots;
+    int animatedRects = 0;
+    std::map<int, AnimatedTile> animated;
+
+    //Scaled copies of the rects, created when first shown and rebuilt when shown after a change
+    Node *lods[TILEMAP_LODS] = {};
+    bool lodStale[TILEMAP_LODS] = {};
+
+    TileChunk(int layer, IntRect _cells) : Node(layer, RENDER_TEXTURE_ARRAY), cells(_cells) {
+
+    }
+};
+
 class TileMap : public Node {
 private:
     Vector2i tileSize;
 
     Indexer *indexes;
     uint gridUpdates = 0;
+    bool gridChanged = false;
+    int gridListener = -1;
 
     int offset = 0;
     Vector2i overlap;
@@ -26,10 +74,107 @@ private:
     Vector2i rectSize;
     Vector2i rectPos;
 
-public:
+    //Chunks ordered bottom row first, so hex rows overlap upwards like a single buffer
+    Vector2i chunkSize;
+    Vector2i chunkCount;
+    std::vector<TileChunk *> chunks;
+
+    //Animations by tile value, with defaultAnimation used for all other tiles
+    std::vector<TileAnimation> animations;
+    std::map<int, int> tileAnimations;
+    int defaultAnimation = -1;
+
+    //Level 0 is full size, each level above halves buffer resolution
+    int lodLevel = 0;
+    int lodMax = TILEMAP_LODS;
+    float lodHysteresis = 0.2;
+
+    //LOD nodes made after getNodes are added to the UpdateList directly
+    bool nodesListed = false;
+
+    int findAnimation(int tile) {
+        auto found = tileAnimations.find(tile);
+        if(found != tileAnimations.end())
+            return found->second;
+        return defaultAnimation;
+    }
+
+    //Texture position of a tile number
+    void setTextureCorner(TextureRect &quad, int tileNumber) {
+        quad.tx = (tileNumber % (getTextureSize().x / tileSize.x)) * tileSize.x;
+        quad.ty = (tileNumber / (getTextureSize().x / tileSize.x)) * tileSize.y;
+    }
+
+    void createChunks(int layer) {
+        chunkCount = (rectSize + chunkSize - Vector2i(1, 1)) / chunkSize;
+        Vector2i step = tileSize - overlap;
+        for(int y = chunkCount.y - 1; y >= 0; y--) {
+            for(int x = 0; x < chunkCount.x; x++) {
+                IntRect cells(x * chunkSize.x, y * chunkSize.y, chunkSize.x, chunkSize.y);
+                cells.width = std::min(cells.width, rectSize.x - cells.left);
+                cells.height = std::min(cells.height, rectSize.y - cells.top);
+
+                //Inner hex chunks cover tiles reaching past their cells
+                Vector2i apron;
+                if(hexRows && x < chunkCount.x - 1)
+                    apron.x = tileSize.x / 2;
+                if(hexRows && y > 0)
+                    apron.y = overlap.y;
+
+                TileChunk *chunk = new TileChunk(layer, cells);
+                chunk->setParent(this);
+                chunk->setOrigin(0, 0);
+                chunk->setSize(step * cells.size() + apron);
+                chunk->setPosition(step.x * cells.left, step.y * cells.top - apron.y);
+                chunk->setTexture(getTexture());
+                chunk->setupBuffer(0, COLOR_EMPTY);
+                chunk->getTextureRects()->reserve(cells.width * cells.height);
+                chunks.push_back(chunk);
+            }
+        }
+    }
+
+    //Buffer sized down then scaled back up, only allocated once first shown
+    Node *createLod(TileChunk *chunk, int level) {
+        int factor = 2 << level;
+        Vector2i size = chunk->getSize();
+        Node *lod = new Node(getLayer(), RENDER_TEXTURE_ARRAY);
+        lod->setParent(this);
+        lod->setOrigin(0, 0);
+        lod->setSize((size.x + factor - 1) / factor, (size.y + factor - 1) / factor);
+        lod->setPosition(chunk->getPosition());
+        lod->setTexture(getTexture());
+        lod->setupBuffer(0, COLOR_EMPTY);
+        lod->setScale(factor);
+        chunk->lods[level] = lod;
+        chunk->lodStale[level] = true;
+        if(nodesListed)
+            UpdateList::addNode(lod);
+        return lod;
+    }
+
+    //Drawn over the chunk without a buffer, created once a chunk has animated tiles
+    Node *createAnimatedNode(TileChunk *chunk) {
+        Vector2i step = tileSize - overlap;
+        Node *node = new Node(getLayer(), RENDER_TEXTURE_ARRAY);
+        node->setParent(this);
+        node->setOrigin(0, 0);
+        node->setSize(chunk->getSize().x, step.y * chunk->cells.height + overlap.y);
+        node->setPosition(step.x * chunk->cells.left, step.y * chunk->cells.top - overlap.y);
+        node->setTexture(getTexture());
+        chunk->animatedNode = node;
+        if(nodesListed)
+            UpdateList::addNode(node);
+        return node;
+    }
 
-    TileMap(sint _tileset, int _tileX, int _tileY, Indexer *_indexes, int layer=0, int _offset=0, bool _hexRows=false, Rect<uint> border=Rect<uint>())
-     : Node(layer, RENDER_TEXTURE_ARRAY), tileSize(_tileX, _tileY), indexes(_indexes), offset(_offset), hexRows(_hexRows) {
+protected:
+    //Subclasses that change animations before the first build can skip the initial load
+    TileMap(sint _tileset, int _tileX, int _tileY, Indexer *_indexes, int layer, int _offset, bool _hexRows, Rect<uint> border, Vector2i _chunkSize, bool load)
+     : Node(layer, RENDER_TEXTURE_ARRAY), tileSize(_tileX, _tileY), indexes(_indexes), offset(_offset), hexRows(_hexRows), chunkSize(_chunkSize) {
+
+        if(chunkSize.x <= 0 || chunkSize.y <= 0)
+            throw new std::invalid_argument("TileMap chunk size must be positive");
 
         //Set sizing
         fullSize = rectSize = indexes->getSize() * indexes->getScale();
@@ -52,19 +197,43 @@ public:
         setOrigin(0, 0);
         setPosition((tileSize - overlap) * rectPos);
 
+        //Map itself draws nothing, chunks are culled and drawn separately
         setTexture(_tileset);
-        setupBuffer(0, COLOR_EMPTY);
+        createChunks(layer);
 
         //std::cout << " " << startX << "," << startY << ", " << width << "," << height << "\n";
         //std::cout << toString(getGPosition()) << ":" << toString(getGScale()) <<  "\n";
 
-        getTextureRects()->reserve(rectSize.x * rectSize.y);
-
         //Load textures
-        reload();
+        gridListener = indexes->subscribe([this]() { gridChanged = true; });
+        if(load)
+            reload();
+    }
+
+    //Empty map with no chunks, for AnimatedTileMap frames added later
+    TileMap(Vector2i size, int layer) : Node(layer, RENDER_TEXTURE_ARRAY), indexes(NULL), hexRows(false) {
+        setSize(size);
+        setOrigin(0, 0);
+    }
+
+public:
+
+    TileMap(sint _tileset, int _tileX, int _tileY, Indexer *_indexes, int layer=0, int _offset=0, bool _hexRows=false, Rect<uint> border=Rect<uint>(), Vector2i _chunkSize=Vector2i(32, 32))
+     : TileMap(_tileset, _tileX, _tileY, _indexes, layer, _offset, _hexRows, border, _chunkSize, true) {
+
     }
 
     ~TileMap() {
+        if(indexes != NULL)
+            indexes->unsubscribe(gridListener);
+        for(TileChunk *chunk : chunks) {
+            for(Node *lod : chunk->lods)
+                if(lod != NULL)
+                    lod->setDelete();
+            if(chunk->animatedNode != NULL)
+                chunk->animatedNode->setDelete();
+            chunk->setDelete();
+        }
     }
 
     void setOffset(int _offset) {
@@ -75,119 +244,391 @@ public:
         return (getTextureSize().x / tileSize.x) * (getTextureSize().y / tileSize.y);
     }
 
-    void reload() {
-        int numTextures = countTextures();
-        int usedRects = 0;
-        bool hasBuffer = true;
+    //Build texture rect for one cell of a chunk, reusing its previous slot
+    void reloadTile(TileChunk *chunk, int i, int j, int numTextures) {
         int rotationCount = (hexRows) ? 6 : 4;
+        int &slot = chunk->rectSlots[i + j * chunk->cells.width];
+        int &animatedSlot = chunk->animatedSlots[i + j * chunk->cells.width];
+
+        //Buffer rows are flipped within each chunk
+        int x = i + chunk->cells.left + rectPos.x;
+        int y = chunk->cells.top + chunk->cells.height - (j + 1) + rectPos.y;
+
+        // get the current tile number
+        int tileValue = indexes->getTile(Vector2f(x, y));
+        int tileNumber = (tileValue % numTextures) + offset;
+        int rotations = (tileValue / numTextures);
+        int fliph = rotations / rotationCount % 2;
+        int flipv = rotations / (rotationCount * 2);
+
+        //Animated tiles skip the buffer, so they keep rows top down
+        int animation = findAnimation(tileValue % numTextures);
+        bool hasBuffer = animation == -1;
+        if(animatedSlot != -1)
+            chunk->animated.erase(animatedSlot);
 
-        // populate the vertex array, with one quad per tile
-        for(int j = 0; j < rectSize.y; ++j) {
-            for(int i = 0; i < rectSize.x; ++i) {
-                // get the current tile number
-                int tileValue = indexes->getTile(Vector2f(i + rectPos.x, hasBuffer ? fullSize.y - (j + rectPos.y + 1) : j + rectPos.y));
-                int tileNumber = (tileValue % numTextures) + offset;
-                int rotations = (tileValue / numTextures);
-                int fliph = rotations / rotationCount % 2;
-                int flipv = rotations / (rotationCount * 2);
-
-                if(hasBuffer)
-                    flipv = (flipv == 0) ? 1 : 0;
-
-                // find its position in the tileset texture
-                int tu = tileNumber % (getTextureSize().x / tileSize.x);
-                int tv = tileNumber / (getTextureSize().x / tileSize.x);
-
-                int xOffset = 0;
-                if(hexRows && (j + rectPos.y) % 2 == 1)
-                    xOffset = tileSize.x / 2;
-
-                if(tileNumber - offset != -1) {
-                    TextureRect quad;
-                    quad.px = i * (tileSize.x - overlap.x) + xOffset;
-                    quad.py = j * (tileSize.y - overlap.y);
-                    quad.pwidth = fliph ? -tileSize.x : tileSize.x;
-                    quad.pheight = flipv ? -tileSize.y : tileSize.y;
-                    quad.tx = tu * tileSize.x;
-                    quad.ty = tv * tileSize.y;
-                    quad.twidth = fliph ? -tileSize.x : tileSize.x;
-                    quad.theight = flipv ? -tileSize.y : tileSize.y;
-                    quad.rotation = (360/rotationCount)*(rotations % rotationCount);
-                    setTextureRect(quad, usedRects++);
-                }
+        if(hasBuffer)
+            flipv = (flipv == 0) ? 1 : 0;
+
+        //Shift matches rows counted from the bottom of the full grid
+        int xOffset = 0;
+        if(hexRows && (fullSize.y - y - 1) % 2 == 1)
+            xOffset = tileSize.x / 2;
+
+        //Leave empty rects in place until next full reload
+        TextureRect empty = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+        if(tileNumber - offset != -1) {
+            TextureRect quad;
+            quad.px = i * (tileSize.x - overlap.x) + xOffset;
+            quad.py = (hasBuffer ? j : chunk->cells.height - (j + 1)) * (tileSize.y - overlap.y);
+            quad.pwidth = fliph ? -tileSize.x : tileSize.x;
+            quad.pheight = flipv ? -tileSize.y : tileSize.y;
+            setTextureCorner(quad, tileNumber);
+            quad.twidth = fliph ? -tileSize.x : tileSize.x;
+            quad.theight = flipv ? -tileSize.y : tileSize.y;
+            quad.rotation = (360/rotationCount)*(rotations % rotationCount);
+
+            // find its position in the tileset texture
+            if(!hasBuffer) {
+                TileAnimation &anim = animations[animation];
+                if(chunk->animatedNode == NULL)
+                    createAnimatedNode(chunk);
+                if(animatedSlot == -1)
+                    animatedSlot = chunk->animatedRects++;
+                chunk->animated[animatedSlot] = {tileNumber, animation};
+                setTextureCorner(quad, tileNumber + anim.frame * anim.stride);
+                chunk->animatedNode->setTextureRect(quad, animatedSlot);
+                if(slot != -1)
+                    chunk->setTextureRect(empty, slot);
+            } else {
+                if(slot == -1)
+                    slot = chunk->usedRects++;
+                chunk->setTextureRect(quad, slot);
+                if(animatedSlot != -1)
+                    chunk->animatedNode->setTextureRect(empty, animatedSlot);
             }
+        } else {
+            if(slot != -1)
+                chunk->setTextureRect(empty, slot);
+            if(animatedSlot != -1)
+                chunk->animatedNode->setTextureRect(empty, animatedSlot);
         }
+    }
+
+    //Copy rects into a downsampled level
+    void reloadLod(TileChunk *chunk, int level) {
+        float factor = 2 << level;
+        std::vector<TextureRect> *rects = chunk->lods[level]->getTextureRects();
+        rects->resize(chunk->usedRects);
+        for(int i = 0; i < chunk->usedRects; i++) {
+            TextureRect quad = (*chunk->getTextureRects())[i];
+            quad.px /= factor;
+            quad.py /= factor;
+            quad.pwidth /= factor;
+            quad.pheight /= factor;
+            (*rects)[i] = quad;
+        }
+        chunk->lodStale[level] = false;
+    }
+
+    //Show only the current level of a chunk
+    void showChunk(TileChunk *chunk) {
+        if(lodLevel > 0 && chunk->lods[lodLevel - 1] == NULL && chunk->usedRects > 0)
+            createLod(chunk, lodLevel - 1);
+
+        chunk->setHidden(lodLevel != 0 || chunk->usedRects == 0);
+        if(chunk->animatedNode != NULL)
+            chunk->animatedNode->setHidden(chunk->animatedRects == 0);
+        for(int level = 0; level < TILEMAP_LODS; level++)
+            if(chunk->lods[level] != NULL)
+                chunk->lods[level]->setHidden(lodLevel != level + 1 || chunk->usedRects == 0);
+
+        if(lodLevel > 0 && chunk->lods[lodLevel - 1] != NULL && chunk->lodStale[lodLevel - 1]) {
+            reloadLod(chunk, lodLevel - 1);
+            chunk->lods[lodLevel - 1]->scheduleBufferRefresh();
+        }
+    }
+
+    //Redraw chunk after its rects changed, leaving other levels until shown
+    void refreshChunk(TileChunk *chunk) {
+        for(int level = 0; level < TILEMAP_LODS; level++)
+            chunk->lodStale[level] = true;
+        chunk->scheduleBufferRefresh();
+        showChunk(chunk);
+    }
+
+    //Rebuild every cell of one chunk
+    void reloadChunk(TileChunk *chunk, int numTextures) {
+        chunk->usedRects = 0;
+        chunk->animatedRects = 0;
+        chunk->animated.clear();
+        chunk->rectSlots.assign(chunk->cells.width * chunk->cells.height, -1);
+        chunk->animatedSlots.assign(chunk->cells.width * chunk->cells.height, -1);
+
+        // populate the vertex array, with one quad per tile
+        for(int j = 0; j < chunk->cells.height; ++j)
+            for(int i = 0; i < chunk->cells.width; ++i)
+                reloadTile(chunk, i, j, numTextures);
+
+        chunk->getTextureRects()->resize(chunk->usedRects);
+        if(chunk->animatedNode != NULL)
+            chunk->animatedNode->getTextureRects()->resize(chunk->animatedRects);
+        refreshChunk(chunk);
+    }
+
+    void reload() {
+        if(indexes == NULL)
+            return;
+        int numTextures = countTextures();
+        for(TileChunk *chunk : chunks)
+            reloadChunk(chunk, numTextures);
         gridUpdates = indexes->getUpdateCount();
-        getTextureRects()->resize(usedRects);
+    }
 
-        if(hasBuffer)
-            scheduleBufferRefresh();
+    //Rebuild only the cells covering a changed grid area, in chunks that overlap it
+    void reload(IntRect area) {
+        if(area.left <= 0 && area.top <= 0 && area.width >= indexes->getSize().x && area.height >= indexes->getSize().y)
+            return reload();
+
+        Vector2i scale = indexes->getScale();
+        int startX = std::max(area.left * scale.x - rectPos.x, 0);
+        int endX = std::min((area.left + area.width) * scale.x - rectPos.x, rectSize.x);
+        int startY = std::max(area.top * scale.y - rectPos.y, 0);
+        int endY = std::min((area.top + area.height) * scale.y - rectPos.y, rectSize.y);
+        if(startX >= endX || startY >= endY)
+            return;
+
+        int numTextures = countTextures();
+        for(int cy = startY / chunkSize.y; cy <= (endY - 1) / chunkSize.y; cy++) {
+            for(int cx = startX / chunkSize.x; cx <= (endX - 1) / chunkSize.x; cx++) {
+                TileChunk *chunk = chunks[cx + (chunkCount.y - 1 - cy) * chunkCount.x];
+                IntRect cells = chunk->cells;
+
+                //Grid rows are flipped into the buffer
+                int left = std::max(startX, cells.left) - cells.left;
+                int right = std::min(endX, cells.left + cells.width) - cells.left;
+                int bottom = cells.top + cells.height - std::min(endY, cells.top + cells.height);
+                int top = cells.top + cells.height - std::max(startY, cells.top);
+                for(int j = bottom; j < top; ++j)
+                    for(int i = left; i < right; ++i)
+                        reloadTile(chunk, i, j, numTextures);
+
+                refreshChunk(chunk);
+            }
+        }
     }
 
     void setIndexer(Indexer *indexes) {
+        if(this->indexes != NULL)
+            this->indexes->unsubscribe(gridListener);
         this->indexes = indexes;
+        gridListener = indexes->subscribe([this]() { gridChanged = true; });
         reload();
     }
 
+    //Add an animation stepping the texture by stride each frame, manual only without a delay
+    int addAnimation(int frames, double delay, int stride) {
+        if(frames <= 0)
+            throw new std::invalid_argument("TileMap animation needs at least one frame");
+        animations.push_back({frames, delay, stride, 0, delay});
+        return animations.size() - 1;
+    }
+
+    //Apply animation to a tile value, or -1 to stop animating, taking effect on reload
+    void setTileAnimation(int tile, int animation) {
+        if(animation == -1)
+            tileAnimations.erase(tile);
+        else
+            tileAnimations[tile] = animation;
+    }
+
+    void setDefaultAnimation(int animation) {
+        defaultAnimation = animation;
+    }
+
+    int getAnimationFrame(int animation) {
+        return animations[animation].frame;
+    }
+
+    //Move animation to a frame, updating only its tiles
+    void setAnimationFrame(int animation, int frame) {
+        animations[animation].frame = frame % animations[animation].frames;
+        std::vector<bool> changed(animations.size(), false);
+        changed[animation] = true;
+        refreshAnimations(changed);
+    }
+
+    //Rewrite texture corners of animated rects in one pass, without touching chunk buffers
+    void refreshAnimations(const std::vector<bool> &changed) {
+        for(TileChunk *chunk : chunks) {
+            if(chunk->animatedNode == NULL)
+                continue;
+            std::vector<TextureRect> *rects = chunk->animatedNode->getTextureRects();
+            for(auto &tile : chunk->animated) {
+                if(!changed[tile.second.animation])
+                    continue;
+                TileAnimation &anim = animations[tile.second.animation];
+                setTextureCorner((*rects)[tile.first], tile.second.tile + anim.frame * anim.stride);
+            }
+        }
+    }
+
+    //Pick level from world pixels per screen pixel, only switching past a margin
+    void updateLod(float factor) {
+        int level = lodLevel;
+        while(level < lodMax && factor >= (2 << level) * (1 + lodHysteresis))
+            level++;
+        while(level > 0 && factor < (1 << level) * (1 - lodHysteresis))
+            level--;
+        if(level != lodLevel)
+            setLodLevel(level);
+    }
+
+    void setLodLevel(int level) {
+        if(level < 0 || level > TILEMAP_LODS)
+            throw new std::invalid_argument("TileMap LOD level out of range");
+        lodLevel = level;
+        for(TileChunk *chunk : chunks)
+            showChunk(chunk);
+    }
+
+    int getLodLevel() {
+        return lodLevel;
+    }
+
+    //Highest level picked from the camera, 0 to always draw full size
+    void setLodMax(int level) {
+        lodMax = std::clamp(level, 0, TILEMAP_LODS);
+        if(lodLevel > lodMax)
+            setLodLevel(lodMax);
+    }
+
+    void setLodHysteresis(float margin) {
+        lodHysteresis = margin;
+    }
+
+    //Bytes of chunk buffers at a level, counting only downsampled buffers already created
+    size_t getBufferMemory(int level) {
+        size_t bytes = 0;
+        for(TileChunk *chunk : chunks) {
+            Node *node = (level == 0) ? chunk : chunk->lods[level - 1];
+            if(node == NULL)
+                continue;
+            Vector2f size = node->getSize() / node->getScale();
+            bytes += (size_t)size.x * (size_t)size.y * 4;
+        }
+        return bytes;
+    }
+
+    //Only check for changes after a notification
     void update(double time) {
-        if(this->indexes->getUpdateCount() != gridUpdates)
-            reload();
+        Vector2f factor = UpdateList::getScaleFactor() / getScale().abs();
+        updateLod(std::max(factor.x, factor.y));
+
+        //Step animation timers
+        std::vector<bool> changed(animations.size(), false);
+        bool anyChanged = false;
+        for(sint i = 0; i < animations.size(); i++) {
+            TileAnimation &anim = animations[i];
+            if(anim.delay <= 0 || anim.frames <= 1)
+                continue;
+            anim.timer -= time;
+            while(anim.timer <= 0) {
+                anim.timer += anim.delay;
+                anim.frame = (anim.frame + 1) % anim.frames;
+                changed[i] = anyChanged = true;
+            }
+        }
+        if(anyChanged)
+            refreshAnimations(changed);
+
+        if(!gridChanged)
+            return;
+        gridChanged = false;
+
+        uint updates = this->indexes->getUpdateCount();
+        if(updates != gridUpdates) {
+            std::vector<IntRect> changes = indexes->getChanges(gridUpdates, updates);
+            gridUpdates = updates;
+            for(IntRect area : changes)
+                reload(area);
+        }
+    }
+
+    Vector2i getChunkSize() {
+        return chunkSize;
+    }
+
+    const std::vector<TileChunk *> &getChunks() {
+        return chunks;
+    }
+
+    //Map for updates followed by each chunk to draw
+    std::vector<Node *> getNodes() {
+        std::vector<Node *> nodes;
+        nodes.push_back(this);
+        for(TileChunk *chunk : chunks) {
+            nodes.push_back(chunk);
+            for(Node *lod : chunk->lods)
+                if(lod != NULL)
+                    nodes.push_back(lod);
+            if(chunk->animatedNode != NULL)
+                nodes.push_back(chunk->animatedNode);
+        }
+        nodesListed = true;
+        return nodes;
     }
 };
 
-//Swap between multiple tilemaps with offset textures
-class AnimatedTileMap : public Node {
+//Tilemap cycling every tile through frames of offset textures, sharing one set of rects
+//Separate TileMaps can also be added as frames, showing one at a time
+class AnimatedTileMap : public TileMap {
 private:
-    std::vector<TileMap *> tilemaps;
+    int animation = -1;
     int numTiles = 0;
-    int maxFrames = 0;
+    int maxFrames;
     int frame = 0;
     double nextTime = 0;
     double delay = -1;
     int pauseAfter = 0;
     bool paused = false;
 
+    //Only used by frames added with addFrame
+    std::vector<TileMap *> frames;
+
+    void showFrame() {
+        if(animation != -1)
+            setAnimationFrame(animation, frame);
+        for(int i = 0; i < (int)frames.size(); i++)
+            frames[i]->setHidden(i != frame);
+    }
+
 public:
     AnimatedTileMap(int tileset, int tileX, int tileY, Indexer *indexes, int frames, double delay, int layer = 0)
-     : Node(layer, RENDER_TEXTURE_SINGLE) {
-        int width = indexes->getSize().x;
-        int height = indexes->getSize().y;
-        setSize(Vector2i(tileX * width, tileY * height));
-        setOrigin(0, 0);
-
+     : TileMap(tileset, tileX, tileY, indexes, layer, 0, false, Rect<uint>(), Vector2i(32, 32), false) {
         this->maxFrames = frames;
         this->delay = delay;
         this->nextTime = delay;
+        this->numTiles = countTextures() / frames;
 
-        //Build each frame
-        for(int i = 0; i < frames; i++) {
-            //Load new tilemap
-            TileMap *map = new TileMap(tileset, tileX, tileY, indexes, layer, i * numTiles);
-            map->setParent(this);
-            tilemaps.push_back(map);
-
-            if(i == 0) {
-                this->numTiles = map->countTextures() / frames;
-                setTexture(map->getRenderComponent(false)->getTexture());
-            }
-        }
+        //Frames follow each other in the texture, stepped here so pausing works
+        animation = addAnimation(frames, 0, numTiles);
+        setDefaultAnimation(animation);
+        TileMap::reload();
     }
 
-    AnimatedTileMap(Vector2i size, double delay, int layer = 0) : Node(layer) {
-        this->numTiles = 0;
+    //Empty and paused until frames are added
+    AnimatedTileMap(Vector2i size, double delay, int layer = 0) : TileMap(size, layer) {
         this->maxFrames = 0;
         this->delay = delay;
         this->nextTime = delay;
         this->paused = true;
-
-        setSize(size);
-        setOrigin(0, 0);
     }
 
     //Update timer
     void update(double time) {
         //Every half second
-        if(!paused) {
+        if(!paused && maxFrames > 0) {
             if((nextTime -= time) <= 0) {
                 nextTime = delay;
                 frame++;
@@ -202,25 +643,25 @@ public:
                 //Reset to start frame
                 if(frame == maxFrames)
                     frame = 0;
-                setTexture(tilemaps[frame]->getRenderComponent(false)->getTexture());
+                showFrame();
             }
         }
-        for(TileMap *map : tilemaps)
+        for(TileMap *map : frames)
             map->update(time);
+        TileMap::update(time);
     }
 
-    //std::vector<TextureRect> *getTextureRects() {
-    //    return tilemaps[frame]->getTextureRects();
-    //}
-
+    //Use a separate map as the next frame, offset past the textures of earlier frames
     void addFrame(TileMap *map) {
-        map->setOffset(tilemaps.size() * numTiles);
-        tilemaps.push_back(map);
+        map->setOffset(frames.size() * numTiles);
+        map->setHidden(frames.size() != (sint)frame);
+        frames.push_back(map);
         maxFrames++;
     }
 
+    //Frames added with addFrame
     TileMap *getFrame(int index) {
-        return tilemaps[index];
+        return frames[index];
     }
 
     int getCurrentFrame() {
@@ -229,6 +670,7 @@ public:
 
     void setCurrentFrame(int frame) {
         this->frame = frame;
+        showFrame();
     }
 
     void setPaused(bool paused) {
@@ -239,71 +681,29 @@ public:
         this->pauseAfter = frame;
     }
 
-    //Reload all tilemaps
+    //Reload shared rects and every added frame
     void reload() {
-        for(int i = 0; i < maxFrames; i++)
-            tilemaps[i]->reload();
+        TileMap::reload();
+        for(TileMap *map : frames)
+            map->reload();
     }
 
+    //Shared chunks followed by the nodes of every added frame
     std::vector<Node *> getNodes() {
-        std::vector<Node *> nodes;
-        nodes.push_back(this);
-        for(TileMap *map : tilemaps)
-            nodes.push_back(map);
+        std::vector<Node *> nodes = TileMap::getNodes();
+        for(TileMap *map : frames) {
+            std::vector<Node *> frameNodes = map->getNodes();
+            nodes.insert(nodes.end(), frameNodes.begin(), frameNodes.end());
+        }
         return nodes;
     }
 };
 
-//Split up tilemaps that are too large for one buffer
-class LargeTileMap : public Node {
-private:
-    std::vector<TileMap *> tilemaps;
-
-    uint fullWidth;
-    uint fullHeight;
-    uint sectionWidth;
-    uint sectionHeight;
-    uint countX;
-    uint countY;
-
+//Tilemap with chunks kept under the maximum texture size
+class LargeTileMap : public TileMap {
 public:
-    LargeTileMap(int tileset, int tileX, int tileY, Indexer *indexes, int layer) : Node(layer, RENDER_NONE) {
-        fullWidth = indexes->getSize().x;
-        fullHeight = indexes->getSize().y;
-        setSize(Vector2i(tileX * fullWidth, tileY * fullHeight));
-        setOrigin(0, 0);
+    LargeTileMap(int tileset, int tileX, int tileY, Indexer *indexes, int layer)
+     : TileMap(tileset, tileX, tileY, indexes, layer, 0, false, Rect<uint>(), Vector2i(16000 / tileX, 16000 / tileY)) {
 
-        countX = std::ceil(fullWidth / (16000.0 / tileX));
-        countY = std::ceil(fullHeight / (16000.0 / tileY));
-        sectionWidth = fullWidth / countX;
-        sectionHeight = fullHeight / countY;
-
-        //std::cout << countX << "," << countY << ": " << fullWidth << "," << fullHeight << "\n";
-        //std::cout << toString(getGPosition()) << ":" << toString(getScale()) <<  "\n";
-
-        //Build each frame
-        for(uint x = 0; x < countX; x++) {
-            for(uint y = 0; y < countY; y++) {
-                //Add new tilemap
-                Rect<uint> border(x * sectionWidth, y * sectionHeight, sectionWidth, sectionHeight);
-                TileMap *map = new TileMap(tileset, tileX, tileY, indexes, layer, 0, false, border);
-                map->setParent(this);
-                tilemaps.push_back(map);
-            }
-        }
     }
-
-    //Reload all tilemaps
-    void reload() {
-        for(TileMap *map : tilemaps)
-            map->reload();
-    }
-
-    std::vector<Node *> getNodes() {
-        std::vector<Node *> nodes;
-        //nodes.push_back(this);
-        for(TileMap *map : tilemaps)
-            nodes.push_back(map);
-        return nodes;
-    }
-};
\ No newline at end of file
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "../core/Vector.h"
+
+/*
+ * Small helpers for splitting grid work across threads
+ */
+
+//Pick thread count, with 0 meaning all hardware threads
+static int parallelThreadCount(int threads) {
+	if(threads <= 0)
+		threads = std::thread::hardware_concurrency();
+	return std::max(threads, 1);
+}
+
+//Run func over square blocks of an area, each thread pulling the next free block
+//func receives the block and the index of the thread running it
+static void parallelBlocks(Vector2i size, int blockSize, int threads, std::function<void(IntRect, int)> func) {
+	int countX = (size.x + blockSize - 1) / blockSize;
+	int countY = (size.y + blockSize - 1) / blockSize;
+	int count = countX * countY;
+	threads = std::min(parallelThreadCount(threads), std::max(count, 1));
+
+	std::atomic<int> next = 0;
+	auto worker = [&](int thread) {
+		int i;
+		while((i = next++) < count) {
+			int x = (i % countX) * blockSize;
+			int y = (i / countX) * blockSize;
+			func(IntRect(x, y, std::min(blockSize, size.x - x), std::min(blockSize, size.y - y)), thread);
+		}
+	};
+
+	//Current thread works as well
+	std::vector<std::thread> pool;
+	for(int t = 1; t < threads; t++)
+		pool.emplace_back(worker, t);
+	worker(0);
+	for(std::thread &thread : pool)
+		thread.join();
+}
+
+//Run func over even bands of a range
+static void parallelRange(int count, int threads, std::function<void(int, int)> func) {
+	threads = std::min(parallelThreadCount(threads), std::max(count, 1));
+	int band = (count + threads - 1) / threads;
+
+	std::vector<std::thread> pool;
+	for(int t = 1; t < threads; t++)
+		if(t * band < count)
+			pool.emplace_back(func, t * band, std::min((t + 1) * band, count));
+	func(0, std::min(band, count));
+	for(std::thread &thread : pool)
+		thread.join();
+}